@@ -0,0 +1,277 @@
+// Benchmark suite: renders the interesting_scenes.cpp presets and synthetic
+// scaling scenes headlessly and writes the results as JSON
+//
+// Usage: ./raytracer_bench [--out bench.json] [--frames N] [--warmup N]
+//                          [--threads 1,4] [--resolutions 320x240,800x600]
+//                          [--modes single,packet,device] [--scenes name,...] [--quick]
+//                          [--light-samples K] [--backends simd,scalar,accel]
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <omp.h>
+
+#include "renderer.h"
+#include "interesting_scenes.cpp"
+
+struct BenchScene {
+    std::string name;
+    void (*setup)(Scene&);
+};
+
+struct BenchResult {
+    std::string scene;
+    size_t spheres, lights;
+    double build_ms;
+    std::string mode;
+    std::string backend;
+    int threads, width, height, frames;
+    double median_ms, p95_ms, min_ms;
+    RayCounters rays;       // per frame
+};
+
+static std::vector<std::string> split(const std::string& s, char sep) {
+    std::vector<std::string> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, sep)) {
+        if (!item.empty()) out.push_back(item);
+    }
+    return out;
+}
+
+// Nearest-rank percentile of an unsorted sample
+static double percentile(std::vector<double> v, double p) {
+    std::sort(v.begin(), v.end());
+    size_t rank = size_t(std::ceil(p * v.size()));
+    return v[std::min(v.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+// Random spheres filling an 80^3 box in front of the preset camera, sized so
+// the box stays about equally full at every count. Deterministic for a given n
+static void addSyntheticSpheres(Scene& scene, int n) {
+    std::mt19937 rng(1234);
+    auto uniform = [&](double lo, double hi) { return lo + (hi - lo) * (rng() / 4294967296.0); };
+    
+    Material materials[4] = {
+        Material(Color(0.9, 0.3, 0.3), 0.1, 0.7, 0.6, 64, 0.0),
+        Material(Color(0.3, 0.9, 0.3), 0.1, 0.7, 0.6, 64, 0.3),
+        Material(Color(0.3, 0.3, 0.9), 0.1, 0.6, 0.9, 128, 0.6),
+        Material(Color(0.9, 0.9, 0.9), 0.1, 0.4, 1.0, 256, 0.8)
+    };
+    double spacing = 80.0 / std::cbrt(double(n));
+    for (int i = 0; i < n; i++) {
+        Vec3 c(uniform(-40, 40), uniform(-40, 40), uniform(-120, -40));
+        scene.addSphere(Sphere(c, spacing * uniform(0.1, 0.3), materials[i & 3]));
+    }
+}
+
+static void setupSynthetic(Scene& scene, int n) {
+    addSyntheticSpheres(scene, n);
+    scene.addLight(Light(Vec3(-50, 60, 20), Color(1, 1, 1), 0.8));
+    scene.addLight(Light(Vec3(60, 30, 10), Color(1, 1, 1), 0.6));
+}
+
+// The 1k scene lit by 256 colored lights of mixed strength instead of two,
+// summing to about the same brightness, for the light sampling mode
+static void setupSyntheticLights(Scene& scene) {
+    addSyntheticSpheres(scene, 1000);
+    std::mt19937 rng(5678);
+    auto uniform = [&](double lo, double hi) { return lo + (hi - lo) * (rng() / 4294967296.0); };
+    for (int l = 0; l < 256; l++) {
+        Vec3 p(uniform(-80, 80), uniform(10, 80), uniform(-140, 20));
+        Color c(uniform(0.3, 1), uniform(0.3, 1), uniform(0.3, 1));
+        scene.addLight(Light(p, c, 5.6 / 256 * std::pow(uniform(0.1, 1), 3)));
+    }
+}
+
+static void setupSynthetic1k(Scene& scene) { setupSynthetic(scene, 1000); }
+static void setupSynthetic100k(Scene& scene) { setupSynthetic(scene, 100000); }
+static void setupSynthetic1M(Scene& scene) { setupSynthetic(scene, 1000000); }
+
+static void writeJSON(std::ostream& out, const std::vector<BenchResult>& results, int light_samples) {
+    out << "{\n";
+    out << "  \"version\": 1,\n";
+    out << "  \"compiler\": \"" << __VERSION__ << "\",\n";
+    out << "  \"precision\": \"" << Precision<Real>::name() << "\",\n";
+    out << "  \"simd_lanes\": " << SIMD_LANES << ",\n";
+    out << "  \"light_samples\": " << light_samples << ",\n";
+    out << "  \"max_threads\": " << omp_get_num_procs() << ",\n";
+    out << "  \"runs\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        double rays_per_sec = r.rays.total() / (r.median_ms / 1000.0);
+        out << "    {\"scene\": \"" << r.scene << "\", \"spheres\": " << r.spheres
+            << ", \"lights\": " << r.lights << ", \"build_ms\": " << r.build_ms
+            << ", \"mode\": \"" << r.mode << "\", \"backend\": \"" << r.backend << "\", \"threads\": " << r.threads
+            << ", \"width\": " << r.width << ", \"height\": " << r.height << ", \"frames\": " << r.frames
+            << ", \"median_ms\": " << r.median_ms << ", \"p95_ms\": " << r.p95_ms << ", \"min_ms\": " << r.min_ms
+            << ", \"primary_rays\": " << r.rays.primary << ", \"secondary_rays\": " << r.rays.secondary()
+            << ", \"shadow_rays\": " << r.rays.shadow << ", \"reflection_rays\": " << r.rays.reflection
+            << ", \"shadow_cached\": " << r.rays.shadow_cached << ", \"lights_culled\": " << r.rays.lights_culled
+            << ", \"sphere_tests\": " << r.rays.sphere_tests
+            << ", \"accel_jobs\": " << r.rays.accel_jobs << ", \"accel_batches\": " << r.rays.accel_batches
+            << ", \"rays_per_sec\": " << uint64_t(rays_per_sec) << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::string out_path = "bench.json";
+    int frames = 5;
+    int warmup = 1;
+    std::vector<std::string> thread_list;
+    std::vector<std::string> resolutions = {"320x240", "800x600"};
+    std::vector<std::string> modes = {"single", "packet"};
+    std::vector<std::string> backends = {"simd"};
+    std::vector<std::string> only;
+    TraceSettings settings;
+    
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--out" && a + 1 < argc) {
+            out_path = argv[++a];
+        } else if (arg == "--frames" && a + 1 < argc) {
+            frames = std::max(1, atoi(argv[++a]));
+        } else if (arg == "--warmup" && a + 1 < argc) {
+            warmup = std::max(0, atoi(argv[++a]));
+        } else if (arg == "--threads" && a + 1 < argc) {
+            thread_list = split(argv[++a], ',');
+        } else if (arg == "--resolutions" && a + 1 < argc) {
+            resolutions = split(argv[++a], ',');
+        } else if (arg == "--modes" && a + 1 < argc) {
+            modes = split(argv[++a], ',');
+        } else if (arg == "--backends" && a + 1 < argc) {
+            backends = split(argv[++a], ',');
+        } else if (arg == "--scenes" && a + 1 < argc) {
+            only = split(argv[++a], ',');
+        } else if (arg == "--light-samples" && a + 1 < argc) {
+            settings.light_samples = std::max(0, atoi(argv[++a]));
+        } else if (arg == "--quick") {
+            frames = 1;
+            warmup = 0;
+            resolutions = {"160x120"};
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+    
+    for (const std::string& b : backends) {
+        if (!findBackend(b)) {
+            std::cerr << "Unknown backend " << b << " (scalar, simd or accel)" << std::endl;
+            return 1;
+        }
+    }
+    
+    std::vector<int> threads;
+    if (thread_list.empty()) {
+        threads.push_back(1);
+        if (omp_get_num_procs() > 1) threads.push_back(omp_get_num_procs());
+    } else {
+        for (const std::string& t : thread_list) threads.push_back(std::max(1, atoi(t.c_str())));
+    }
+    
+    std::vector<BenchScene> scenes = {
+        {"mirror_gallery", setupMirrorGallery},
+        {"neon_dreams", setupNeonDreams},
+        {"planetary_system", setupPlanetarySystem},
+        {"glass_orbs", setupGlassOrbs},
+        {"golden_hour", setupGoldenHour},
+        {"candy_land", setupCandyLand},
+        {"deep_ocean", setupDeepOcean},
+        {"synthetic_1k", setupSynthetic1k},
+        {"synthetic_lights", setupSyntheticLights},
+        {"synthetic_100k", setupSynthetic100k},
+        {"synthetic_1m", setupSynthetic1M}
+    };
+    
+    Camera camera(Vec3(0, 1, 5), Vec3(0, 0, 0));
+    Renderer renderer;
+    renderer.setVerbose(false);
+    renderer.setTraceSettings(settings);
+    std::vector<BenchResult> results;
+    
+    for (const BenchScene& bs : scenes) {
+        if (!only.empty() && std::find(only.begin(), only.end(), bs.name) == only.end()) continue;
+        
+        Scene scene;
+        auto build_start = std::chrono::high_resolution_clock::now();
+        bs.setup(scene);
+        scene.buildBVH();
+        double build_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - build_start).count();
+        
+        // Every backend renders the same scene object, so they see identical geometry
+        for (const std::string& backend : backends) {
+            scene.setBackend(*findBackend(backend));
+            for (const std::string& mode : modes) {
+                renderer.setTraceMode(mode == "packet" ? TraceMode::Packet : mode == "device" ? TraceMode::Device : TraceMode::Single);
+                for (int t : threads) {
+                    omp_set_num_threads(t);
+                    for (const std::string& res : resolutions) {
+                        int width = 0, height = 0;
+                        if (sscanf(res.c_str(), "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+                            std::cerr << "Bad resolution " << res << std::endl;
+                            return 1;
+                        }
+                        
+                        FrameBuffer target(width, height);
+                        for (int w = 0; w < warmup; w++) renderer.render(scene, camera, target);
+                        
+                        // A frame is timed until its pixels are ready to show, tonemap included
+                        std::vector<double> times;
+                        for (int f = 0; f < frames; f++) {
+                            auto frame_start = std::chrono::high_resolution_clock::now();
+                            renderer.render(scene, camera, target);
+                            renderer.resolve(target);
+                            times.push_back(std::chrono::duration<double, std::milli>(
+                                std::chrono::high_resolution_clock::now() - frame_start).count());
+                        }
+                        
+                        BenchResult r;
+                        r.scene = bs.name;
+                        r.spheres = scene.soa.size();
+                        r.lights = scene.lights.size();
+                        r.build_ms = build_ms;
+                        r.mode = mode;
+                        r.backend = backend;
+                        r.threads = t;
+                        r.width = width;
+                        r.height = height;
+                        r.frames = frames;
+                        r.median_ms = percentile(times, 0.5);
+                        r.p95_ms = percentile(times, 0.95);
+                        r.min_ms = *std::min_element(times.begin(), times.end());
+                        r.rays = renderer.stats().rays;
+                        results.push_back(r);
+                        
+                        printf("%-18s %-6s %-6s %2d thr %5dx%-5d median %9.2f ms  p95 %9.2f ms  %8.2f Mrays/s (%.1f%% secondary)\n",
+                               bs.name.c_str(), backend.c_str(), mode.c_str(), t, width, height, r.median_ms, r.p95_ms,
+                               r.rays.total() / (r.median_ms / 1000.0) / 1e6,
+                               100.0 * r.rays.secondary() / std::max<uint64_t>(1, r.rays.total()));
+                        fflush(stdout);
+                    }
+                }
+            }
+        }
+    }
+    
+    std::ofstream out(out_path);
+    if (!out) {
+        std::cerr << "Cannot write " << out_path << std::endl;
+        return 1;
+    }
+    writeJSON(out, results, settings.light_samples);
+    std::cout << "Wrote " << results.size() << " runs to " << out_path << std::endl;
+    return 0;
+}
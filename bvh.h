@@ -0,0 +1,362 @@
+// SAH-built bounding volume hierarchy over the SoA spheres
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+#include "geometry.h"
+#include "sphere_soa.h"
+
+// Flattened BVH node: 'left_first' is the left child index for interior nodes
+// (right child is always left_first + 1) or the first primitive for leaves
+struct BVHNode {
+    AABB bounds;
+    int left_first;
+    int count;          // 0 for interior nodes
+    
+    bool isLeaf() const { return count > 0; }
+};
+
+// OPTIMIZATION 6: Bounding volume hierarchy over the scene spheres
+// Built once with binned SAH, stored as one contiguous node array and
+// traversed with an explicit stack (closest-hit and ordered any-hit).
+// Leaves refer to contiguous SoA slots, so the build hands back the order
+// the SoA has to be permuted into
+class BVH {
+public:
+    MappedArray<BVHNode> nodes;     // owned after build(), or a view into a mapped scene
+    
+    static const int BIN_COUNT = 16;
+    static const int MAX_LEAF_SIZE = SIMD_LANES < 4 ? 4 : SIMD_LANES;
+    static const int STACK_SIZE = 64;
+    
+    bool empty() const { return nodes.empty(); }
+    
+    void clear() {
+        nodes.clear();
+        built_area.clear();
+    }
+    
+    void build(const SphereSoA& soa, std::vector<int>& order) {
+        clear();
+        int n = int(soa.size());
+        order.resize(n);
+        if (n == 0) return;
+        
+        prim_bounds.resize(n);
+        prim_centroids.resize(n);
+        for (int i = 0; i < n; i++) {
+            Vec3 c = soa.center(i);
+            Real r = soa.radius(i);
+            prim_bounds[i] = AABB(c - Vec3(r, r, r), c + Vec3(r, r, r));
+            prim_centroids[i] = c;
+            order[i] = i;
+        }
+        indices = &order;
+        
+        build_nodes.reserve(2 * n);
+        build_nodes.push_back(BVHNode());
+        build_nodes[0].left_first = 0;
+        build_nodes[0].count = n;
+        subdivide(0, 0);
+        nodes.assign(build_nodes.begin(), build_nodes.end());
+        recordAreas();
+        
+        indices = nullptr;
+        build_nodes.clear();
+        build_nodes.shrink_to_fit();
+        prim_bounds.clear();
+        prim_bounds.shrink_to_fit();
+        prim_centroids.clear();
+        prim_centroids.shrink_to_fit();
+    }
+    
+    // NEW: Refit for animation. Recomputes every node's bounds around the
+    // spheres' current centers and radii, keeping the tree. Children always
+    // come after their parent in 'nodes', so one backwards sweep sees both
+    // children before the node that unions them
+    void refit(const SphereSoA& soa) {
+        if (empty()) return;
+        if (built_area.size() != nodes.size()) recordAreas();   // e.g. a BVH loaded with its scene
+        BVHNode* n = nodes.mutableData();
+        for (size_t i = nodes.size(); i-- > 0;) {
+            BVHNode& node = n[i];
+            if (node.isLeaf()) {
+                node.bounds = AABB();
+                for (int s = node.left_first; s < node.left_first + node.count; s++) {
+                    Vec3 c = soa.center(s);
+                    Real r = soa.radius(s);
+                    node.bounds.expand(AABB(c - Vec3(r, r, r), c + Vec3(r, r, r)));
+                }
+            } else {
+                node.bounds = n[node.left_first].bounds;
+                node.bounds.expand(n[node.left_first + 1].bounds);
+            }
+        }
+    }
+    
+    // How much refits have inflated the nodes: the geometric mean of each
+    // node's surface area over its area when built (1 = as built). A few
+    // huge nodes, like a ground sphere's, don't hide the rest growing
+    double degradation() const {
+        if (built_area.size() != nodes.size()) return 1;
+        double log_sum = 0;
+        size_t counted = 0;
+        for (size_t i = 0; i < nodes.size(); i++) {
+            double area = nodes[i].bounds.surfaceArea();
+            if (built_area[i] <= 0 || area <= 0) continue;
+            log_sum += std::log(area / built_area[i]);
+            counted++;
+        }
+        return counted ? std::exp(log_sum / counted) : 1;
+    }
+    
+    // Visits leaves overlapping [0.001, t_max] near-to-far. The leaf callback
+    // bool(int first, int count, Real& t_max) may shrink t_max; returning
+    // true stops the traversal (any-hit)
+    template <typename LeafFn>
+    bool traverse(const Ray& ray, Real t_max, LeafFn leaf) const {
+        Vec3 inv_dir = inverse(ray.direction);
+        int stack[STACK_SIZE];
+        int sp = 0;
+        int node_idx = 0;
+        Real t_root;
+        if (!nodes[0].bounds.intersect(ray.origin, inv_dir, t_max, t_root)) return false;
+        
+        while (true) {
+            const BVHNode& node = nodes[node_idx];
+            if (node.isLeaf()) {
+                if (leaf(node.left_first, node.count, t_max)) return true;
+            } else if (visitChildren(node, ray, inv_dir, t_max, node_idx, stack, sp)) {
+                continue;
+            }
+            if (!popNode(ray, inv_dir, t_max, node_idx, stack, sp)) break;
+        }
+        return false;
+    }
+    
+    // Packet traversal: a node is entered if any lane overlaps it. The leaf
+    // callback unsigned(int first, int count, unsigned lanes) returns the lanes
+    // that should keep traversing (any-hit drops occluded ones)
+    template <typename LeafFn>
+    void traversePacket(const RayPacket& p, unsigned active, LeafFn leaf) const {
+        alignas(64) Real ix[PACKET_SIZE], iy[PACKET_SIZE], iz[PACKET_SIZE];
+        for (int k = 0; k < PACKET_SIZE; k++) {
+            ix[k] = 1 / p.dx[k];
+            iy[k] = 1 / p.dy[k];
+            iz[k] = 1 / p.dz[k];
+        }
+        int lead = __builtin_ctz(active);
+        Vec3 lead_dir = p.direction(lead);
+        
+        int stack[STACK_SIZE];
+        int sp = 0;
+        stack[sp++] = 0;
+        while (sp > 0 && active) {
+            const BVHNode& node = nodes[stack[--sp]];
+            unsigned lanes = packetOverlap(node.bounds, p, ix, iy, iz) & active;
+            if (!lanes) continue;
+            
+            if (node.isLeaf()) {
+                active &= ~lanes | leaf(node.left_first, node.count, lanes);
+                continue;
+            }
+            // Order children for the lead ray; the nearer one is pushed last
+            int left = node.left_first;
+            Vec3 left_c = (nodes[left].bounds.min + nodes[left].bounds.max) * 0.5;
+            Vec3 right_c = (nodes[left + 1].bounds.min + nodes[left + 1].bounds.max) * 0.5;
+            bool left_first = (right_c - left_c).dot(lead_dir) > 0;
+            stack[sp++] = left_first ? left + 1 : left;
+            stack[sp++] = left_first ? left : left + 1;
+        }
+    }
+
+private:
+    std::vector<double> built_area;     // node surface areas as built, for degradation()
+    
+    void recordAreas() {
+        built_area.resize(nodes.size());
+        for (size_t i = 0; i < nodes.size(); i++) built_area[i] = nodes[i].bounds.surfaceArea();
+    }
+    
+    // Scratch data, only alive during build()
+    std::vector<BVHNode> build_nodes;
+    std::vector<AABB> prim_bounds;
+    std::vector<Vec3> prim_centroids;
+    std::vector<int>* indices = nullptr;
+    
+    // Slab test for every lane against [0.001, p.t]
+    static unsigned packetOverlap(const AABB& b, const RayPacket& p, const Real* ix, const Real* iy, const Real* iz) {
+#if defined(PACKET_KERNEL_AVX512)
+        __m512d vix = _mm512_load_pd(ix), viy = _mm512_load_pd(iy), viz = _mm512_load_pd(iz);
+        __m512d ox = _mm512_load_pd(p.ox), oy = _mm512_load_pd(p.oy), oz = _mm512_load_pd(p.oz);
+        __m512d tx1 = _mm512_mul_pd(_mm512_sub_pd(_mm512_set1_pd(b.min.x), ox), vix);
+        __m512d tx2 = _mm512_mul_pd(_mm512_sub_pd(_mm512_set1_pd(b.max.x), ox), vix);
+        __m512d ty1 = _mm512_mul_pd(_mm512_sub_pd(_mm512_set1_pd(b.min.y), oy), viy);
+        __m512d ty2 = _mm512_mul_pd(_mm512_sub_pd(_mm512_set1_pd(b.max.y), oy), viy);
+        __m512d tz1 = _mm512_mul_pd(_mm512_sub_pd(_mm512_set1_pd(b.min.z), oz), viz);
+        __m512d tz2 = _mm512_mul_pd(_mm512_sub_pd(_mm512_set1_pd(b.max.z), oz), viz);
+        __m512d t_enter = max8(max8(min8(tx2, tx1), min8(ty2, ty1)), min8(tz2, tz1));
+        __m512d t_exit = min8(min8(max8(tx2, tx1), max8(ty2, ty1)), max8(tz2, tz1));
+        __mmask8 mask = _mm512_cmp_pd_mask(t_exit, max8(_mm512_set1_pd(0.001), t_enter), _CMP_GE_OQ);
+        return _mm512_mask_cmp_pd_mask(mask, t_enter, _mm512_load_pd(p.t), _CMP_LT_OQ);
+#elif defined(PACKET_KERNEL_AVX)
+        __m256 vix = _mm256_load_ps(ix), viy = _mm256_load_ps(iy), viz = _mm256_load_ps(iz);
+        __m256 ox = _mm256_load_ps(p.ox), oy = _mm256_load_ps(p.oy), oz = _mm256_load_ps(p.oz);
+        __m256 tx1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(b.min.x), ox), vix);
+        __m256 tx2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(b.max.x), ox), vix);
+        __m256 ty1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(b.min.y), oy), viy);
+        __m256 ty2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(b.max.y), oy), viy);
+        __m256 tz1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(b.min.z), oz), viz);
+        __m256 tz2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(b.max.z), oz), viz);
+        __m256 t_enter = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(tx2, tx1), _mm256_min_ps(ty2, ty1)), _mm256_min_ps(tz2, tz1));
+        __m256 t_exit = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(tx2, tx1), _mm256_max_ps(ty2, ty1)), _mm256_max_ps(tz2, tz1));
+        __m256 ok = _mm256_and_ps(_mm256_cmp_ps(t_exit, _mm256_max_ps(_mm256_set1_ps(0.001f), t_enter), _CMP_GE_OQ),
+                                  _mm256_cmp_ps(t_enter, _mm256_load_ps(p.t), _CMP_LT_OQ));
+        return unsigned(_mm256_movemask_ps(ok));
+#else
+        int overlap[PACKET_SIZE];
+        #pragma omp simd
+        for (int k = 0; k < PACKET_SIZE; k++) {
+            Real tx1 = (b.min.x - p.ox[k]) * ix[k], tx2 = (b.max.x - p.ox[k]) * ix[k];
+            Real ty1 = (b.min.y - p.oy[k]) * iy[k], ty2 = (b.max.y - p.oy[k]) * iy[k];
+            Real tz1 = (b.min.z - p.oz[k]) * iz[k], tz2 = (b.max.z - p.oz[k]) * iz[k];
+            Real t_enter = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::min(tz1, tz2));
+            Real t_exit = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::max(tz1, tz2));
+            overlap[k] = (t_exit >= std::max(t_enter, Real(0.001))) & (t_enter < p.t[k]);
+        }
+        unsigned mask = 0;
+        for (int k = 0; k < PACKET_SIZE; k++) mask |= unsigned(overlap[k]) << k;
+        return mask;
+#endif
+    }
+    
+    static Vec3 inverse(const Vec3& d) {
+        return Vec3(1 / d.x, 1 / d.y, 1 / d.z);
+    }
+    
+    static Real axisOf(const Vec3& v, int axis) {
+        return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+    }
+    
+    // Descend into the nearer child and push the farther one; returns false
+    // if neither child is hit
+    bool visitChildren(const BVHNode& node, const Ray& ray, const Vec3& inv_dir, Real t_max,
+                       int& node_idx, int* stack, int& sp) const {
+        int near_idx = node.left_first;
+        int far_idx = node.left_first + 1;
+        Real t_near, t_far;
+        bool hit_near = nodes[near_idx].bounds.intersect(ray.origin, inv_dir, t_max, t_near);
+        bool hit_far = nodes[far_idx].bounds.intersect(ray.origin, inv_dir, t_max, t_far);
+        
+        if (hit_near && hit_far) {
+            if (t_far < t_near) std::swap(near_idx, far_idx);
+            stack[sp++] = far_idx;
+            node_idx = near_idx;
+            return true;
+        }
+        if (hit_near || hit_far) {
+            node_idx = hit_near ? near_idx : far_idx;
+            return true;
+        }
+        return false;
+    }
+    
+    // Pop the next node that still overlaps [0, t_max]
+    bool popNode(const Ray& ray, const Vec3& inv_dir, Real t_max, int& node_idx, int* stack, int& sp) const {
+        while (sp > 0) {
+            node_idx = stack[--sp];
+            Real t_entry;
+            if (nodes[node_idx].bounds.intersect(ray.origin, inv_dir, t_max, t_entry)) return true;
+        }
+        return false;
+    }
+    
+    void subdivide(int node_idx, int depth) {
+        std::vector<int>& idx = *indices;
+        BVHNode& node = build_nodes[node_idx];
+        int first = node.left_first;
+        int count = node.count;
+        
+        node.bounds = AABB();
+        AABB centroid_bounds;
+        for (int i = first; i < first + count; i++) {
+            node.bounds.expand(prim_bounds[idx[i]]);
+            centroid_bounds.expand(prim_centroids[idx[i]]);
+        }
+        
+        if (count <= MAX_LEAF_SIZE || depth >= STACK_SIZE - 2) return;
+        
+        // Find the cheapest binned SAH split over all three axes
+        int best_axis = -1;
+        int best_split = 0;
+        double best_cost = std::numeric_limits<double>::max();
+        for (int axis = 0; axis < 3; axis++) {
+            double lo = axisOf(centroid_bounds.min, axis);
+            double hi = axisOf(centroid_bounds.max, axis);
+            if (hi <= lo) continue;
+            
+            AABB bin_bounds[BIN_COUNT];
+            int bin_count[BIN_COUNT] = {0};
+            double scale = BIN_COUNT / (hi - lo);
+            for (int i = first; i < first + count; i++) {
+                int b = std::min(BIN_COUNT - 1, int((axisOf(prim_centroids[idx[i]], axis) - lo) * scale));
+                bin_count[b]++;
+                bin_bounds[b].expand(prim_bounds[idx[i]]);
+            }
+            
+            // Sweep from the right to get suffix areas, then from the left
+            double right_area[BIN_COUNT];
+            int right_count[BIN_COUNT];
+            AABB acc;
+            int acc_count = 0;
+            for (int b = BIN_COUNT - 1; b > 0; b--) {
+                acc.expand(bin_bounds[b]);
+                acc_count += bin_count[b];
+                right_area[b] = acc.surfaceArea();
+                right_count[b] = acc_count;
+            }
+            acc = AABB();
+            acc_count = 0;
+            for (int b = 0; b < BIN_COUNT - 1; b++) {
+                acc.expand(bin_bounds[b]);
+                acc_count += bin_count[b];
+                if (acc_count == 0 || right_count[b + 1] == 0) continue;
+                double cost = acc_count * acc.surfaceArea() + right_count[b + 1] * right_area[b + 1];
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_split = b + 1;
+                }
+            }
+        }
+        
+        // Splitting must beat intersecting everything in this node
+        double leaf_cost = count * node.bounds.surfaceArea();
+        if (best_axis < 0 || best_cost >= leaf_cost) return;
+        
+        double lo = axisOf(centroid_bounds.min, best_axis);
+        double scale = BIN_COUNT / (axisOf(centroid_bounds.max, best_axis) - lo);
+        int* mid = std::partition(idx.data() + first, idx.data() + first + count, [&](int i) {
+            int b = std::min(BIN_COUNT - 1, int((axisOf(prim_centroids[i], best_axis) - lo) * scale));
+            return b < best_split;
+        });
+        int left_count = int(mid - (idx.data() + first));
+        if (left_count == 0 || left_count == count) return;
+        
+        int left_idx = int(build_nodes.size());
+        build_nodes.push_back(BVHNode());
+        build_nodes.push_back(BVHNode());
+        build_nodes[left_idx].left_first = first;
+        build_nodes[left_idx].count = left_count;
+        build_nodes[left_idx + 1].left_first = first + left_count;
+        build_nodes[left_idx + 1].count = count - left_count;
+        
+        // 'node' may dangle after push_back, so index the array again
+        build_nodes[node_idx].left_first = left_idx;
+        build_nodes[node_idx].count = 0;
+        
+        subdivide(left_idx, depth + 1);
+        subdivide(left_idx + 1, depth + 1);
+    }
+};
@@ -0,0 +1,184 @@
+// Camera, per-frame ray setup and screen tiles
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+#include "geometry.h"
+
+// A rectangular block of pixels [x0, x1) x [y0, y1)
+struct Tile {
+    int x0, y0, x1, y1;
+    
+    Tile(int x0 = 0, int y0 = 0, int x1 = 0, int y1 = 0) : x0(x0), y0(y0), x1(x1), y1(y1) {}
+    
+    int width() const { return x1 - x0; }
+    int height() const { return y1 - y0; }
+    int pixelCount() const { return width() * height(); }
+};
+
+// OPTIMIZATION 8: Camera basis prepared once per frame
+// Holds the unnormalized direction through pixel (0, 0) and the per-pixel
+// increments, so a row of primary rays is just repeated additions.
+// NEW: A frame can also be a window of a larger image (distributed tiles):
+// pixel coordinates stay local to the window, while ray directions and
+// per-pixel seeds are those of the same pixel in the full image
+struct CameraFrame {
+    Vec3 origin;
+    Vec3 corner;    // direction through the image's top-left pixel
+    Vec3 du;        // step one column right
+    Vec3 dv;        // step one row down
+    int width, height;
+    int x0, y0;                     // window position in the image
+    int image_width, image_height;
+    
+    // The pixels [window.x0, window.x1) x [window.y0, window.y1) of this frame
+    CameraFrame window(const Tile& w) const {
+        CameraFrame f = *this;
+        f.x0 = x0 + w.x0;
+        f.y0 = y0 + w.y0;
+        f.width = w.width();
+        f.height = w.height();
+        return f;
+    }
+    
+    // Seed of local pixel (i, j): its index in the full image
+    uint32_t seed(int i, int j) const { return uint32_t(j + y0) * uint32_t(image_width) + uint32_t(i + x0); }
+    uint32_t imagePixels() const { return uint32_t(image_width) * uint32_t(image_height); }
+    
+    // Whether 'o' traces exactly the rays of this frame into the same pixels
+    bool sameRays(const CameraFrame& o) const {
+        const Vec3* va[4] = {&origin, &corner, &du, &dv};
+        const Vec3* vb[4] = {&o.origin, &o.corner, &o.du, &o.dv};
+        for (int v = 0; v < 4; v++) {
+            if (va[v]->x != vb[v]->x || va[v]->y != vb[v]->y || va[v]->z != vb[v]->z) return false;
+        }
+        return width == o.width && height == o.height && x0 == o.x0 && y0 == o.y0 &&
+               image_width == o.image_width && image_height == o.image_height;
+    }
+    
+    Vec3 direction(int i, int j) const {
+        return (corner + dv * (j + y0) + du * (i + x0)).normalize();
+    }
+    
+    Ray ray(int i, int j) const {
+        return Ray(origin, direction(i, j), Ray::Normalized());
+    }
+    
+    // Through the point (fx, fy) pixels from the top-left corner of local
+    // pixel (i, j); (0.5, 0.5) is its center. The offset is added to the
+    // image coordinate, so windows round exactly like the whole image
+    Vec3 subpixelDirection(int i, int j, Real fx, Real fy) const {
+        Real x = i + x0 + fx - Real(0.5);
+        Real y = j + y0 + fy - Real(0.5);
+        return (corner + dv * y + du * x).normalize();
+    }
+    
+    // Writes the unit directions of the tile's pixels, row-major, into 'out'
+    // (tile.pixelCount() entries). The additions restart every ROW_RUN image
+    // columns, so a pixel's direction doesn't depend on where its tile starts
+    static const int ROW_RUN = 16;
+    
+    void generateRays(const Tile& tile, Vec3* out) const {
+        int x_end = tile.x1 + x0;
+        for (int j = tile.y0; j < tile.y1; j++) {
+            Vec3 row = corner + dv * (j + y0);
+            int x = tile.x0 + x0;
+            while (x < x_end) {
+                int run = x - x % ROW_RUN;
+                Vec3 d = row + du * run;
+                for (int k = run; k < x; k++) d = d + du;
+                for (int run_end = std::min(x_end, run + ROW_RUN); x < run_end; x++) {
+                    *out++ = d.normalize();
+                    d = d + du;
+                }
+            }
+        }
+    }
+};
+
+class Camera {
+public:
+    Vec3 position;
+    Vec3 target;
+    Vec3 up;
+    Real fov;
+    
+    Camera(const Vec3& pos, const Vec3& tgt, const Vec3& u = Vec3(0, 1, 0), Real f = 60.0)
+        : position(pos), target(tgt), up(u), fov(f) {}
+    
+    Ray getRay(Real u, Real v, Real aspect_ratio) const {
+        Real theta = fov * M_PI / 180.0;
+        Real h = tan(theta / 2.0);
+        Real viewport_height = 2.0 * h;
+        Real viewport_width = aspect_ratio * viewport_height;
+        
+        Vec3 w = (position - target).normalize();
+        Vec3 u_vec = up.cross(w).normalize();
+        Vec3 v_vec = w.cross(u_vec);
+        
+        Vec3 horizontal = u_vec * viewport_width;
+        Vec3 vertical = v_vec * viewport_height;
+        Vec3 lower_left = position - horizontal / 2 - vertical / 2 - w;
+        
+        Vec3 direction = lower_left + horizontal * u + vertical * v - position;
+        return Ray(position, direction);
+    }
+    
+    // NEW: Interactive motion. Offsets are in the camera's own basis
+    // (forward along the view direction, right, and along 'up')
+    void move(Real forward, Real right, Real lift) {
+        Vec3 w = (target - position).normalize();
+        Vec3 r = w.cross(up).normalize();
+        Vec3 offset = w * forward + r * right + up.normalize() * lift;
+        position = position + offset;
+        target = target + offset;
+    }
+    
+    // Turns the view direction in place (radians); pitch stops short of 'up'
+    // so the basis in prepare() never degenerates
+    void rotate(Real yaw, Real pitch) {
+        Vec3 d = target - position;
+        Real dist = d.length();
+        Vec3 axis = up.normalize();
+        d = rotateAbout(d / dist, axis, yaw);
+        
+        Vec3 pitched = rotateAbout(d, d.cross(axis).normalize(), pitch);
+        if (std::fabs(pitched.dot(axis)) < 0.99) d = pitched;
+        target = position + d * dist;
+    }
+    
+    // Same rays as getRay(i / (width - 1), (height - 1 - j) / (height - 1), width / height)
+    CameraFrame prepare(int width, int height) const {
+        Real theta = fov * M_PI / 180.0;
+        Real viewport_height = 2.0 * tan(theta / 2.0);
+        Real viewport_width = (Real(width) / height) * viewport_height;
+        
+        Vec3 w = (position - target).normalize();
+        Vec3 u_vec = up.cross(w).normalize();
+        Vec3 v_vec = w.cross(u_vec);
+        
+        Vec3 horizontal = u_vec * viewport_width;
+        Vec3 vertical = v_vec * viewport_height;
+        
+        CameraFrame frame;
+        frame.origin = position;
+        frame.corner = vertical / 2 - horizontal / 2 - w;
+        frame.du = horizontal / std::max(1, width - 1);
+        frame.dv = vertical * (-1.0 / std::max(1, height - 1));
+        frame.width = width;
+        frame.height = height;
+        frame.x0 = frame.y0 = 0;
+        frame.image_width = width;
+        frame.image_height = height;
+        return frame;
+    }
+
+private:
+    // Rodrigues rotation of v about the unit axis k
+    static Vec3 rotateAbout(const Vec3& v, const Vec3& k, Real angle) {
+        Real c = cos(angle), s = sin(angle);
+        return v * c + k.cross(v) * s + k * (k.dot(v) * (1 - c));
+    }
+};
@@ -0,0 +1,331 @@
+// Whole-frame tracing as one OpenMP target kernel: a GPU when the build
+// offloads to one, the host otherwise
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+#include <omp.h>
+
+#include "scene.h"
+#include "camera.h"
+#include "stats.h"
+
+// The scene as the kernel reads it: the SoA arrays, BVH nodes, materials,
+// specular exponents and lights, all in device memory
+struct DeviceScene {
+    const Real* cx;
+    const Real* cy;
+    const Real* cz;
+    const Real* r2;
+    const int* material;
+    const BVHNode* nodes;
+    const Material* materials;
+    const SpecularExponent* exponents;
+    const Light* lights;
+    int sphere_count, node_count, light_count;
+    Color background;
+};
+
+// Per-pixel ray counts, summed over the frame after the kernel
+struct DeviceCounters {
+    uint64_t primary, shadow, reflection, sphere_tests, lights_culled;
+};
+
+// The kernel's own functions; what they call from geometry.h and scene.h
+// is declared for the device implicitly (OpenMP 5.0)
+#pragma omp declare target
+
+// Nearest root of slot s past hitEpsilon(r²), as sphereRootScalar()
+inline bool deviceRoot(const DeviceScene& s, int k, const Ray& ray, Real& t) {
+    Vec3 oc = ray.origin - Vec3(s.cx[k], s.cy[k], s.cz[k]);
+    Real b_half = oc.dot(ray.direction);
+    Real disc = b_half * b_half - (oc.lengthSquared() - s.r2[k]);
+    if (disc < 0) return false;
+    Real eps = hitEpsilon(s.r2[k]);
+    Real sqrt_disc = std::sqrt(disc);
+    t = -b_half - sqrt_disc;
+    if (t > eps) return true;
+    t = -b_half + sqrt_disc;
+    return t > eps;
+}
+
+// Tests slots [first, first + count); true once 'any' has found a blocker
+inline bool deviceLeaf(const DeviceScene& s, int first, int count, const Ray& ray, Real& t_max, bool any, int& slot,
+                       DeviceCounters& counters) {
+    counters.sphere_tests += count;
+    for (int k = first; k < first + count; k++) {
+        Real t;
+        if (deviceRoot(s, k, ray, t) && t < t_max) {
+            slot = k;
+            if (any) return true;
+            t_max = t;
+        }
+    }
+    return false;
+}
+
+// The closest hit before t_max, which shrinks to it, or with 'any' the
+// first blocker found; the slot, -1 if none. BVH::traverse() over raw nodes
+inline int deviceQuery(const DeviceScene& s, const Ray& ray, Real& t_max, bool any, DeviceCounters& counters) {
+    int slot = -1;
+    if (s.node_count == 0) {
+        deviceLeaf(s, 0, s.sphere_count, ray, t_max, any, slot, counters);
+        return slot;
+    }
+    
+    Vec3 inv_dir(1 / ray.direction.x, 1 / ray.direction.y, 1 / ray.direction.z);
+    int stack[BVH::STACK_SIZE];
+    int sp = 0;
+    int node_idx = 0;
+    Real t_entry;
+    if (!s.nodes[0].bounds.intersect(ray.origin, inv_dir, t_max, t_entry)) return -1;
+    
+    while (true) {
+        const BVHNode& node = s.nodes[node_idx];
+        if (node.isLeaf()) {
+            if (deviceLeaf(s, node.left_first, node.count, ray, t_max, any, slot, counters)) return slot;
+        } else {
+            // Nearer child first, the farther one pushed
+            int near_idx = node.left_first, far_idx = node.left_first + 1;
+            Real t_near, t_far;
+            bool hit_near = s.nodes[near_idx].bounds.intersect(ray.origin, inv_dir, t_max, t_near);
+            bool hit_far = s.nodes[far_idx].bounds.intersect(ray.origin, inv_dir, t_max, t_far);
+            if (hit_near && hit_far) {
+                if (t_far < t_near) {
+                    int swap = near_idx;
+                    near_idx = far_idx;
+                    far_idx = swap;
+                }
+                stack[sp++] = far_idx;
+                node_idx = near_idx;
+                continue;
+            }
+            if (hit_near || hit_far) {
+                node_idx = hit_near ? near_idx : far_idx;
+                continue;
+            }
+        }
+        
+        bool popped = false;
+        while (sp > 0 && !popped) {
+            node_idx = stack[--sp];
+            popped = s.nodes[node_idx].bounds.intersect(ray.origin, inv_dir, t_max, t_entry);
+        }
+        if (!popped) break;
+    }
+    return slot;
+}
+
+// Scene::traceKernel<0, true>() for one camera ray, without the shadow
+// cache (any blocker gives the same answer) or path recording
+inline Color deviceTrace(const DeviceScene& s, const TraceSettings& settings, Ray ray, uint32_t seed, int& first_hit,
+                         DeviceCounters& counters) {
+    counters.primary++;
+    Color result(0, 0, 0);
+    Real weight = 1;
+    for (int depth = 0; ; depth++) {
+        Real t = std::numeric_limits<Real>::max();
+        int hit_idx = deviceQuery(s, ray, t, false, counters);
+        if (depth == 0) first_hit = hit_idx;
+        if (hit_idx < 0) {
+            result = result + s.background * weight;
+            break;
+        }
+        
+        const Material& material = s.materials[s.material[hit_idx]];
+        const SpecularExponent& exponent = s.exponents[s.material[hit_idx]];
+        Vec3 hit_point = ray.at(t);
+        Vec3 normal = (hit_point - Vec3(s.cx[hit_idx], s.cy[hit_idx], s.cz[hit_idx])).normalize();
+        Vec3 view_dir = (ray.origin - hit_point).normalize();
+        Real n_dot_v = normal.dot(view_dir);
+        
+        Color color = material.color * material.ambient;
+        for (int l = 0; l < s.light_count; l++) {
+            const Light& light = s.lights[l];
+            Vec3 light_dir;
+            Real light_distance;
+            towardsLight(hit_point, light.position, settings.fast_shading, light_dir, light_distance);
+            
+            Real diff = normal.dot(light_dir);
+            if (diff <= 0 || settings.cullsLight(material, diff, light, weight)) {
+                counters.lights_culled++;
+                continue;
+            }
+            
+            counters.shadow++;
+            Ray shadow = settings.fast_shading ? Ray(hit_point, light_dir, Ray::Normalized()) : Ray(hit_point, light_dir);
+            if (deviceQuery(s, shadow, light_distance, true, counters) >= 0) continue;
+            
+            Color diffuse = material.color * material.diffuse * diff * light.intensity;
+            Real spec = specularTerm(view_dir, normal, light_dir, diff, n_dot_v, material, exponent, settings.fast_shading);
+            Color specular = light.color * material.specular * spec * light.intensity;
+            color = color + (diffuse + specular);
+        }
+        
+        Vec3 reflect_dir = (view_dir * -1).reflect(normal);
+        Bounce b = settings.bounce(weight, material.reflectivity, depth, seed);
+        result = result + color * b.local;
+        if (b.reflected <= 0) break;
+        
+        weight = b.reflected;
+        ray = Ray(hit_point, reflect_dir);
+        counters.reflection++;
+    }
+    return result;
+}
+
+// Local pixel (i, j)'s primary direction, rounded exactly as
+// CameraFrame::generateRays() rounds it
+inline Vec3 deviceDirection(const CameraFrame& f, int i, int j) {
+    int x = i + f.x0;
+    int run = x - x % CameraFrame::ROW_RUN;
+    Vec3 d = f.corner + f.dv * (j + f.y0) + f.du * run;
+    for (int k = run; k < x; k++) d = d + f.du;
+    return d.normalize();
+}
+
+#pragma omp end declare target
+
+// NEW: Device tracing (TraceMode::Device). The scene is uploaded once per
+// edit version into device memory; each frame is then one kernel over its
+// pixels, every one tracing its primary, shadow and reflection rays with
+// the same stack BVH traversal and shading as Scene::trace(), and the colors
+// and first hits come back in one copy. With -foffload (make OFFLOAD=...)
+// GCC compiles the kernel for that GPU; otherwise, or without a device at
+// run time, OpenMP runs it on the host threads.
+// Experimental: the kernel has only run on the host fallback, never on an
+// offload device, and it restates Scene::trace's traversal and shading
+// instead of sharing them. make golden holds its frames to the single-ray
+// frame, which is what catches the two drifting apart
+class DeviceTracer {
+public:
+    DeviceTracer() : device(omp_get_num_devices() > 0 ? omp_get_default_device() : omp_get_initial_device()),
+                     scene(nullptr), edit_version(0), pixel_capacity(0), color_buffer(nullptr), hit_buffer(nullptr) {
+        resident = DeviceScene();
+    }
+    
+    ~DeviceTracer() {
+        release();
+        dealloc(color_buffer);
+        dealloc(hit_buffer);
+    }
+    
+    DeviceTracer(const DeviceTracer&) = delete;
+    DeviceTracer& operator=(const DeviceTracer&) = delete;
+    
+    bool offloaded() const { return device != omp_get_initial_device(); }
+    
+    std::string describe() const {
+        return offloaded() ? "device " + std::to_string(device) + " of " + std::to_string(omp_get_num_devices())
+                           : "host fallback, no offload device";
+    }
+    
+    // Traces every pixel of 'frame' into 'colors' (width x height, row-major)
+    // and, if given, each one's first hit into 'first_hit'; adds the rays to
+    // 'counters'. settings.light_samples is ignored: every light is visited
+    void render(const Scene& s, const CameraFrame& frame, const TraceSettings& settings, Color* colors,
+                int* first_hit, RayCounters& counters) {
+        upload(s);
+        int pixels = frame.width * frame.height;
+        if (pixels > pixel_capacity) {
+            dealloc(color_buffer);
+            dealloc(hit_buffer);
+            color_buffer = static_cast<Real*>(alloc(sizeof(Real) * 3 * size_t(pixels)));
+            hit_buffer = static_cast<int*>(alloc(sizeof(int) * size_t(pixels)));
+            pixel_capacity = pixels;
+        }
+        
+        DeviceScene ds = resident;
+        CameraFrame f = frame;
+        TraceSettings ts = settings;
+        Real* out = color_buffer;
+        int* hits = hit_buffer;
+        uint64_t primary = 0, shadow = 0, reflection = 0, sphere_tests = 0, lights_culled = 0;
+        #pragma omp target teams distribute parallel for device(device) is_device_ptr(out, hits) \
+            firstprivate(ds, f, ts) reduction(+: primary, shadow, reflection, sphere_tests, lights_culled)
+        for (int idx = 0; idx < pixels; idx++) {
+            int i = idx % f.width, j = idx / f.width;
+            DeviceCounters c = {0, 0, 0, 0, 0};
+            Ray ray(f.origin, deviceDirection(f, i, j), Ray::Normalized());
+            Color color = deviceTrace(ds, ts, ray, f.seed(i, j), hits[idx], c);
+            out[3 * idx] = color.x;
+            out[3 * idx + 1] = color.y;
+            out[3 * idx + 2] = color.z;
+            primary += c.primary;
+            shadow += c.shadow;
+            reflection += c.reflection;
+            sphere_tests += c.sphere_tests;
+            lights_culled += c.lights_culled;
+        }
+        
+        staging.resize(3 * size_t(pixels));
+        fromDevice(staging.data(), out, sizeof(Real) * staging.size());
+        for (int idx = 0; idx < pixels; idx++) colors[idx] = Color(staging[3 * idx], staging[3 * idx + 1], staging[3 * idx + 2]);
+        if (first_hit) fromDevice(first_hit, hits, sizeof(int) * size_t(pixels));
+        
+        counters.primary += primary;
+        counters.shadow += shadow;
+        counters.reflection += reflection;
+        counters.sphere_tests += sphere_tests;
+        counters.lights_culled += lights_culled;
+    }
+
+private:
+    int device;
+    DeviceScene resident;
+    std::vector<void*> allocations;     // resident's arrays
+    const Scene* scene;                 // what 'resident' holds, at edit_version
+    uint64_t edit_version;
+    int pixel_capacity;
+    Real* color_buffer;                 // 3 per pixel, interleaved
+    int* hit_buffer;
+    std::vector<Real> staging;
+    
+    void* alloc(size_t bytes) { return omp_target_alloc(std::max<size_t>(bytes, 1), device); }
+    void dealloc(void* p) {
+        if (p) omp_target_free(p, device);
+    }
+    
+    void fromDevice(void* dst, const void* src, size_t bytes) {
+        omp_target_memcpy(dst, const_cast<void*>(src), bytes, 0, 0, omp_get_initial_device(), device);
+    }
+    
+    template <typename T>
+    const T* copyIn(const T* src, size_t count) {
+        void* p = alloc(sizeof(T) * count);
+        if (count) omp_target_memcpy(p, const_cast<T*>(src), sizeof(T) * count, 0, 0, device, omp_get_initial_device());
+        allocations.push_back(p);
+        return static_cast<const T*>(p);
+    }
+    
+    void release() {
+        for (void* p : allocations) dealloc(p);
+        allocations.clear();
+        scene = nullptr;
+    }
+    
+    // Every edit to the scene bumps its edit version, so a matching version
+    // means the device copy is current
+    void upload(const Scene& s) {
+        if (scene == &s && edit_version == s.editVersion()) return;
+        release();
+        size_t n = s.soa.size();
+        resident.cx = copyIn(s.soa.cx.data(), n);
+        resident.cy = copyIn(s.soa.cy.data(), n);
+        resident.cz = copyIn(s.soa.cz.data(), n);
+        resident.r2 = copyIn(s.soa.r2.data(), n);
+        resident.material = copyIn(s.soa.material.data(), n);
+        resident.nodes = copyIn(s.bvh.nodes.data(), s.bvh.nodes.size());
+        resident.materials = copyIn(s.materials.data(), s.materials.size());
+        resident.exponents = copyIn(s.exponents.data(), s.exponents.size());
+        resident.lights = copyIn(s.lights.data(), s.lights.size());
+        resident.sphere_count = int(n);
+        resident.node_count = int(s.bvh.nodes.size());
+        resident.light_count = int(s.lights.size());
+        resident.background = s.background;
+        scene = &s;
+        edit_version = s.editVersion();
+    }
+};
@@ -0,0 +1,186 @@
+// Screen tiles that scene edits can have changed, for incremental re-renders
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "scene.h"
+#include "camera.h"
+
+// NEW: Dirty-region tracking. After an edit, a pixel can only change if its
+// primary ray may see a touched sphere (where it was or where it is now),
+// or if one of its path's shadow or reflection rays may meet one. The first
+// is the sphere's projected bounds; the others are tested against what the
+// last render of each tile recorded (PathBounds): a shading point lit past
+// the sphere, or a reflection ray heading towards it. Where the bounds
+// reach behind the camera they can't be projected and the whole frame is
+// marked
+class DirtyTiles {
+public:
+    // Tiles of tile_size pixels over the frame, in the TileScheduler's grid
+    DirtyTiles(const CameraFrame& frame, int tile_size)
+        : frame(frame), tile_size(std::max(1, tile_size)), marked_all(false) {
+        tiles_x = (frame.width + this->tile_size - 1) / this->tile_size;
+        tiles_y = (frame.height + this->tile_size - 1) / this->tile_size;
+        dirty.assign(size_t(tiles_x) * tiles_y, 0);
+    }
+    
+    int tilesX() const { return tiles_x; }
+    int tilesY() const { return tiles_y; }
+    
+    // One entry per tile, row-major: nonzero where the tile is dirty
+    const std::vector<uint8_t>& mask() const { return dirty; }
+    
+    bool all() const { return marked_all || count() == int(dirty.size()); }
+    int count() const { return int(std::count(dirty.begin(), dirty.end(), uint8_t(1))); }
+    
+    void markAll() {
+        std::fill(dirty.begin(), dirty.end(), uint8_t(1));
+        marked_all = true;
+    }
+    
+    // Local pixels [i0, i1) x [j0, j1), clipped to the frame
+    void markPixels(int i0, int j0, int i1, int j1) {
+        i0 = std::max(i0, 0);
+        j0 = std::max(j0, 0);
+        i1 = std::min(i1, frame.width);
+        j1 = std::min(j1, frame.height);
+        if (i0 >= i1 || j0 >= j1) return;
+        for (int ty = j0 / tile_size; ty <= (j1 - 1) / tile_size; ty++) {
+            for (int tx = i0 / tile_size; tx <= (i1 - 1) / tile_size; tx++) dirty[size_t(ty) * tiles_x + tx] = 1;
+        }
+    }
+    
+    // The tiles a world-space box covers on screen
+    void markBox(const AABB& box) {
+        if (marked_all || box.min.x > box.max.x || box.min.y > box.max.y || box.min.z > box.max.z) return;
+        
+        // A point p is seen along t (corner + du x + dv y) for image
+        // coordinates (x, y); n is normal to the image plane
+        Vec3 n = frame.du.cross(frame.dv);
+        Real facing = frame.corner.dot(n);
+        Vec3 ax = frame.dv.cross(n), ay = n.cross(frame.du);
+        Real sx = frame.du.dot(ax), sy = frame.dv.dot(ay);
+        
+        Real lo_x = std::numeric_limits<Real>::max(), lo_y = lo_x;
+        Real hi_x = -lo_x, hi_y = -lo_x;
+        for (int c = 0; c < 8; c++) {
+            Vec3 p = Vec3(c & 1 ? box.max.x : box.min.x, c & 2 ? box.max.y : box.min.y,
+                          c & 4 ? box.max.z : box.min.z) - frame.origin;
+            Real t = p.dot(n) / facing;
+            if (!(t > 0)) {
+                markAll();          // the box reaches behind the camera
+                return;
+            }
+            Vec3 q = p / t - frame.corner;
+            Real x = q.dot(ax) / sx, y = q.dot(ay) / sy;
+            lo_x = std::min(lo_x, x);
+            hi_x = std::max(hi_x, x);
+            lo_y = std::min(lo_y, y);
+            hi_y = std::max(hi_y, y);
+        }
+        
+        // (x, y) are pixel centers; subpixel samples reach half a pixel
+        // further, and one more pixel covers rounding
+        Real limit = Real(std::max(frame.image_width, frame.image_height) + 2);
+        auto pixel = [&](Real v) { return int(std::floor(std::max(-limit, std::min(limit, v)))); };
+        markPixels(pixel(lo_x) - 1 - frame.x0, pixel(lo_y) - 1 - frame.y0,
+                   pixel(hi_x) + 3 - frame.x0, pixel(hi_y) + 3 - frame.y0);
+    }
+    
+    // Grows the dirty set by one tile in every direction, for passes that
+    // read neighbouring pixels (antialiasing's edge detection)
+    void dilate() {
+        std::vector<uint8_t> grown(dirty.size(), 0);
+        for (int ty = 0; ty < tiles_y; ty++) {
+            for (int tx = 0; tx < tiles_x; tx++) {
+                if (!dirty[size_t(ty) * tiles_x + tx]) continue;
+                for (int y = std::max(0, ty - 1); y <= std::min(tiles_y - 1, ty + 1); y++) {
+                    for (int x = std::max(0, tx - 1); x <= std::min(tiles_x - 1, tx + 1); x++) grown[size_t(y) * tiles_x + x] = 1;
+                }
+            }
+        }
+        dirty.swap(grown);
+    }
+    
+    // Marks what the edits to 'scene' after 'version' can have changed.
+    // 'paths' holds what the last render of each tile recorded, in mask()
+    // order, 'cells' records to a tile
+    void markEdits(const Scene& scene, uint64_t version, const std::vector<PathBounds>& paths, int cells) {
+        std::vector<Scene::SphereDamage> edits;
+        if (!scene.editsSince(version, edits)) {
+            markAll();
+            return;
+        }
+        
+        for (const Scene::SphereDamage& e : edits) {
+            // Spheres round-trip through r²
+            Real r = e.radius * Real(1.001) + Real(1e-4);
+            markBox(AABB(e.center - Vec3(r, r, r), e.center + Vec3(r, r, r)));
+            if (marked_all) return;
+            for (size_t t = 0; t < dirty.size(); t++) {
+                bool hit = dirty[t];
+                for (int c = 0; c < cells && !hit; c++) {
+                    const PathBounds& p = paths[t * cells + c];
+                    hit = reflectionsReach(p, e.center, r);
+                    for (size_t l = 0; l < scene.lights.size() && !hit; l++) {
+                        hit = shadowReaches(p, e.center, r, scene.lights[l].position);
+                    }
+                }
+                dirty[t] = hit;
+            }
+        }
+    }
+
+private:
+    CameraFrame frame;
+    int tile_size;
+    int tiles_x, tiles_y;
+    std::vector<uint8_t> dirty;
+    bool marked_all;
+    
+    // Angles are widened by this much for rounding
+    static Real slack() { return Real(1e-3); }
+    
+    // Bounding sphere of a box, false if the box is empty
+    static bool enclose(const AABB& box, Vec3& center, Real& radius) {
+        if (box.min.x > box.max.x) return false;
+        center = (box.min + box.max) * Real(0.5);
+        radius = (box.max - box.min).length() * Real(0.5);
+        return true;
+    }
+    
+    static Real angleBetween(const Vec3& a, const Vec3& b) {
+        return std::acos(std::max(Real(-1), std::min(Real(1), a.dot(b) / (a.length() * b.length()))));
+    }
+    
+    // Whether a recorded reflection ray may pass through sphere (c, r). From
+    // origins within rb of b, every direction towards the sphere lies within
+    // the cone from b onto the sphere grown by rb
+    static bool reflectionsReach(const PathBounds& p, const Vec3& c, Real r) {
+        Vec3 b;
+        Real rb;
+        if (p.reflections == 0 || !enclose(p.origins, b, rb)) return false;
+        Real dist = (c - b).length();
+        if (dist <= r + rb || p.cos_spread <= -1) return true;
+        Real reach = std::acos(p.cos_spread) + std::asin((r + rb) / dist) + slack();
+        return angleBetween(c - b, p.axis) <= reach;
+    }
+    
+    // Whether the shadow ray of a recorded shading point towards 'light' may
+    // pass through sphere (c, r): the point has to lie within the sphere's
+    // cone as seen from the light, and beyond its near side
+    static bool shadowReaches(const PathBounds& p, const Vec3& c, Real r, const Vec3& light) {
+        Vec3 b;
+        Real rb;
+        if (!enclose(p.points, b, rb)) return false;
+        Real d = (c - light).length(), dist = (b - light).length();
+        if (d <= r || dist <= rb) return true;
+        if (dist + rb < d - r) return false;
+        Real reach = std::asin(r / d) + std::asin(std::min(Real(1), rb / dist)) + slack();
+        return angleBetween(b - light, c - light) <= reach;
+    }
+};
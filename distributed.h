@@ -0,0 +1,597 @@
+// Multi-node rendering over TCP: a coordinator deals the tiles of one frame
+// to worker processes and stitches their pixels into its FrameBuffer
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "renderer.h"
+#include "scene_io.h"
+
+// Workers connect to the coordinator, which sends each of them the job: the
+// render settings and the scene in its binary (.rtb) form, exactly once.
+// Tiles then go out as small messages and come back as ARGB pixels. Every
+// worker keeps a couple of tiles queued so it never waits on the network;
+// once the queue runs dry, idle workers get copies of tiles still out on
+// slower ones and whichever copy arrives first is used, so a straggler can't
+// hold up the frame. Tiles of a worker that drops out are dealt again.
+// Workers render with the headless Renderer on a window of the full image,
+// which gives every pixel the ray and seed it has in a single-process render.
+// Messages are native-endian and the scene is in the coordinator's Real
+// precision, so all nodes run the same build
+namespace distributed {
+
+static const uint32_t PROTOCOL_VERSION = 2;
+static const int TILES_IN_FLIGHT = 2;   // per worker
+static const int MAX_COPIES = 2;        // of one tile out at a time
+static const int WORKER_TIMEOUT_S = 60; // silence from a worker holding tiles before it is dropped
+static const uint64_t MAX_SCENE_BYTES = uint64_t(8) << 30;     // largest scene a worker accepts
+static const int MAX_IMAGE_SIDE = 1 << 16;                      // pixels per side of a job's image
+static const int MAX_JOB_FRAMES = 1 << 16;      // progressive frames of a job
+static const int MAX_JOB_AA_GRID = 16;          // subpixels per side of an edge pixel
+static const int MAX_JOB_DEPTH = 64;            // reflections; Scene::trace recurses once per bounce
+static const int MAX_JOB_LIGHT_SAMPLES = 1 << 16;
+
+enum MessageType : uint32_t {
+    MSG_JOB = 1,        // coordinator -> worker: JobHeader, then the binary scene
+    MSG_TILE,           // coordinator -> worker: a TileMessage
+    MSG_PIXELS          // worker -> coordinator: the tile's pixels, row-major
+};
+
+struct MessageHeader {
+    uint32_t type;
+    uint32_t frame;     // render() call a tile belongs to; workers echo it back
+    uint32_t tile;      // index of the tile, for MSG_TILE and MSG_PIXELS
+    uint32_t reserved;
+    uint64_t bytes;     // payload that follows
+};
+
+struct TileMessage {
+    int32_t x0, y0, x1, y1;
+};
+
+// Everything a worker's Renderer needs besides the scene (the camera is in it)
+struct JobHeader {
+    uint32_t version;
+    int32_t width, height;          // full image
+    int32_t mode;                   // TraceMode
+    int32_t tile_size;              // the worker's own tiles inside a dealt one
+    int32_t max_frames;
+    int32_t aa_grid;
+    int32_t max_depth, light_samples;
+    int32_t fast_shading;
+    double aa_threshold;
+    double min_weight, roulette_weight, light_cutoff;
+    char backend[16];
+    uint64_t scene_bytes;
+};
+
+// False, saying why, if a job's settings are outside what raytracer.cpp's
+// options produce or what a worker will render: the image, tile and frame
+// counts, the antialiasing grid (aa_grid^2 rays per edge pixel) and the
+// recursion depth all come off the wire. The scene is checked separately
+inline bool jobInRange(const JobHeader& job) {
+    const char* bad = nullptr;
+    if (job.width < 1 || job.height < 1 || job.width > MAX_IMAGE_SIDE || job.height > MAX_IMAGE_SIDE) {
+        bad = "image size";
+    } else if (job.scene_bytes > MAX_SCENE_BYTES) {
+        bad = "scene size";
+    } else if (job.mode < int32_t(TraceMode::Single) || job.mode > int32_t(TraceMode::Device)) {
+        bad = "trace mode";
+    } else if (job.tile_size < 1 || job.tile_size > MAX_IMAGE_SIDE) {
+        bad = "tile size";
+    } else if (job.max_frames < 1 || job.max_frames > MAX_JOB_FRAMES) {
+        bad = "frame count";
+    } else if (job.aa_grid < 0 || job.aa_grid > MAX_JOB_AA_GRID) {
+        bad = "antialiasing grid";
+    } else if (job.max_depth < 0 || job.max_depth > MAX_JOB_DEPTH) {
+        bad = "max depth";
+    } else if (job.light_samples < 0 || job.light_samples > MAX_JOB_LIGHT_SAMPLES) {
+        bad = "light samples";
+    } else if (!std::isfinite(job.aa_threshold) || !std::isfinite(job.min_weight) ||
+               !std::isfinite(job.roulette_weight) || !std::isfinite(job.light_cutoff)) {
+        bad = "thresholds";
+    }
+    if (!bad) return true;
+    std::cerr << "Job " << bad << " out of range: " << job.width << "x" << job.height << ", mode " << job.mode
+              << ", tiles of " << job.tile_size << ", " << job.max_frames << " frames, aa " << job.aa_grid
+              << ", depth " << job.max_depth << ", " << job.light_samples << " light samples, " << job.scene_bytes
+              << " scene bytes" << std::endl;
+    return false;
+}
+
+// Full writes and reads; false once the peer is gone. MSG_NOSIGNAL keeps a
+// worker whose coordinator hung up from dying of SIGPIPE
+inline bool sendAll(int fd, const void* data, size_t n) {
+    const char* p = static_cast<const char*>(data);
+    while (n > 0) {
+        ssize_t sent = send(fd, p, n, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        p += sent;
+        n -= size_t(sent);
+    }
+    return true;
+}
+
+inline bool recvAll(int fd, void* data, size_t n) {
+    char* p = static_cast<char*>(data);
+    while (n > 0) {
+        ssize_t got = recv(fd, p, n, 0);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        p += got;
+        n -= size_t(got);
+    }
+    return true;
+}
+
+inline bool sendMessage(int fd, uint32_t type, uint32_t frame, uint32_t tile, const void* payload, size_t bytes) {
+    MessageHeader h = {type, frame, tile, 0, bytes};
+    return sendAll(fd, &h, sizeof(h)) && (bytes == 0 || sendAll(fd, payload, bytes));
+}
+
+// Splits "host:port"; false if there is no port
+inline bool parseAddress(const std::string& address, std::string& host, int& port) {
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos || colon + 1 == address.size()) return false;
+    host = address.substr(0, colon);
+    port = atoi(address.c_str() + colon + 1);
+    return port > 0 && port < 65536;
+}
+
+inline int connectTo(const std::string& host, int port) {
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* found = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &found) != 0) return -1;
+    
+    int fd = -1;
+    for (addrinfo* a = found; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+    if (fd >= 0) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+inline int listenOn(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(uint16_t(port));
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// The job for the renderer's current settings
+inline JobHeader makeJob(const Renderer& renderer, int width, int height, const IntersectBackend& backend) {
+    JobHeader job;
+    memset(&job, 0, sizeof(job));
+    const TraceSettings& t = renderer.traceSettings();
+    job.version = PROTOCOL_VERSION;
+    job.width = width;
+    job.height = height;
+    job.mode = int32_t(renderer.traceMode());
+    job.tile_size = renderer.tileSize();
+    job.max_frames = renderer.maxFrames();
+    job.aa_grid = renderer.antialiasingGrid();
+    job.aa_threshold = renderer.antialiasingThreshold();
+    job.max_depth = t.max_depth;
+    job.light_samples = t.light_samples;
+    job.fast_shading = t.fast_shading;
+    job.min_weight = t.min_weight;
+    job.roulette_weight = t.roulette_weight;
+    job.light_cutoff = t.light_cutoff;
+    strncpy(job.backend, backend.name(), sizeof(job.backend) - 1);
+    return job;
+}
+
+// OPTIMIZATION 10: Dynamic tile distribution across machines
+class Coordinator {
+public:
+    // Listens on 'port'; render() starts once 'min_workers' have connected,
+    // later ones join mid-frame
+    Coordinator(int port, int min_workers, int tile_size = 128)
+        : listen_fd(listenOn(port)), min_workers(std::max(1, min_workers)), tile_size(std::max(1, tile_size)),
+          frame_number(0), scene_image(nullptr) {
+        if (listen_fd < 0) std::cerr << "Cannot listen on port " << port << std::endl;
+    }
+    
+    ~Coordinator() {
+        for (const Worker& w : workers) close(w.fd);
+        if (listen_fd >= 0) close(listen_fd);
+    }
+    
+    bool listening() const { return listen_fd >= 0; }
+    
+    // Renders the full frame into 'target' on the workers; false if they all
+    // dropped out before it was done
+    bool render(const Scene& scene, const Camera& camera, const JobHeader& settings, FrameBuffer& target) {
+        if (!listening()) return false;
+        frame_number++;
+        
+        // The scene goes out in its binary form, with the camera
+        char* image = nullptr;
+        size_t image_size = 0;
+        FILE* f = open_memstream(&image, &image_size);
+        bool written = f && scene_io::writeBinary(f, scene, &camera);
+        if (f) fclose(f);
+        std::unique_ptr<char, void (*)(void*)> image_owner(image, free);
+        if (!written) {
+            std::cerr << "Cannot serialize the scene" << std::endl;
+            return false;
+        }
+        job = settings;
+        job.width = target.width;
+        job.height = target.height;
+        job.scene_bytes = image_size;
+        if (!jobInRange(job)) return false;  // the workers would refuse it
+        scene_image = image;
+        
+        // Dealt in curve order, so neighbouring tiles go out together
+        TileScheduler order(target.width, target.height, tile_size, TileOrder::Hilbert, 1);
+        tiles.clear();
+        Tile tile;
+        while (order.next(0, tile)) tiles.push_back(tile);
+        state.assign(tiles.size(), TileState());
+        queue.clear();
+        for (size_t t = 0; t < tiles.size(); t++) queue.push_back(int(t));
+        int remaining = int(tiles.size());
+        int copies_sent = 0;
+        
+        while (int(workers.size()) < min_workers) {
+            std::cout << "Waiting for workers (" << workers.size() << "/" << min_workers << ")..." << std::endl;
+            if (!acceptWorker()) return false;
+        }
+        
+        // Copies still out from the last frame are now just in the way
+        auto start_time = std::chrono::high_resolution_clock::now();
+        for (size_t w = 0; w < workers.size(); w++) {
+            workers[w].stale += int(workers[w].tiles.size());
+            workers[w].tiles.clear();
+            if (!sendJob(workers[w])) dropWorker(w--);
+        }
+        
+        std::vector<uint32_t> pixels;
+        while (remaining > 0) {
+            for (size_t w = 0; w < workers.size(); w++) {
+                if (!deal(workers[w], copies_sent)) dropWorker(w--);
+            }
+            if (workers.empty()) {
+                std::cerr << "All workers disconnected; " << remaining << " tiles left" << std::endl;
+                scene_image = nullptr;
+                return false;
+            }
+            
+            // Wakes up by the first deadline of a worker that owes tiles
+            std::vector<pollfd> fds(workers.size() + 1);
+            for (size_t w = 0; w < workers.size(); w++) fds[w] = pollfd{workers[w].fd, POLLIN, 0};
+            fds[workers.size()] = pollfd{listen_fd, POLLIN, 0};
+            int timeout_ms = -1;
+            auto now = std::chrono::steady_clock::now();
+            for (const Worker& w : workers) {
+                if (w.tiles.empty() && w.stale == 0) continue;
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    w.last_heard + std::chrono::seconds(WORKER_TIMEOUT_S) - now).count();
+                int ms = int(std::max<long long>(0, std::min<long long>(left, WORKER_TIMEOUT_S * 1000)));
+                if (timeout_ms < 0 || ms < timeout_ms) timeout_ms = ms;
+            }
+            if (poll(fds.data(), fds.size(), timeout_ms) < 0 && errno != EINTR) break;
+            
+            // Late joiners get the job and start on the next round of dealing
+            if (fds[workers.size()].revents & POLLIN) {
+                if (acceptWorker() && !sendJob(workers.back())) dropWorker(workers.size() - 1);
+            }
+            
+            for (size_t w = fds.size() - 1; w-- > 0;) {
+                if (!(fds[w].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+                Worker& worker = workers[w];
+                MessageHeader h;
+                int t = -1;
+                bool ok = recvAll(worker.fd, &h, sizeof(h)) && h.type == MSG_PIXELS;
+                worker.last_heard = std::chrono::steady_clock::now();
+                if (ok && h.frame != frame_number) {
+                    // A tile of an earlier frame, if the worker owes one: no
+                    // tile is more than tile_size^2 pixels
+                    ok = worker.stale > 0 && h.bytes % sizeof(uint32_t) == 0 &&
+                         h.bytes <= uint64_t(tile_size) * tile_size * sizeof(uint32_t);
+                    pixels.resize(ok ? size_t(h.bytes / sizeof(uint32_t)) : 0);
+                    ok = ok && recvAll(worker.fd, pixels.data(), pixels.size() * sizeof(uint32_t));
+                    worker.stale--;
+                    if (!ok) dropWorker(w);
+                    continue;
+                }
+                // Only a tile this worker holds: anything else would take a
+                // copy away from the worker that does
+                std::deque<int>::iterator it = worker.tiles.end();
+                if (ok && h.tile < tiles.size()) it = std::find(worker.tiles.begin(), worker.tiles.end(), int(h.tile));
+                ok = ok && it != worker.tiles.end();
+                if (ok) {
+                    t = int(h.tile);
+                    pixels.resize(size_t(tiles[t].pixelCount()));
+                    ok = h.bytes == pixels.size() * sizeof(uint32_t) && recvAll(worker.fd, pixels.data(), size_t(h.bytes));
+                }
+                if (!ok) {
+                    dropWorker(w);
+                    continue;
+                }
+                
+                worker.tiles.erase(it);
+                state[t].copies--;
+                if (state[t].done) continue;     // a copy that lost the race
+                
+                const Tile& r = tiles[t];
+                for (int j = 0; j < r.height(); j++) {
+                    std::copy(pixels.begin() + j * r.width(), pixels.begin() + (j + 1) * r.width(),
+                              target.pixels.begin() + (r.y0 + j) * target.width + r.x0);
+                }
+                state[t].done = true;
+                worker.rendered++;
+                remaining--;
+                std::cout << "Progress: " << (100 * (int(tiles.size()) - remaining) / int(tiles.size())) << "%\r" << std::flush;
+            }
+            
+            // A worker that owes tiles and has been silent past its deadline
+            // is treated as gone, so its tiles go back to the queue
+            now = std::chrono::steady_clock::now();
+            for (size_t w = 0; w < workers.size(); w++) {
+                if (workers[w].tiles.empty() && workers[w].stale == 0) continue;
+                if (now - workers[w].last_heard < std::chrono::seconds(WORKER_TIMEOUT_S)) continue;
+                std::cerr << "Worker " << workers[w].name << " silent for " << WORKER_TIMEOUT_S << " s" << std::endl;
+                dropWorker(w--);
+            }
+        }
+        scene_image = nullptr;
+        
+        auto end_time = std::chrono::high_resolution_clock::now();
+        double elapsed = std::chrono::duration<double>(end_time - start_time).count();
+        if (remaining > 0) return false;
+        
+        std::cout << "Progress: 100% - Done!     " << std::endl;
+        std::cout << "Render time: " << elapsed << " seconds on " << workers.size() << " workers ("
+                  << tiles.size() << " tiles, " << copies_sent << " straggler copies)" << std::endl;
+        for (const Worker& w : workers) std::cout << "  " << w.name << ": " << w.rendered << " tiles" << std::endl;
+        return true;
+    }
+
+private:
+    struct Worker {
+        int fd;
+        std::string name;
+        std::deque<int> tiles;      // in flight, in the order they were sent
+        int stale;                  // results of earlier frames still to come
+        int rendered;               // tiles whose result was the one used
+        std::chrono::steady_clock::time_point last_heard;  // last message, or since it owes tiles
+    };
+    
+    struct TileState {
+        bool done;
+        int copies;                 // out on workers right now
+        std::chrono::steady_clock::time_point issued;  // first sent
+        
+        TileState() : done(false), copies(0) {}
+    };
+    
+    int listen_fd;
+    int min_workers;
+    int tile_size;
+    std::vector<Worker> workers;
+    
+    // The frame being rendered
+    uint32_t frame_number;
+    JobHeader job;
+    const char* scene_image;
+    std::vector<Tile> tiles;
+    std::vector<TileState> state;
+    std::deque<int> queue;          // tiles nobody holds
+    
+    bool acceptWorker() {
+        sockaddr_storage addr;
+        socklen_t len = sizeof(addr);
+        int fd = accept(listen_fd, reinterpret_cast<sockaddr*>(&addr), &len);
+        if (fd < 0) return false;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        
+        char host[NI_MAXHOST] = "?", service[NI_MAXSERV] = "?";
+        getnameinfo(reinterpret_cast<sockaddr*>(&addr), len, host, sizeof(host), service, sizeof(service),
+                    NI_NUMERICHOST | NI_NUMERICSERV);
+        Worker w;
+        w.fd = fd;
+        w.name = std::string(host) + ":" + service;
+        w.stale = 0;
+        w.rendered = 0;
+        w.last_heard = std::chrono::steady_clock::now();
+        workers.push_back(w);
+        std::cout << "Worker " << w.name << " connected" << std::endl;
+        return true;
+    }
+    
+    bool sendJob(const Worker& w) {
+        return sendMessage(w.fd, MSG_JOB, frame_number, 0, &job, sizeof(job)) && sendAll(w.fd, scene_image, size_t(job.scene_bytes));
+    }
+    
+    // Tops up a worker's tiles in flight: fresh tiles while there are any,
+    // then, for a worker with nothing left to do, a copy of the tile that
+    // has been out the longest
+    bool deal(Worker& w, int& copies_sent) {
+        while (int(w.tiles.size()) + w.stale < TILES_IN_FLIGHT) {
+            int t = -1;
+            if (!queue.empty()) {
+                t = queue.front();
+                queue.pop_front();
+                state[t].issued = std::chrono::steady_clock::now();
+            } else if (w.tiles.empty() && w.stale == 0) {
+                for (size_t c = 0; c < state.size(); c++) {
+                    if (state[c].done || state[c].copies == 0 || state[c].copies >= MAX_COPIES) continue;
+                    if (t < 0 || state[c].issued < state[t].issued) t = int(c);
+                }
+                if (t >= 0) copies_sent++;
+            }
+            if (t < 0) break;
+            
+            const Tile& r = tiles[t];
+            TileMessage m = {r.x0, r.y0, r.x1, r.y1};
+            if (w.tiles.empty() && w.stale == 0) w.last_heard = std::chrono::steady_clock::now();
+            state[t].copies++;
+            w.tiles.push_back(t);
+            if (!sendMessage(w.fd, MSG_TILE, frame_number, uint32_t(t), &m, sizeof(m))) return false;
+        }
+        return true;
+    }
+    
+    // Forgets worker w; tiles only it held go back to the front of the queue
+    void dropWorker(size_t w) {
+        std::cerr << "Worker " << workers[w].name << " disconnected" << std::endl;
+        for (int t : workers[w].tiles) {
+            if (--state[t].copies == 0 && !state[t].done) queue.push_front(t);
+        }
+        close(workers[w].fd);
+        workers.erase(workers.begin() + w);
+    }
+};
+
+// Connects to the coordinator at 'address' (host:port) and renders the tiles
+// it deals until it hangs up; returns the process exit status. Retries the
+// connection for a while, so workers can be started before the coordinator.
+// 'renderer' keeps this machine's thread options; each job sets the rest
+inline int runWorker(const std::string& address, Renderer& renderer) {
+    std::string host;
+    int port = 0;
+    if (!parseAddress(address, host, port)) {
+        std::cerr << "Expected --worker HOST:PORT, got " << address << std::endl;
+        return 1;
+    }
+    int fd = -1;
+    for (int attempt = 0; attempt < 60 && fd < 0; attempt++) {
+        fd = connectTo(host, port);
+        if (fd < 0) std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+    if (fd < 0) {
+        std::cerr << "Cannot connect to " << address << std::endl;
+        return 1;
+    }
+    std::cout << "Connected to " << address << std::endl;
+    
+    Scene scene;
+    Camera camera(Vec3(0, 1, 5), Vec3(0, 0, 0));
+    renderer.setVerbose(false);
+    JobHeader job;
+    bool have_job = false;
+    int tiles_rendered = 0;
+    double busy_seconds = 0;
+    
+    std::vector<uint32_t> pixels;
+    MessageHeader h;
+    while (recvAll(fd, &h, sizeof(h))) {
+        if (h.type == MSG_JOB) {
+            if (h.bytes != sizeof(job) || !recvAll(fd, &job, sizeof(job)) || job.version != PROTOCOL_VERSION) {
+                std::cerr << "Coordinator speaks a different protocol version" << std::endl;
+                break;
+            }
+            if (!jobInRange(job)) break;
+            
+            // The binary scene is used in place, from a 64-byte aligned
+            // buffer; useBinary() checks it like a file before anything renders it
+            void* image = nullptr;
+            size_t image_size = size_t(job.scene_bytes);
+            if (posix_memalign(&image, 64, std::max<size_t>(image_size, 1)) != 0) break;
+            std::shared_ptr<const void> storage(image, free);
+            if (!recvAll(fd, image, image_size)) break;
+            if (!scene_io::useBinary(storage, image_size, "job from " + address, scene, &camera)) break;
+            
+            const IntersectBackend* backend = findBackend(job.backend);
+            scene.setBackend(backend ? *backend : simdBackend());
+            TraceSettings t;
+            t.max_depth = job.max_depth;
+            t.light_samples = job.light_samples;
+            t.fast_shading = job.fast_shading != 0;
+            t.min_weight = Real(job.min_weight);
+            t.roulette_weight = Real(job.roulette_weight);
+            t.light_cutoff = Real(job.light_cutoff);
+            renderer.setTraceSettings(t);
+            renderer.setTraceMode(TraceMode(job.mode));
+            renderer.setTileSize(job.tile_size);
+            renderer.setMaxFrames(job.max_frames);
+            renderer.setAntialiasing(job.aa_grid, Real(job.aa_threshold));
+            have_job = true;
+            std::cout << "Job: " << job.width << "x" << job.height << ", " << scene.soa.size() << " spheres" << std::endl;
+        } else if (h.type == MSG_TILE && have_job && h.bytes == sizeof(TileMessage)) {
+            TileMessage m;
+            if (!recvAll(fd, &m, sizeof(m))) break;
+            if (m.x0 < 0 || m.y0 < 0 || m.x0 >= m.x1 || m.y0 >= m.y1 || m.x1 > job.width || m.y1 > job.height) {
+                std::cerr << "Tile outside the " << job.width << "x" << job.height << " image" << std::endl;
+                break;
+            }
+            Tile tile(m.x0, m.y0, m.x1, m.y1);
+            
+            // Edge detection for --aa looks one pixel past the tile, so the
+            // window carries a one-pixel apron that is traced but not sent
+            Tile window = tile;
+            if (job.aa_grid > 1) {
+                window = Tile(std::max(0, tile.x0 - 1), std::max(0, tile.y0 - 1),
+                              std::min(int(job.width), tile.x1 + 1), std::min(int(job.height), tile.y1 + 1));
+            }
+            CameraFrame frame = camera.prepare(job.width, job.height).window(window);
+            FrameBuffer target(window.width(), window.height());
+            do {
+                busy_seconds += renderer.render(scene, frame, target);
+            } while (renderer.refining(scene));
+            renderer.resolve(target);
+            
+            pixels.resize(size_t(tile.pixelCount()));
+            for (int j = 0; j < tile.height(); j++) {
+                const uint32_t* row = &target.pixels[(tile.y0 - window.y0 + j) * target.width + tile.x0 - window.x0];
+                std::copy(row, row + tile.width(), pixels.begin() + j * tile.width());
+            }
+            if (!sendMessage(fd, MSG_PIXELS, h.frame, h.tile, pixels.data(), pixels.size() * sizeof(uint32_t))) break;
+            tiles_rendered++;
+        } else {
+            std::cerr << "Unexpected message " << h.type << " from the coordinator" << std::endl;
+            break;
+        }
+    }
+    close(fd);
+    
+    std::cout << "Coordinator done: rendered " << tiles_rendered << " tiles in " << busy_seconds << " seconds" << std::endl;
+    return 0;
+}
+    
+} // namespace distributed
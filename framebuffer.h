@@ -0,0 +1,407 @@
+// Headless render target and image writers (PPM / PNG / EXR)
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "geometry.h"
+#include "sphere_soa.h"
+
+// Cache-line aligned, and default-initializes new elements, i.e. leaves
+// trivial ones unwritten, so a fresh buffer's pages are only backed (and
+// placed on a NUMA node) by whoever writes them first
+template <typename T>
+struct FirstTouchAllocator : AlignedAllocator<T> {
+    FirstTouchAllocator() {}
+    template <typename U> FirstTouchAllocator(const FirstTouchAllocator<U>&) {}
+    
+    template <typename U> struct rebind { typedef FirstTouchAllocator<U> other; };
+    
+    template <typename U> void construct(U* p) { ::new (static_cast<void*>(p)) U; }
+    template <typename U, typename... Args> void construct(U* p, Args&&... args) {
+        ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+};
+
+// ARGB8888 pixels in row-major order, top row first
+class FrameBuffer {
+public:
+    int width, height;
+    std::vector<uint32_t, FirstTouchAllocator<uint32_t>> pixels;
+    
+    // NEW: Linear HDR image. The renderer writes unclamped colors, summed
+    // over progressive frames, into three row-major planes (R, G, B), and
+    // resolve() tonemaps their mean into 'pixels' once the frame is shown or
+    // saved. The planes are only backed once written
+    std::vector<Real, FirstTouchAllocator<Real>> linear[3];
+    int linear_frames;              // frames summed in 'linear'; 0: it holds no image
+    bool quantized;                 // 'pixels' are up to date with 'linear'
+    
+    // Set while the pixels have never been written; the Renderer then has each
+    // of its threads clear the tiles it renders first (see ThreadPool)
+    bool untouched;
+    
+    // Which Renderer frame 'linear' holds, so an incremental render can keep
+    // the tiles it doesn't re-trace; 0 if unknown. Clear it after writing the
+    // image by other means
+    uint64_t render_id;
+    
+    struct Untouched {};
+    
+    FrameBuffer(int w, int h) : width(w), height(h), pixels(size_t(w) * h, 0xFF000000u) { init(false); }
+    
+    // Allocates without writing: the contents are undefined until the first
+    // render, which places each page with the thread that renders it
+    FrameBuffer(int w, int h, Untouched) : width(w), height(h) {
+        pixels.resize(size_t(w) * h);
+        init(true);
+    }
+    
+    void setPixel(int idx, const Color& color) { pixels[idx] = pack(color.x, color.y, color.z); }
+    
+    void setLinear(size_t idx, const Color& color) {
+        linear[0][idx] = color.x;
+        linear[1][idx] = color.y;
+        linear[2][idx] = color.z;
+    }
+    
+    void addLinear(size_t idx, const Color& color) {
+        linear[0][idx] += color.x;
+        linear[1][idx] += color.y;
+        linear[2][idx] += color.z;
+    }
+    
+    Real linearScale() const { return Real(1) / linear_frames; }
+    
+    Color linearColor(size_t idx) const {
+        return Color(linear[0][idx], linear[1][idx], linear[2][idx]) * linearScale();
+    }
+    
+    // Brings 'pixels' up to date with 'linear' (a no-op if they are)
+    void resolve() {
+        if (quantized || linear_frames == 0) return;
+        resolveRows(0, height);
+        quantized = true;
+    }
+    
+    // OPTIMIZATION 12: Deferred, vectorized tonemap
+    // Rows [j0, j1) only, so threads can split the pass; resolve() or the
+    // caller marks the image quantized. One pass over contiguous planes, 8
+    // (AVX-512) or 4 (AVX2) pixels at a time, instead of a clamp and pack per
+    // sample inside the trace loop
+    void resolveRows(int j0, int j1) {
+        const Real* r = linear[0].data();
+        const Real* g = linear[1].data();
+        const Real* b = linear[2].data();
+        uint32_t* out = pixels.data();
+        Real s = linearScale();
+        size_t i = size_t(j0) * width, end = size_t(j1) * width;
+#if defined(__AVX512F__)
+        const __m256i alpha = _mm256_set1_epi32(int(0xFF000000u));
+        for (; i + 8 <= end; i += 8) {
+            __m256i q = _mm256_or_si256(_mm256_slli_epi32(quantize8(r + i, s), 16), _mm256_slli_epi32(quantize8(g + i, s), 8));
+            q = _mm256_or_si256(_mm256_or_si256(q, quantize8(b + i, s)), alpha);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), q);
+        }
+#elif defined(__AVX2__)
+        const __m128i alpha = _mm_set1_epi32(int(0xFF000000u));
+        for (; i + 4 <= end; i += 4) {
+            __m128i q = _mm_or_si128(_mm_slli_epi32(quantize4(r + i, s), 16), _mm_slli_epi32(quantize4(g + i, s), 8));
+            q = _mm_or_si128(_mm_or_si128(q, quantize4(b + i, s)), alpha);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), q);
+        }
+#endif
+        for (; i < end; i++) out[i] = pack(r[i] * s, g[i] * s, b[i] * s);
+    }
+    
+    // Clamped to [0, 1] and quantized to 8 bits per channel
+    static uint32_t pack(Real red, Real green, Real blue) {
+        return (0xFFu << 24) | (quantize(red) << 16) | (quantize(green) << 8) | quantize(blue);
+    }
+    
+    static uint32_t quantize(Real v) {
+        return uint8_t(255.99 * std::min(Real(1), std::max(Real(0), v)));
+    }
+    
+    // The vector forms of quantize(v * s). The scale is applied at Real
+    // precision and the rest in double, as in the scalar code, so both give
+    // the same bytes. max(v, 0) takes the 0 for NaN, like std::max(0, v).
+    // Zero-masked AVX-512 forms for the GCC 12 warning noted in sphere_soa.h
+#if defined(__AVX512F__)
+    static __m256i quantize8(const Real* p, Real s) {
+#ifdef RAYTRACER_DOUBLE
+        __m512d v = _mm512_mul_pd(_mm512_loadu_pd(p), _mm512_set1_pd(s));
+#else
+        __m512d v = _mm512_maskz_cvtps_pd(0xFF, _mm256_mul_ps(_mm256_loadu_ps(p), _mm256_set1_ps(s)));
+#endif
+        v = _mm512_maskz_min_pd(0xFF, _mm512_maskz_max_pd(0xFF, v, _mm512_setzero_pd()), _mm512_set1_pd(1.0));
+        return _mm512_maskz_cvttpd_epi32(0xFF, _mm512_mul_pd(v, _mm512_set1_pd(255.99)));
+    }
+#elif defined(__AVX2__)
+    static __m128i quantize4(const Real* p, Real s) {
+#ifdef RAYTRACER_DOUBLE
+        __m256d v = _mm256_mul_pd(_mm256_loadu_pd(p), _mm256_set1_pd(s));
+#else
+        __m256d v = _mm256_cvtps_pd(_mm_mul_ps(_mm_loadu_ps(p), _mm_set1_ps(s)));
+#endif
+        v = _mm256_min_pd(_mm256_max_pd(v, _mm256_setzero_pd()), _mm256_set1_pd(1.0));
+        return _mm256_cvttpd_epi32(_mm256_mul_pd(v, _mm256_set1_pd(255.99)));
+    }
+#endif
+    
+    uint8_t channel(int idx, int c) const {
+        return uint8_t(pixels[idx] >> (16 - 8 * c));
+    }
+    
+    // Picks the format from the extension (.ppm, .png or .exr)
+    bool save(const std::string& path) {
+        resolve();
+        std::string ext = path.size() >= 4 ? path.substr(path.size() - 4) : "";
+        if (ext == ".png") return savePNG(path);
+        if (ext == ".exr") return saveEXR(path);
+        return savePPM(path);
+    }
+    
+    bool savePPM(const std::string& path) const {
+        FILE* f = fopen(path.c_str(), "wb");
+        if (!f) return false;
+        writePPM(f);
+        return fclose(f) == 0;
+    }
+    
+    bool savePNG(const std::string& path) const {
+        FILE* f = fopen(path.c_str(), "wb");
+        if (!f) return false;
+        writePNG(f);
+        return fclose(f) == 0;
+    }
+    
+    // The encoders, to any open stream (a file, or open_memstream() to send
+    // the image over the network); call resolve() first
+    void writePPM(FILE* f) const {
+        fprintf(f, "P6\n%d %d\n255\n", width, height);
+        std::vector<uint8_t> row(size_t(width) * 3);
+        for (int j = 0; j < height; j++) {
+            rgbRow(j, row.data());
+            fwrite(row.data(), 1, row.size(), f);
+        }
+    }
+    
+    // 8-bit RGB PNG. The zlib stream uses stored (uncompressed) deflate blocks,
+    // which keeps the writer dependency-free at the cost of file size
+    void writePNG(FILE* f) const {
+        std::vector<uint8_t> raw(size_t(height) * (width * 3 + 1));
+        for (int j = 0; j < height; j++) pngRow(j, &raw[size_t(j) * (width * 3 + 1)]);
+        
+        std::vector<uint8_t> z;
+        z.push_back(0x78);
+        z.push_back(0x01);
+        storedBlocks(z, raw.data(), raw.size(), true);
+        putBE32(z, adler32(raw.data(), raw.size()));
+        
+        writePNGHeader(f, width, height);
+        writeChunk(f, "IDAT", z);
+        writeChunk(f, "IEND", std::vector<uint8_t>());
+    }
+    
+    // Uncompressed scanline OpenEXR with 32-bit float B, G, R channels:
+    // the unclamped linear image if there is one, otherwise the 8-bit pixels
+    bool saveEXR(const std::string& path) const {
+        std::vector<uint8_t> out = exrHeader(width, height);
+        
+        // Offset table, then one block per scanline
+        uint64_t offset = out.size() + uint64_t(height) * 8;
+        for (int j = 0; j < height; j++) {
+            putLE64(out, offset);
+            offset += exrLineBytes(width);
+        }
+        for (int j = 0; j < height; j++) exrLine(out, j, j);
+        
+        FILE* f = fopen(path.c_str(), "wb");
+        if (!f) return false;
+        fwrite(out.data(), 1, out.size(), f);
+        return fclose(f) == 0;
+    }
+    
+    // Row j as 8-bit RGB, 3 * width bytes
+    void rgbRow(int j, uint8_t* out) const {
+        for (int i = 0; i < width; i++) {
+            for (int c = 0; c < 3; c++) *out++ = channel(j * width + i, c);
+        }
+    }
+    
+    // Row j as a PNG scanline: filter byte, then RGB
+    void pngRow(int j, uint8_t* out) const {
+        *out = 0;   // filter: none
+        rgbRow(j, out + 1);
+    }
+    
+    // Appends row j as the EXR scanline block of image line 'line'
+    void exrLine(std::vector<uint8_t>& out, int j, int line) const {
+        putLE32(out, uint32_t(line));
+        putLE32(out, uint32_t(width) * 3 * 4);
+        for (int c = 2; c >= 0; c--) {
+            for (int i = 0; i < width; i++) {
+                size_t idx = size_t(j) * width + i;
+                putLEFloat(out, linear_frames > 0 ? float(linear[c][idx] * linearScale()) : channel(int(idx), c) / 255.0f);
+            }
+        }
+    }
+    
+    // Encoding pieces, shared with the streaming writers (stream_output.h)
+    
+    // PNG signature and IHDR of a width x height 8-bit RGB image
+    static void writePNGHeader(FILE* f, int width, int height) {
+        std::vector<uint8_t> ihdr;
+        putBE32(ihdr, width);
+        putBE32(ihdr, height);
+        ihdr.push_back(8);      // bit depth
+        ihdr.push_back(2);      // colour type: RGB
+        ihdr.push_back(0);      // compression
+        ihdr.push_back(0);      // filter
+        ihdr.push_back(0);      // interlace
+        
+        static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        fwrite(signature, 1, 8, f);
+        writeChunk(f, "IHDR", ihdr);
+    }
+    
+    // 'len' bytes as stored deflate blocks; 'final' marks the last one as
+    // the end of the stream (an empty final block if len is 0)
+    static void storedBlocks(std::vector<uint8_t>& z, const uint8_t* data, size_t len, bool final) {
+        size_t pos = 0;
+        do {
+            size_t n = std::min<size_t>(65535, len - pos);
+            z.push_back(final && pos + n == len ? 1 : 0);
+            z.push_back(uint8_t(n));
+            z.push_back(uint8_t(n >> 8));
+            z.push_back(uint8_t(~n));
+            z.push_back(uint8_t(~n >> 8));
+            z.insert(z.end(), data + pos, data + pos + n);
+            pos += n;
+        } while (pos < len);
+    }
+    
+    // Bytes of one EXR scanline block: line number, size, and B, G, R floats
+    static uint64_t exrLineBytes(int width) { return 8 + uint64_t(width) * 3 * 4; }
+    
+    // Everything of a width x height EXR before its offset table
+    static std::vector<uint8_t> exrHeader(int width, int height) {
+        std::vector<uint8_t> out;
+        putLE32(out, 20000630);     // magic
+        putLE32(out, 2);            // version 2, scanline
+        
+        std::vector<uint8_t> chlist;
+        for (const char* name : {"B", "G", "R"}) {
+            chlist.push_back(uint8_t(name[0]));
+            chlist.push_back(0);
+            putLE32(chlist, 2);     // FLOAT
+            putLE32(chlist, 0);     // pLinear + reserved
+            putLE32(chlist, 1);     // x sampling
+            putLE32(chlist, 1);     // y sampling
+        }
+        chlist.push_back(0);
+        
+        std::vector<uint8_t> box;
+        putLE32(box, 0);
+        putLE32(box, 0);
+        putLE32(box, width - 1);
+        putLE32(box, height - 1);
+        
+        std::vector<uint8_t> one_f, zero_v2f;
+        putLEFloat(one_f, 1.0f);
+        putLEFloat(zero_v2f, 0.0f);
+        putLEFloat(zero_v2f, 0.0f);
+        
+        putAttribute(out, "channels", "chlist", chlist);
+        putAttribute(out, "compression", "compression", std::vector<uint8_t>(1, 0));
+        putAttribute(out, "dataWindow", "box2i", box);
+        putAttribute(out, "displayWindow", "box2i", box);
+        putAttribute(out, "lineOrder", "lineOrder", std::vector<uint8_t>(1, 0));
+        putAttribute(out, "pixelAspectRatio", "float", one_f);
+        putAttribute(out, "screenWindowCenter", "v2f", zero_v2f);
+        putAttribute(out, "screenWindowWidth", "float", one_f);
+        out.push_back(0);
+        return out;
+    }
+    
+    static void putBE32(std::vector<uint8_t>& v, uint32_t x) {
+        for (int s = 24; s >= 0; s -= 8) v.push_back(uint8_t(x >> s));
+    }
+    
+    static void putLE32(std::vector<uint8_t>& v, uint32_t x) {
+        for (int s = 0; s < 32; s += 8) v.push_back(uint8_t(x >> s));
+    }
+    
+    static void putLE64(std::vector<uint8_t>& v, uint64_t x) {
+        for (int s = 0; s < 64; s += 8) v.push_back(uint8_t(x >> s));
+    }
+    
+    static void putLEFloat(std::vector<uint8_t>& v, float f) {
+        uint32_t bits;
+        memcpy(&bits, &f, 4);
+        putLE32(v, bits);
+    }
+    
+    static void putAttribute(std::vector<uint8_t>& out, const char* name, const char* type, const std::vector<uint8_t>& value) {
+        out.insert(out.end(), name, name + strlen(name) + 1);
+        out.insert(out.end(), type, type + strlen(type) + 1);
+        putLE32(out, uint32_t(value.size()));
+        out.insert(out.end(), value.begin(), value.end());
+    }
+    
+    // Continues 'adler' (1 to start) over 'len' more bytes
+    static uint32_t adler32(const uint8_t* data, size_t len, uint32_t adler = 1) {
+        uint32_t a = adler & 0xFFFF, b = adler >> 16;
+        for (size_t i = 0; i < len; i++) {
+            a = (a + data[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        return (b << 16) | a;
+    }
+    
+    static std::vector<uint32_t> crcTable() {
+        std::vector<uint32_t> table(256);
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        return table;
+    }
+    
+    static uint32_t crc32(const uint8_t* data, size_t len, uint32_t crc) {
+        static const std::vector<uint32_t> table = crcTable();
+        for (size_t i = 0; i < len; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return crc;
+    }
+    
+    static void writeChunk(FILE* f, const char* type, const std::vector<uint8_t>& data) {
+        std::vector<uint8_t> header;
+        putBE32(header, uint32_t(data.size()));
+        header.insert(header.end(), type, type + 4);
+        fwrite(header.data(), 1, 8, f);
+        if (!data.empty()) fwrite(data.data(), 1, data.size(), f);
+        
+        uint32_t crc = crc32(header.data() + 4, 4, 0xFFFFFFFFu);
+        crc = crc32(data.data(), data.size(), crc) ^ 0xFFFFFFFFu;
+        std::vector<uint8_t> tail;
+        putBE32(tail, crc);
+        fwrite(tail.data(), 1, 4, f);
+    }
+
+private:
+    void init(bool fresh) {
+        for (int c = 0; c < 3; c++) linear[c].resize(pixels.size());
+        linear_frames = 0;
+        quantized = true;
+        untouched = fresh;
+        render_id = 0;
+    }
+};
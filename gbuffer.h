@@ -0,0 +1,56 @@
+// Primary-visibility cache: where every pixel's camera ray hits first
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "scene.h"
+#include "camera.h"
+
+// NEW: G-buffer of primary hits (Renderer::setPrimaryCache). Frames of an
+// unchanged view into unchanged geometry send their camera rays to the same
+// spheres, so after edits to lights, materials or the background, and for
+// every progressive frame of sampled lights, shading starts from here
+// instead of from a primary intersection. The entries are exactly what
+// Scene::firstHit() (or the PacketTracer) computed, so the image is too
+class GBuffer {
+public:
+    GBuffer() : scene(nullptr), backend(nullptr), geometry_version(0), valid(false) {}
+    
+    // Whether the entries are the first hits of 'frame' in 'scene' as it is now
+    bool holds(const Scene& s, const CameraFrame& frame) const {
+        return valid && scene == &s && backend == &s.intersectBackend() &&
+               geometry_version == s.geometryVersion() && view.sameRays(frame);
+    }
+    
+    // Starts over for 'frame' in 'scene'; the entries count once commit()
+    // says every pixel has been written
+    void prepare(const Scene& s, const CameraFrame& frame) {
+        valid = false;
+        scene = &s;
+        backend = &s.intersectBackend();
+        geometry_version = s.geometryVersion();
+        view = frame;
+        hits.resize(size_t(frame.width) * frame.height);
+    }
+    
+    void commit() { valid = true; }
+    
+    // Drops the entries and their memory
+    void clear() {
+        valid = false;
+        std::vector<PrimaryHit>().swap(hits);
+    }
+    
+    // Local pixel idx (row-major over the frame)
+    PrimaryHit& operator[](size_t idx) { return hits[idx]; }
+    const PrimaryHit& operator[](size_t idx) const { return hits[idx]; }
+
+private:
+    const Scene* scene;
+    const IntersectBackend* backend;
+    uint64_t geometry_version;
+    CameraFrame view;
+    bool valid;
+    std::vector<PrimaryHit> hits;
+};
@@ -0,0 +1,325 @@
+// Golden-image regression test: renders the interesting_scenes.cpp presets
+// headlessly, compares them with the stored goldens and gates throughput
+//
+// Usage: ./raytracer_golden [--goldens DIR] [--update] [--tolerance N] [--max-outliers PCT]
+//                           [--min-psnr DB] [--hw-min-psnr DB] [--no-hardware] [--frames N]
+//                           [--baseline FILE] [--record-baseline] [--max-slowdown PCT] [--no-perf-gate]
+//                           [--packet-tolerance N] [--packet-max-differing PCT]
+//                           [--device-tolerance N] [--device-max-differing PCT]
+//
+// Every preset is rendered with single rays, with packets and with the
+// device kernel, each compared with DIR/<scene>.ppm, and with packets on the
+// accelerator model, which has to stay within a looser PSNR of the same
+// golden (the whole-renderer form of compare_with_model in the
+// hardware testbench). Packets are also held to the single-ray frame
+// itself: their vector hit tests may round a hit differently, so a few
+// pixels may differ, by at most --packet-tolerance levels (default 1) and
+// on at most --packet-max-differing percent of pixels (default 0.1). That
+// pins how far the two modes may drift apart. Device frames are held to
+// the single-ray frame the same way (--device-tolerance and
+// --device-max-differing), since the kernel restates Scene::trace rather
+// than calling it. scenes/default.scene, at the 800x600 the renderer opens
+// it at, gets both checks. The
+// single-ray frames are timed; with a baseline file (written by
+// --record-baseline, per machine), throughput more than
+// --max-slowdown percent below it fails, and so does a preset the baseline
+// doesn't have: record one first, or pass --no-perf-gate to check only the
+// images. Exits 1 if any check fails
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+
+#include "renderer.h"
+#include "scene_io.h"
+#include "interesting_scenes.cpp"
+
+struct GoldenScene {
+    std::string name;
+    void (*setup)(Scene&);
+};
+
+// How far a frame's 8-bit pixels are from a golden's
+struct ImageDiff {
+    int max_level;          // largest per-channel difference
+    size_t outliers;        // pixels with a channel off by more than the tolerance
+    double psnr;            // dB over all channels; infinite for identical images
+};
+
+static bool loadPPM(const std::string& path, int& width, int& height, std::vector<uint8_t>& rgb) {
+    std::ifstream in(path, std::ios::binary);
+    std::string magic;
+    int max_value = 0;
+    if (!(in >> magic >> width >> height >> max_value) || magic != "P6" || max_value != 255 || width <= 0 || height <= 0) {
+        return false;
+    }
+    in.get();           // the single whitespace before the pixels
+    rgb.resize(size_t(width) * height * 3);
+    return bool(in.read(reinterpret_cast<char*>(rgb.data()), rgb.size()));
+}
+
+static ImageDiff compare(const FrameBuffer& frame, const std::vector<uint8_t>& golden, int tolerance) {
+    ImageDiff d = {0, 0, 0};
+    double squared = 0;
+    for (int idx = 0; idx < frame.width * frame.height; idx++) {
+        bool outlier = false;
+        for (int c = 0; c < 3; c++) {
+            int diff = std::abs(int(frame.channel(idx, c)) - int(golden[size_t(idx) * 3 + c]));
+            d.max_level = std::max(d.max_level, diff);
+            outlier = outlier || diff > tolerance;
+            squared += double(diff) * diff;
+        }
+        d.outliers += outlier;
+    }
+    double mse = squared / (3.0 * frame.width * frame.height);
+    d.psnr = mse > 0 ? 10 * std::log10(255.0 * 255.0 / mse) : std::numeric_limits<double>::infinity();
+    return d;
+}
+
+static std::vector<uint8_t> rgbOf(const FrameBuffer& frame) {
+    std::vector<uint8_t> rgb(size_t(frame.width) * frame.height * 3);
+    for (int idx = 0; idx < frame.width * frame.height; idx++) {
+        for (int c = 0; c < 3; c++) rgb[size_t(idx) * 3 + c] = frame.channel(idx, c);
+    }
+    return rgb;
+}
+
+// Renders until the image is final and returns the fastest frame time (ms):
+// frames this small are short enough for scheduling noise to swamp a median
+static double renderTimed(Renderer& renderer, const Scene& scene, const Camera& camera, FrameBuffer& target,
+                          int frames) {
+    std::vector<double> times;
+    for (int f = 0; f < frames; f++) {
+        renderer.resetAccumulation();
+        auto start = std::chrono::high_resolution_clock::now();
+        do {
+            renderer.render(scene, camera, target);
+        } while (renderer.refining(scene));
+        renderer.resolve(target);
+        times.push_back(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+    }
+    return *std::min_element(times.begin(), times.end());
+}
+
+// "<scene> <Mrays/sec>" per line
+static std::map<std::string, double> loadBaseline(const std::string& path) {
+    std::map<std::string, double> baseline;
+    std::ifstream in(path);
+    std::string name;
+    double mrays;
+    while (in >> name >> mrays) baseline[name] = mrays;
+    return baseline;
+}
+
+int main(int argc, char* argv[]) {
+    std::string golden_dir = "goldens";
+    std::string baseline_path = "goldens/perf_baseline.txt";
+    bool update = false;
+    bool record_baseline = false;
+    bool hardware = true;
+    bool perf_gate = true;
+    int tolerance = 2;              // levels per channel
+    double max_outliers = 0.1;      // percent of pixels beyond the tolerance
+    double min_psnr = 45;
+    double hw_min_psnr = 30;
+    double max_slowdown = 15;       // percent below the baseline throughput
+    int packet_tolerance = 1;       // levels packets may differ from single rays by
+    double packet_max_differing = 0.1;  // percent of pixels that may differ at all
+    int device_tolerance = 1;       // the same for device frames
+    double device_max_differing = 0.1;
+    int frames = 15;
+    const int width = 200, height = 150;
+    
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--goldens" && a + 1 < argc) {
+            golden_dir = argv[++a];
+        } else if (arg == "--update") {
+            update = true;
+        } else if (arg == "--tolerance" && a + 1 < argc) {
+            tolerance = std::max(0, atoi(argv[++a]));
+        } else if (arg == "--max-outliers" && a + 1 < argc) {
+            max_outliers = atof(argv[++a]);
+        } else if (arg == "--min-psnr" && a + 1 < argc) {
+            min_psnr = atof(argv[++a]);
+        } else if (arg == "--hw-min-psnr" && a + 1 < argc) {
+            hw_min_psnr = atof(argv[++a]);
+        } else if (arg == "--no-hardware") {
+            hardware = false;
+        } else if (arg == "--frames" && a + 1 < argc) {
+            frames = std::max(1, atoi(argv[++a]));
+        } else if (arg == "--baseline" && a + 1 < argc) {
+            baseline_path = argv[++a];
+        } else if (arg == "--record-baseline") {
+            record_baseline = true;
+        } else if (arg == "--packet-tolerance" && a + 1 < argc) {
+            packet_tolerance = std::max(0, atoi(argv[++a]));
+        } else if (arg == "--packet-max-differing" && a + 1 < argc) {
+            packet_max_differing = atof(argv[++a]);
+        } else if (arg == "--device-tolerance" && a + 1 < argc) {
+            device_tolerance = std::max(0, atoi(argv[++a]));
+        } else if (arg == "--device-max-differing" && a + 1 < argc) {
+            device_max_differing = atof(argv[++a]);
+        } else if (arg == "--no-perf-gate") {
+            perf_gate = false;
+        } else if (arg == "--max-slowdown" && a + 1 < argc) {
+            max_slowdown = atof(argv[++a]);
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+    
+    std::vector<GoldenScene> scenes = {
+        {"mirror_gallery", setupMirrorGallery},
+        {"neon_dreams", setupNeonDreams},
+        {"planetary_system", setupPlanetarySystem},
+        {"glass_orbs", setupGlassOrbs},
+        {"golden_hour", setupGoldenHour},
+        {"candy_land", setupCandyLand},
+        {"deep_ocean", setupDeepOcean}
+    };
+    
+    Camera camera(Vec3(0, 1, 5), Vec3(0, 0, 0));
+    Renderer renderer;
+    renderer.setVerbose(false);
+    std::map<std::string, double> baseline = loadBaseline(baseline_path);
+    std::map<std::string, double> measured;
+    int failures = 0;
+    
+    // Another mode's frame against the single-ray frame of the same scene
+    auto checkMode = [&](const std::string& name, const char* label, const FrameBuffer& single, const FrameBuffer& other,
+                         int tolerance, double max_differing) {
+        ImageDiff d = compare(other, rgbOf(single), 0);
+        double differing_pct = 100.0 * d.outliers / (double(single.width) * single.height);
+        bool pass = d.max_level <= tolerance && differing_pct <= max_differing;
+        printf("%-18s %-14s max diff %3d  differing %6.3f%%  %s\n", name.c_str(), label, d.max_level, differing_pct,
+               pass ? "ok" : "FAIL");
+        failures += !pass;
+    };
+    
+    for (const GoldenScene& gs : scenes) {
+        Scene scene;
+        gs.setup(scene);
+        scene.buildBVH();
+        std::string golden_path = golden_dir + "/" + gs.name + ".ppm";
+        
+        // The golden itself: single rays on the SIMD backend
+        FrameBuffer frame(width, height);
+        scene.setBackend(simdBackend());
+        renderer.setTraceMode(TraceMode::Single);
+        renderTimed(renderer, scene, camera, frame, 1);     // warm-up
+        double ms = renderTimed(renderer, scene, camera, frame, frames);
+        double mrays = renderer.stats().rays.total() / (ms / 1000.0) / 1e6;
+        measured[gs.name] = mrays;
+        
+        if (update) {
+            if (!frame.savePPM(golden_path)) {
+                std::cerr << "Cannot write " << golden_path << std::endl;
+                return 1;
+            }
+            printf("%-18s wrote %s\n", gs.name.c_str(), golden_path.c_str());
+            continue;
+        }
+        
+        int gw, gh;
+        std::vector<uint8_t> golden;
+        if (!loadPPM(golden_path, gw, gh, golden) || gw != width || gh != height) {
+            printf("%-18s FAIL: no %dx%d golden at %s (run with --update)\n", gs.name.c_str(), width, height,
+                   golden_path.c_str());
+            failures++;
+            continue;
+        }
+        
+        auto check = [&](const char* what, const FrameBuffer& f, bool hw) {
+            ImageDiff d = compare(f, golden, tolerance);
+            double outlier_pct = 100.0 * d.outliers / (double(width) * height);
+            bool pass = hw ? d.psnr >= hw_min_psnr : d.psnr >= min_psnr && outlier_pct <= max_outliers;
+            printf("%-18s %-14s max diff %3d  outliers %6.3f%%  PSNR %6.2f dB  %s\n", gs.name.c_str(), what,
+                   d.max_level, outlier_pct, d.psnr, pass ? "ok" : "FAIL");
+            failures += !pass;
+        };
+        check("single", frame, false);
+        
+        FrameBuffer packets(width, height);
+        renderer.setTraceMode(TraceMode::Packet);
+        renderTimed(renderer, scene, camera, packets, 1);
+        check("packet", packets, false);
+        checkMode(gs.name, "packet~single", frame, packets, packet_tolerance, packet_max_differing);
+        
+        FrameBuffer device(width, height);
+        renderer.setTraceMode(TraceMode::Device);
+        renderTimed(renderer, scene, camera, device, 1);
+        check("device", device, false);
+        checkMode(gs.name, "device~single", frame, device, device_tolerance, device_max_differing);
+        renderer.setTraceMode(TraceMode::Packet);
+        
+        // The accelerator's fixed-point tests only have to stay close
+        if (hardware) {
+            FrameBuffer accel(width, height);
+            scene.setBackend(acceleratorBackend());
+            renderTimed(renderer, scene, camera, accel, 1);
+            check("accel packet", accel, true);
+        }
+        
+        auto b = baseline.find(gs.name);
+        if (!perf_gate || record_baseline) {
+            printf("%-18s %-14s %8.2f Mrays/s\n", gs.name.c_str(), "throughput", mrays);
+        } else if (b == baseline.end()) {
+            printf("%-18s %-14s %8.2f Mrays/s  FAIL: no baseline in %s (run with --record-baseline)\n",
+                   gs.name.c_str(), "throughput", mrays, baseline_path.c_str());
+            failures++;
+        } else {
+            bool pass = mrays >= b->second * (1 - max_slowdown / 100);
+            printf("%-18s %-14s %8.2f Mrays/s  baseline %8.2f (%+.1f%%)  %s\n", gs.name.c_str(), "throughput", mrays,
+                   b->second, 100.0 * (mrays / b->second - 1), pass ? "ok" : "FAIL");
+            failures += !pass;
+        }
+        fflush(stdout);
+    }
+    
+    if (record_baseline) {
+        std::ofstream out(baseline_path);
+        if (!out) {
+            std::cerr << "Cannot write " << baseline_path << std::endl;
+            return 1;
+        }
+        for (const auto& m : measured) out << m.first << " " << m.second << "\n";
+        std::cout << "Recorded throughput baseline in " << baseline_path << std::endl;
+    }
+    if (update) return 0;
+    
+    // The default scene has no golden; only its modes are compared
+    Scene default_scene;
+    Camera default_camera = camera;
+    if (!loadScene("scenes/default.scene", default_scene, &default_camera)) {
+        printf("%-18s FAIL: cannot load scenes/default.scene\n", "default");
+        failures++;
+    } else {
+        default_scene.buildBVH();
+        FrameBuffer single(800, 600), packets(800, 600);
+        renderer.setTraceMode(TraceMode::Single);
+        renderTimed(renderer, default_scene, default_camera, single, 1);
+        renderer.setTraceMode(TraceMode::Packet);
+        renderTimed(renderer, default_scene, default_camera, packets, 1);
+        checkMode("default", "packet~single", single, packets, packet_tolerance, packet_max_differing);
+        FrameBuffer device(800, 600);
+        renderer.setTraceMode(TraceMode::Device);
+        renderTimed(renderer, default_scene, default_camera, device, 1);
+        checkMode("default", "device~single", single, device, device_tolerance, device_max_differing);
+    }
+    
+    if (failures) {
+        std::cout << failures << " golden check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All golden checks passed" << std::endl;
+    return 0;
+}
@@ -2,6 +2,8 @@
 /* HOW TO USE: 
     - copy and paste the contents of whichever scenery function that you want to use into the main 
     function of raytracer.cpp where the scenery detailing is.
+    - or skip the copy-paste: each preset is also in scenes/ as a text scene file,
+      e.g. ./raytracer --scene scenes/mirror_gallery.scene
 */
 
 // SCENE 1: "Mirror Gallery" - Highly reflective spheres
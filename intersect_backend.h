@@ -0,0 +1,575 @@
+// Intersection backends: the sphere tests behind Scene's ray queries, on the
+// CPU (scalar or SIMD) or batched out to the ray-sphere accelerator
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "geometry.h"
+#include "sphere_soa.h"
+#include "bvh.h"
+#include "stats.h"
+
+// NEW: What Scene dispatches its intersection queries to, chosen at runtime
+// with Scene::setBackend(). Each call is a whole query - BVH traversal plus
+// the tests in every leaf it reaches (all of the SoA if the BVH is empty) -
+// so the virtual call is paid once per ray or packet, not once per leaf.
+// Results follow Sphere::intersect: nearest root past hitEpsilon(r²), SoA slots
+class IntersectBackend {
+public:
+    virtual ~IntersectBackend() {}
+    virtual const char* name() const = 0;
+    
+    // Closest hit nearer than closest_t; updates closest_t/hit_slot
+    virtual void intersect(const SphereSoA& soa, const BVH& bvh, const Ray& ray, Real& closest_t, int& hit_slot) const = 0;
+    
+    // A slot blocking the ray before max_distance, or -1
+    virtual int occluded(const SphereSoA& soa, const BVH& bvh, const Ray& ray, Real max_distance) const = 0;
+    
+    // Packet forms: closest hit per p.active lane into p.t/p.hit, and the
+    // 'lanes' blocked before their p.t ('occluder' receives the last blocking slot)
+    virtual void intersectPacket(const SphereSoA& soa, const BVH& bvh, RayPacket& p) const = 0;
+    virtual unsigned occludedPacket(const SphereSoA& soa, const BVH& bvh, const RayPacket& p, unsigned lanes,
+                                    int* occluder) const = 0;
+    
+    // Shadow tests against slots [first, first + count) alone, without the BVH
+    // (the last-occluder cache)
+    virtual int occludedRange(const SphereSoA& soa, int first, int count, const Ray& ray, Real max_distance) const = 0;
+    virtual unsigned occludedPacketRange(const SphereSoA& soa, int first, int count, const RayPacket& p,
+                                         unsigned lanes) const = 0;
+};
+
+// Nearest root of slot s past hitEpsilon(r²), one ray and one sphere at a time
+static inline bool sphereRootScalar(const SphereSoA& soa, int s, const Vec3& origin, const Vec3& direction, Real& t) {
+    Vec3 oc = origin - soa.center(s);
+    Real b_half = oc.dot(direction);
+    Real disc = b_half * b_half - (oc.lengthSquared() - soa.r2[s]);
+    if (disc < 0) return false;
+    Real eps = hitEpsilon(soa.r2[s]);
+    Real sqrt_disc = std::sqrt(disc);
+    t = -b_half - sqrt_disc;
+    if (t > eps) return true;
+    t = -b_half + sqrt_disc;
+    return t > eps;
+}
+
+// Leaf kernels for KernelBackend: plain loops, no SIMD. The reference the
+// other backends are compared against
+struct ScalarKernels {
+    static void closest(const SphereSoA& soa, int first, int count, const Ray& ray, Real& closest_t, int& hit_slot) {
+        for (int s = first; s < first + count; s++) {
+            Real t;
+            if (sphereRootScalar(soa, s, ray.origin, ray.direction, t) && t < closest_t) {
+                closest_t = t;
+                hit_slot = s;
+            }
+        }
+    }
+    
+    static int any(const SphereSoA& soa, int first, int count, const Ray& ray, Real max_distance) {
+        for (int s = first; s < first + count; s++) {
+            Real t;
+            if (sphereRootScalar(soa, s, ray.origin, ray.direction, t) && t < max_distance) return s;
+        }
+        return -1;
+    }
+    
+    static void closestPacket(const SphereSoA& soa, int first, int count, RayPacket& p, unsigned lanes) {
+        for (int s = first; s < first + count; s++) {
+            for (unsigned m = lanes; m; m &= m - 1) {
+                int k = __builtin_ctz(m);
+                Real t;
+                if (sphereRootScalar(soa, s, p.origin(k), p.direction(k), t) && t < p.t[k]) {
+                    p.t[k] = t;
+                    p.hit[k] = s;
+                }
+            }
+        }
+    }
+    
+    static unsigned anyPacket(const SphereSoA& soa, int first, int count, const RayPacket& p, unsigned lanes, int* blocker) {
+        unsigned occluded = 0;
+        for (int s = first; s < first + count && occluded != lanes; s++) {
+            unsigned hit = 0;
+            for (unsigned m = lanes & ~occluded; m; m &= m - 1) {
+                int k = __builtin_ctz(m);
+                Real t;
+                if (sphereRootScalar(soa, s, p.origin(k), p.direction(k), t) && t < p.t[k]) hit |= 1u << k;
+            }
+            if (hit && blocker) *blocker = s;
+            occluded |= hit;
+        }
+        return occluded;
+    }
+};
+
+// Leaf kernels for KernelBackend: the sphere_soa.h SIMD kernels
+struct SimdKernels {
+    static void closest(const SphereSoA& soa, int first, int count, const Ray& ray, Real& closest_t, int& hit_slot) {
+        intersectSpheresSIMD(soa, first, count, ray, closest_t, hit_slot);
+    }
+    static int any(const SphereSoA& soa, int first, int count, const Ray& ray, Real max_distance) {
+        return anySphereSIMD(soa, first, count, ray, max_distance);
+    }
+    static void closestPacket(const SphereSoA& soa, int first, int count, RayPacket& p, unsigned lanes) {
+        intersectPacketSpheres(soa, first, count, p, lanes);
+    }
+    static unsigned anyPacket(const SphereSoA& soa, int first, int count, const RayPacket& p, unsigned lanes, int* blocker) {
+        return occludedPacketSpheres(soa, first, count, p, lanes, blocker);
+    }
+};
+
+// CPU backend: the BVH traversals with leaf kernels K inlined into them
+template <typename K>
+class KernelBackend : public IntersectBackend {
+public:
+    explicit KernelBackend(const char* n) : label(n) {}
+    
+    const char* name() const override { return label; }
+    
+    void intersect(const SphereSoA& soa, const BVH& bvh, const Ray& ray, Real& closest_t, int& hit_slot) const override {
+        RayCounters& counters = threadCounters();
+        if (bvh.empty()) {
+            counters.sphere_tests += soa.size();
+            K::closest(soa, 0, int(soa.size()), ray, closest_t, hit_slot);
+            return;
+        }
+        bvh.traverse(ray, closest_t, [&](int first, int count, Real& t_max) {
+            counters.sphere_tests += count;
+            K::closest(soa, first, count, ray, closest_t, hit_slot);
+            t_max = closest_t;
+            return false;
+        });
+    }
+    
+    int occluded(const SphereSoA& soa, const BVH& bvh, const Ray& ray, Real max_distance) const override {
+        RayCounters& counters = threadCounters();
+        if (bvh.empty()) {
+            counters.sphere_tests += soa.size();
+            return K::any(soa, 0, int(soa.size()), ray, max_distance);
+        }
+        int slot = -1;
+        bvh.traverse(ray, max_distance, [&](int first, int count, Real&) {
+            counters.sphere_tests += count;
+            slot = K::any(soa, first, count, ray, max_distance);
+            return slot >= 0;
+        });
+        return slot;
+    }
+    
+    void intersectPacket(const SphereSoA& soa, const BVH& bvh, RayPacket& p) const override {
+        RayCounters& counters = threadCounters();
+        if (bvh.empty()) {
+            counters.sphere_tests += soa.size() * __builtin_popcount(p.active);
+            K::closestPacket(soa, 0, int(soa.size()), p, p.active);
+            return;
+        }
+        bvh.traversePacket(p, p.active, [&](int first, int count, unsigned lanes) {
+            counters.sphere_tests += count * __builtin_popcount(lanes);
+            K::closestPacket(soa, first, count, p, lanes);
+            return lanes;
+        });
+    }
+    
+    unsigned occludedPacket(const SphereSoA& soa, const BVH& bvh, const RayPacket& p, unsigned lanes,
+                            int* occluder) const override {
+        RayCounters& counters = threadCounters();
+        if (bvh.empty()) {
+            counters.sphere_tests += soa.size() * __builtin_popcount(lanes);
+            return K::anyPacket(soa, 0, int(soa.size()), p, lanes, occluder);
+        }
+        unsigned occluded = 0;
+        bvh.traversePacket(p, lanes, [&](int first, int count, unsigned live) {
+            counters.sphere_tests += count * __builtin_popcount(live);
+            unsigned blocked = K::anyPacket(soa, first, count, p, live, occluder);
+            occluded |= blocked;
+            return live & ~blocked;
+        });
+        return occluded;
+    }
+    
+    int occludedRange(const SphereSoA& soa, int first, int count, const Ray& ray, Real max_distance) const override {
+        threadCounters().sphere_tests += count;
+        return K::any(soa, first, count, ray, max_distance);
+    }
+    
+    unsigned occludedPacketRange(const SphereSoA& soa, int first, int count, const RayPacket& p,
+                                 unsigned lanes) const override {
+        threadCounters().sphere_tests += count * __builtin_popcount(lanes);
+        return K::anyPacket(soa, first, count, p, lanes, nullptr);
+    }
+
+private:
+    const char* label;
+};
+
+// One ray-sphere job as the accelerator takes it: Q16.16 operands, unit
+// direction, r² instead of r (see ray_sphere_fixed.sv)
+struct AcceleratorJob {
+    int32_t ox, oy, oz;
+    int32_t dx, dy, dz;
+    int32_t cx, cy, cz;
+    int32_t r2;
+};
+
+struct AcceleratorResult {
+    bool hit;
+    int32_t t;          // Q16.16, valid if hit
+};
+
+// The hardware side of AcceleratorBackend: runs a batch and returns one
+// result per job, in job order. A Verilator model or an FPGA driver plugs in
+// here (the RaySphereStream class in ray_sphere_stream_tb.cpp has the same
+// submit/drain shape); run() is called from every render thread at once
+class AcceleratorDevice {
+public:
+    virtual ~AcceleratorDevice() {}
+    virtual const char* name() const = 0;
+    virtual void run(const std::vector<AcceleratorJob>& jobs, std::vector<AcceleratorResult>& results) const = 0;
+};
+
+// C++ model of ray_sphere_fixed.sv at its default parameters (WIDTH 32,
+// FRAC 16, GUARD 8), written to compute bit for bit what the pipeline does.
+// Both testbenches hold the RTL to it with no tolerance, but until run.sh
+// has passed under Verilator that equivalence is unverified. Stateless,
+// hence thread-safe; it doesn't model timing
+class FixedPointModel : public AcceleratorDevice {
+public:
+    static const int FRAC = 16;
+    static const int GUARD = 8;
+    
+    const char* name() const override { return "ray_sphere_fixed model"; }
+    
+    void run(const std::vector<AcceleratorJob>& jobs, std::vector<AcceleratorResult>& results) const override {
+        results.resize(jobs.size());
+        for (size_t i = 0; i < jobs.size(); i++) results[i] = evaluate(jobs[i]);
+    }
+    
+    static AcceleratorResult evaluate(const AcceleratorJob& j) {
+        typedef __int128 Wide;
+        Wide ocx = Wide(j.ox) - j.cx, ocy = Wide(j.oy) - j.cy, ocz = Wide(j.oz) - j.cz;
+        
+        // b' in Q.(FRAC+GUARD), rounded; c in Q.2FRAC
+        Wide b_sum = ocx * j.dx + ocy * j.dy + ocz * j.dz + (Wide(1) << (FRAC - GUARD - 1));
+        Wide b = b_sum >> (FRAC - GUARD);
+        Wide c = ocx * ocx + ocy * ocy + ocz * ocz - (Wide(j.r2) << FRAC);
+        Wide disc = b * b - (c << (2 * GUARD));
+        AcceleratorResult r = {false, 0};
+        if (disc < 0) return r;
+        
+        Wide root = Wide(isqrt((unsigned __int128)disc));
+        Wide eps = Wide((1 << FRAC) / 1000) << GUARD;
+        Wide t = -b - root;
+        if (t <= eps) t = -b + root;
+        if (t <= eps) return r;
+        
+        Wide rounded = (t + (Wide(1) << (GUARD - 1))) >> GUARD;
+        r.hit = true;
+        r.t = rounded > INT32_MAX ? INT32_MAX : int32_t(rounded);
+        return r;
+    }
+
+private:
+    // floor(sqrt(v)), the value isqrt_pipe produces
+    static uint64_t isqrt(unsigned __int128 v) {
+        uint64_t root = uint64_t(std::sqrt((long double)v));
+        while ((unsigned __int128)root * root > v) root--;
+        while ((unsigned __int128)(root + 1) * (root + 1) <= v) root++;
+        return root;
+    }
+};
+
+// NEW: Hybrid backend that batches sphere tests for the accelerator. The
+// BVH is traversed on the CPU; the spheres of every leaf reached become jobs
+// (one per live ray for packets, so the PacketTracer's packets fill the
+// batches) and a batch goes to the device once it holds batch_jobs jobs or
+// the query ends. Closest-hit queries only tighten their cull distance when
+// a batch comes back, which is the price of batching. Tests the hardware
+// can't do - operands outside Q16.16, or spheres large enough that
+// hitEpsilon(r²) exceeds the pipeline's fixed 0.001 - run on the CPU.
+// A Q16.16 direction is unit length only to about 1e-5 and the a = 1 form
+// scales that error by |oc|², enough to miss or invent hits on spheres a
+// hundred units away. So each job's ray starts just in front of its sphere
+// (2r before the closest approach, still outside it) and the distance
+// skipped is added back to the t that comes out
+class AcceleratorBackend : public IntersectBackend {
+public:
+    AcceleratorBackend(const AcceleratorDevice& d, int batch = 256) : device(d), batch_jobs(std::max(1, batch)) {}
+    
+    const char* name() const override { return "accel"; }
+    
+    void intersect(const SphereSoA& soa, const BVH& bvh, const Ray& ray, Real& closest_t, int& hit_slot) const override {
+        Batch& batch = threadBatch();
+        batch.clear();
+        auto leaf = [&](int first, int count, Real& t_max) {
+            for (int s = first; s < first + count; s++) {
+                if (!submit(batch, soa, s, ray.origin, ray.direction, 0)) {
+                    cpuClosest(soa, s, ray.origin, ray.direction, closest_t, hit_slot);
+                }
+            }
+            if (int(batch.jobs.size()) >= batch_jobs) flushClosest(batch, closest_t, hit_slot);
+            t_max = closest_t;
+            return false;
+        };
+        if (bvh.empty()) {
+            Real t_max = closest_t;
+            leaf(0, int(soa.size()), t_max);
+        } else {
+            bvh.traverse(ray, closest_t, leaf);
+        }
+        flushClosest(batch, closest_t, hit_slot);
+    }
+    
+    int occluded(const SphereSoA& soa, const BVH& bvh, const Ray& ray, Real max_distance) const override {
+        Batch& batch = threadBatch();
+        batch.clear();
+        int slot = -1;
+        auto leaf = [&](int first, int count, Real&) {
+            for (int s = first; s < first + count && slot < 0; s++) {
+                if (submit(batch, soa, s, ray.origin, ray.direction, 0)) continue;
+                Real t;
+                threadCounters().accel_cpu++;
+                if (sphereRootScalar(soa, s, ray.origin, ray.direction, t) && t < max_distance) slot = s;
+            }
+            if (slot < 0 && int(batch.jobs.size()) >= batch_jobs) slot = flushAny(batch, max_distance);
+            return slot >= 0;
+        };
+        Real t_max = max_distance;
+        if (bvh.empty()) leaf(0, int(soa.size()), t_max);
+        else bvh.traverse(ray, max_distance, leaf);
+        if (slot < 0) slot = flushAny(batch, max_distance);
+        return slot;
+    }
+    
+    void intersectPacket(const SphereSoA& soa, const BVH& bvh, RayPacket& p) const override {
+        Batch& batch = threadBatch();
+        batch.clear();
+        auto leaf = [&](int first, int count, unsigned lanes) {
+            for (int s = first; s < first + count; s++) {
+                for (unsigned m = lanes; m; m &= m - 1) {
+                    int k = __builtin_ctz(m);
+                    if (!submit(batch, soa, s, p.origin(k), p.direction(k), k)) {
+                        cpuClosest(soa, s, p.origin(k), p.direction(k), p.t[k], p.hit[k]);
+                    }
+                }
+            }
+            if (int(batch.jobs.size()) >= batch_jobs) flushPacket(batch, p);
+            return lanes;
+        };
+        if (bvh.empty()) leaf(0, int(soa.size()), p.active);
+        else bvh.traversePacket(p, p.active, leaf);
+        flushPacket(batch, p);
+    }
+    
+    unsigned occludedPacket(const SphereSoA& soa, const BVH& bvh, const RayPacket& p, unsigned lanes,
+                            int* occluder) const override {
+        Batch& batch = threadBatch();
+        batch.clear();
+        unsigned occluded = 0;
+        auto leaf = [&](int first, int count, unsigned live) {
+            live &= ~occluded;
+            for (int s = first; s < first + count; s++) {
+                for (unsigned m = live; m; m &= m - 1) {
+                    int k = __builtin_ctz(m);
+                    if (submit(batch, soa, s, p.origin(k), p.direction(k), k)) continue;
+                    Real t;
+                    threadCounters().accel_cpu++;
+                    if (sphereRootScalar(soa, s, p.origin(k), p.direction(k), t) && t < p.t[k]) {
+                        occluded |= 1u << k;
+                        if (occluder) *occluder = s;
+                    }
+                }
+            }
+            if (int(batch.jobs.size()) >= batch_jobs) occluded |= flushOccluded(batch, p, occluder);
+            return live & ~occluded;
+        };
+        if (bvh.empty()) leaf(0, int(soa.size()), lanes);
+        else bvh.traversePacket(p, lanes, leaf);
+        return occluded | flushOccluded(batch, p, occluder);
+    }
+    
+    int occludedRange(const SphereSoA& soa, int first, int count, const Ray& ray, Real max_distance) const override {
+        Batch& batch = threadBatch();
+        batch.clear();
+        for (int s = first; s < first + count; s++) {
+            if (submit(batch, soa, s, ray.origin, ray.direction, 0)) continue;
+            Real t;
+            threadCounters().accel_cpu++;
+            if (sphereRootScalar(soa, s, ray.origin, ray.direction, t) && t < max_distance) return s;
+        }
+        return flushAny(batch, max_distance);
+    }
+    
+    unsigned occludedPacketRange(const SphereSoA& soa, int first, int count, const RayPacket& p,
+                                 unsigned lanes) const override {
+        Batch& batch = threadBatch();
+        batch.clear();
+        unsigned occluded = 0;
+        for (int s = first; s < first + count; s++) {
+            for (unsigned m = lanes; m; m &= m - 1) {
+                int k = __builtin_ctz(m);
+                if (submit(batch, soa, s, p.origin(k), p.direction(k), k)) continue;
+                Real t;
+                threadCounters().accel_cpu++;
+                if (sphereRootScalar(soa, s, p.origin(k), p.direction(k), t) && t < p.t[k]) occluded |= 1u << k;
+            }
+        }
+        return occluded | flushOccluded(batch, p, nullptr);
+    }
+
+private:
+    const AcceleratorDevice& device;
+    int batch_jobs;
+    
+    // Pending jobs with the slot and packet lane each one answers for and
+    // how far along the ray its origin was moved
+    struct Batch {
+        std::vector<AcceleratorJob> jobs;
+        std::vector<AcceleratorResult> results;
+        std::vector<int> slot, lane;
+        std::vector<Real> offset;
+        
+        void clear() {
+            jobs.clear();
+            slot.clear();
+            lane.clear();
+            offset.clear();
+        }
+        
+        // Job i's hit distance along the original ray
+        Real t(size_t i) const { return offset[i] + Real(results[i].t * (1.0 / 65536.0)); }
+    };
+    
+    static Batch& threadBatch() {
+        static thread_local Batch batch;
+        return batch;
+    }
+    
+    // Q16.16 with rounding; false if v doesn't fit
+    static bool toFixed(Real v, int32_t& out) {
+        double scaled = std::round(double(v) * 65536.0);
+        if (!(std::fabs(scaled) < 2147483647.0)) return false;
+        out = int32_t(scaled);
+        return true;
+    }
+    
+    // Queues slot s against one ray; false if the hardware can't take it
+    static bool submit(Batch& batch, const SphereSoA& soa, int s, const Vec3& origin, const Vec3& direction, int lane) {
+        Real r2 = soa.r2[s];
+        AcceleratorJob j;
+        if (hitEpsilon(r2) > Real(0.001)) return false;
+        Real offset = std::max(Real(0), (soa.center(s) - origin).dot(direction) - 2 * std::sqrt(r2));
+        Vec3 start = origin + direction * offset;
+        if (!toFixed(start.x, j.ox) || !toFixed(start.y, j.oy) || !toFixed(start.z, j.oz) ||
+            !toFixed(soa.cx[s], j.cx) || !toFixed(soa.cy[s], j.cy) || !toFixed(soa.cz[s], j.cz) || !toFixed(r2, j.r2)) {
+            return false;
+        }
+        toFixed(direction.x, j.dx);
+        toFixed(direction.y, j.dy);
+        toFixed(direction.z, j.dz);
+        batch.jobs.push_back(j);
+        batch.slot.push_back(s);
+        batch.lane.push_back(lane);
+        batch.offset.push_back(offset);
+        return true;
+    }
+    
+    static void cpuClosest(const SphereSoA& soa, int s, const Vec3& origin, const Vec3& direction, Real& closest_t, int& hit_slot) {
+        threadCounters().accel_cpu++;
+        Real t;
+        if (sphereRootScalar(soa, s, origin, direction, t) && t < closest_t) {
+            closest_t = t;
+            hit_slot = s;
+        }
+    }
+    
+    // Runs the pending jobs; the results are in batch.results
+    void dispatch(Batch& batch) const {
+        RayCounters& counters = threadCounters();
+        counters.sphere_tests += batch.jobs.size();
+        counters.accel_jobs += batch.jobs.size();
+        counters.accel_batches++;
+        device.run(batch.jobs, batch.results);
+    }
+    
+    void flushClosest(Batch& batch, Real& closest_t, int& hit_slot) const {
+        if (batch.jobs.empty()) return;
+        dispatch(batch);
+        for (size_t i = 0; i < batch.jobs.size(); i++) {
+            Real t = batch.t(i);
+            if (batch.results[i].hit && t < closest_t) {
+                closest_t = t;
+                hit_slot = batch.slot[i];
+            }
+        }
+        batch.clear();
+    }
+    
+    int flushAny(Batch& batch, Real max_distance) const {
+        if (batch.jobs.empty()) return -1;
+        dispatch(batch);
+        int slot = -1;
+        for (size_t i = 0; i < batch.jobs.size() && slot < 0; i++) {
+            if (batch.results[i].hit && batch.t(i) < max_distance) slot = batch.slot[i];
+        }
+        batch.clear();
+        return slot;
+    }
+    
+    void flushPacket(Batch& batch, RayPacket& p) const {
+        if (batch.jobs.empty()) return;
+        dispatch(batch);
+        for (size_t i = 0; i < batch.jobs.size(); i++) {
+            int k = batch.lane[i];
+            Real t = batch.t(i);
+            if (batch.results[i].hit && t < p.t[k]) {
+                p.t[k] = t;
+                p.hit[k] = batch.slot[i];
+            }
+        }
+        batch.clear();
+    }
+    
+    unsigned flushOccluded(Batch& batch, const RayPacket& p, int* occluder) const {
+        if (batch.jobs.empty()) return 0;
+        dispatch(batch);
+        unsigned occluded = 0;
+        for (size_t i = 0; i < batch.jobs.size(); i++) {
+            int k = batch.lane[i];
+            if (batch.results[i].hit && batch.t(i) < p.t[k]) {
+                occluded |= 1u << k;
+                if (occluder) *occluder = batch.slot[i];
+            }
+        }
+        batch.clear();
+        return occluded;
+    }
+};
+
+// The built-in backends, by the names --backend takes
+inline const IntersectBackend& scalarBackend() {
+    static const KernelBackend<ScalarKernels> backend("scalar");
+    return backend;
+}
+
+inline const IntersectBackend& simdBackend() {
+    static const KernelBackend<SimdKernels> backend("simd");
+    return backend;
+}
+
+inline const IntersectBackend& acceleratorBackend() {
+    static const FixedPointModel model;
+    static const AcceleratorBackend backend(model);
+    return backend;
+}
+
+// nullptr for an unknown name
+inline const IntersectBackend* findBackend(const std::string& name) {
+    if (name == "scalar") return &scalarBackend();
+    if (name == "simd") return &simdBackend();
+    if (name == "accel") return &acceleratorBackend();
+    return nullptr;
+}
@@ -0,0 +1,100 @@
+// Pipelined integer square root: out_root = floor(sqrt(in_value)), one result
+// per cycle. Digit-by-digit (restoring) method: each step brings down the next
+// two operand bits and decides one root bit, STEPS_PER_STAGE steps per
+// pipeline stage, so LATENCY = ceil(IN_WIDTH / 2 / STEPS_PER_STAGE) cycles.
+// Fewer steps per stage shorten the critical path at the cost of latency;
+// throughput is one root per cycle either way. A payload rides along with
+// each operand so callers don't need their own delay line
+module isqrt_pipe #(
+    parameter int IN_WIDTH = 68,            // even
+    parameter int STEPS_PER_STAGE = 2,
+    parameter int PAYLOAD_WIDTH = 1
+) (
+    input  logic clk,
+    input  logic rst_n,
+    input  logic en,                        // advance every stage this cycle
+    
+    input  logic [IN_WIDTH-1:0] in_value,
+    input  logic [PAYLOAD_WIDTH-1:0] in_payload,
+    
+    output logic [IN_WIDTH/2-1:0] out_root,
+    output logic [PAYLOAD_WIDTH-1:0] out_payload
+);
+    
+    localparam int ROOT_WIDTH = IN_WIDTH / 2;
+    localparam int STAGES = (ROOT_WIDTH + STEPS_PER_STAGE - 1) / STEPS_PER_STAGE;
+    localparam int DIGITS = STAGES * STEPS_PER_STAGE;   // root bits incl. leading zeros
+    localparam int VW = 2 * DIGITS;                     // operand, zero-extended
+    localparam int RW = ROOT_WIDTH + 3;                 // remainder, before the subtract
+    
+    // The last stage's operand and remainder registers feed nothing
+    /* verilator lint_off UNUSED */
+    genvar s;
+    generate
+        for (s = 0; s < STAGES; s++) begin : stage
+            // This stage's registers
+            logic [VW-1:0] value_q;             // operand bits not brought down yet, MSB first
+            logic [ROOT_WIDTH-1:0] root_q;
+            logic [RW-1:0] rem_q;
+            logic [PAYLOAD_WIDTH-1:0] payload_q;
+            
+            // What it takes in: the module inputs, or the previous stage
+            logic [VW-1:0] value_d;
+            logic [ROOT_WIDTH-1:0] root_d;
+            logic [RW-1:0] rem_d;
+            logic [PAYLOAD_WIDTH-1:0] payload_d;
+            if (s == 0) begin : first
+                assign value_d = VW'(in_value);
+                assign root_d = '0;
+                assign rem_d = '0;
+                assign payload_d = in_payload;
+            end else begin : chained
+                assign value_d = stage[s-1].value_q;
+                assign root_d = stage[s-1].root_q;
+                assign rem_d = stage[s-1].rem_q;
+                assign payload_d = stage[s-1].payload_q;
+            end
+            
+            logic [VW-1:0] v;
+            logic [ROOT_WIDTH-1:0] q;
+            logic [RW-1:0] r;
+            logic [RW-1:0] trial;
+            always_comb begin
+                v = value_d;
+                q = root_d;
+                r = rem_d;
+                trial = '0;
+                for (int k = 0; k < STEPS_PER_STAGE; k++) begin
+                    r = {r[RW-3:0], v[VW-1:VW-2]};
+                    v = {v[VW-3:0], 2'b00};
+                    trial = {1'b0, q, 2'b01};
+                    if (r >= trial) begin
+                        r = r - trial;
+                        q = {q[ROOT_WIDTH-2:0], 1'b1};
+                    end else begin
+                        q = {q[ROOT_WIDTH-2:0], 1'b0};
+                    end
+                end
+            end
+            
+            always_ff @(posedge clk or negedge rst_n) begin
+                if (!rst_n) begin
+                    value_q <= '0;
+                    root_q <= '0;
+                    rem_q <= '0;
+                    payload_q <= '0;
+                end else if (en) begin
+                    value_q <= v;
+                    root_q <= q;
+                    rem_q <= r;
+                    payload_q <= payload_d;
+                end
+            end
+        end
+    endgenerate
+    /* verilator lint_on UNUSED */
+    
+    assign out_root = stage[STAGES-1].root_q;
+    assign out_payload = stage[STAGES-1].payload_q;
+
+endmodule
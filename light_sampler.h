@@ -0,0 +1,66 @@
+// Alias table for drawing lights in proportion to their power
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "geometry.h"
+
+// Walker/Vose alias table: O(n) to build, O(1) per draw. Each of the n
+// columns holds its own index with probability prob[i] and 'alias[i]'
+// otherwise, so one uniform number picks a column and then one of its two
+class AliasTable {
+public:
+    bool empty() const { return pmf.empty(); }
+    size_t size() const { return pmf.size(); }
+    
+    // Non-negative weights; if they sum to zero every entry is equally likely
+    void build(const std::vector<double>& weights) {
+        size_t n = weights.size();
+        prob.assign(n, 1);
+        alias.resize(n);
+        pmf.resize(n);
+        
+        double total = 0;
+        for (double w : weights) total += std::max(0.0, w);
+        std::vector<double> scaled(n);
+        for (size_t i = 0; i < n; i++) {
+            double p = total > 0 ? std::max(0.0, weights[i]) / total : 1.0 / n;
+            pmf[i] = Real(p);
+            scaled[i] = p * n;
+            alias[i] = int(i);
+        }
+        
+        std::vector<int> small, large;
+        for (size_t i = 0; i < n; i++) (scaled[i] < 1 ? small : large).push_back(int(i));
+        while (!small.empty() && !large.empty()) {
+            int s = small.back(); small.pop_back();
+            int l = large.back();
+            prob[s] = Real(scaled[s]);
+            alias[s] = l;
+            scaled[l] -= 1 - scaled[s];
+            if (scaled[l] < 1) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // Whatever is left is 1 up to rounding
+        for (int i : small) prob[i] = 1;
+        for (int i : large) prob[i] = 1;
+    }
+    
+    // Maps u in [0, 1) to an entry; 'pdf' receives that entry's probability
+    int sample(Real u, Real& pdf) const {
+        int n = int(pmf.size());
+        Real x = u * n;
+        int column = std::min(int(x), n - 1);
+        int pick = x - column < prob[column] ? column : alias[column];
+        pdf = pmf[pick];
+        return pick;
+    }
+
+private:
+    std::vector<Real> prob;     // chance column i keeps its own entry
+    std::vector<int> alias;
+    std::vector<Real> pmf;      // normalized weights
+};
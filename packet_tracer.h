@@ -0,0 +1,217 @@
+// Packet/stream tracer: shades 8-ray packets and regroups reflections
+#pragma once
+
+#include <vector>
+
+#include "scene.h"
+
+// A ray queued in a stream, with the pixel its radiance lands in and the
+// weight it carries (product of the reflectivities along its path)
+struct StreamRay {
+    Vec3 origin, direction;
+    Real weight;
+    int pixel;
+    int depth;
+    uint32_t seed;      // the path's image pixel, for TraceSettings::bounce()
+};
+
+// Stream tracer: packs rays into RayPackets, shades all lanes of a packet
+// together and regroups the reflection rays into the next bounce's stream.
+// Shades like Scene::trace(): each surface adds its shading with the local
+// weight from TraceSettings::bounce() and hands the reflected weight to its
+// reflection ray. The vector hit tests can round a hit slightly differently,
+// so a few pixels may come out one level apart; make golden pins how many
+class PacketTracer {
+public:
+    PacketTracer(const Scene& s, const TraceSettings& t = TraceSettings())
+        : scene(s), settings(t), hits(nullptr), records(nullptr), primary(nullptr), primary_known(false) {}
+    
+    // Traces the stream to completion, accumulating radiance into out[pixel].
+    // 'first_hit', if given, receives each depth-0 ray's hit slot by pixel (-1: miss);
+    // 'paths', if given, holds the PathBounds each pixel's paths are recorded in.
+    // 'first', if given, receives each depth-0 ray's whole first hit by pixel
+    // or, with 'known', already holds it and the primary intersection is skipped
+    void trace(std::vector<StreamRay>& stream, Color* out, int* first_hit = nullptr,
+               PathBounds* const* paths = nullptr, PrimaryHit* first = nullptr, bool known = false) {
+        hits = first_hit;
+        records = paths;
+        primary = first;
+        primary_known = first && known;
+        while (!stream.empty()) {
+            next.clear();
+            for (size_t i = 0; i < stream.size(); i += PACKET_SIZE) {
+                shadePacket(&stream[i], int(std::min<size_t>(PACKET_SIZE, stream.size() - i)), out);
+            }
+            regroup(next, stream);
+        }
+    }
+
+private:
+    const Scene& scene;
+    TraceSettings settings;
+    std::vector<StreamRay> next;
+    std::vector<StreamRay> sorted;
+    int* hits;
+    PathBounds* const* records;
+    PrimaryHit* primary;
+    bool primary_known;
+    
+    // Bucket secondary rays by direction octant so packets stay coherent
+    void regroup(const std::vector<StreamRay>& in, std::vector<StreamRay>& out) {
+        PROFILE_STAGE(STAGE_SHADE);
+        size_t offsets[9] = {0};
+        for (const StreamRay& r : in) offsets[octant(r.direction) + 1]++;
+        for (int o = 1; o < 9; o++) offsets[o] += offsets[o - 1];
+        out.resize(in.size());
+        for (const StreamRay& r : in) out[offsets[octant(r.direction)]++] = r;
+    }
+    
+    static int octant(const Vec3& d) {
+        return (d.x < 0 ? 1 : 0) | (d.y < 0 ? 2 : 0) | (d.z < 0 ? 4 : 0);
+    }
+    
+    void shadePacket(const StreamRay* rays, int count, Color* out) {
+        PROFILE_STAGE(STAGE_SHADE);
+        RayPacket p;
+        for (int k = 0; k < count; k++) {
+            p.set(k, Ray(rays[k].origin, rays[k].direction, Ray::Normalized()), std::numeric_limits<Real>::max());
+        }
+        p.padFrom(count);
+        p.active = (1u << count) - 1;
+        
+        // A stream holds rays of a single depth
+        RayCounters& counters = threadCounters();
+        bool cached = rays[0].depth == 0 && primary_known;
+        if (cached) {
+            for (int k = 0; k < count; k++) {
+                p.t[k] = primary[rays[k].pixel].t;
+                p.hit[k] = primary[rays[k].pixel].slot;
+            }
+            counters.primary_cached += count;
+        } else {
+            scene.intersectPacket(p);
+            if (rays[0].depth == 0) counters.primary += count;
+            else counters.reflection += count;
+        }
+        if (rays[0].depth == 0 && hits) {
+            for (int k = 0; k < count; k++) hits[rays[k].pixel] = p.hit[k];
+        }
+        
+        if (rays[0].depth == 0 && primary && !cached) {
+            for (int k = 0; k < count; k++) {
+                PrimaryHit& h = primary[rays[k].pixel];
+                h.slot = p.hit[k];
+                h.t = p.t[k];
+                if (h.slot >= 0) h.normal = (p.at(k) - scene.soa.center(h.slot)).normalize();
+            }
+        }
+        
+        // Misses terminate here
+        Vec3 hit_point[PACKET_SIZE], normal[PACKET_SIZE], view_dir[PACKET_SIZE];
+        Real n_dot_v[PACKET_SIZE];
+        Color color[PACKET_SIZE];
+        const Material* material[PACKET_SIZE];
+        const SpecularExponent* exponent[PACKET_SIZE];
+        unsigned alive = 0;
+        for (int k = 0; k < count; k++) {
+            if (p.hit[k] < 0) {
+                out[rays[k].pixel] = out[rays[k].pixel] + scene.background * rays[k].weight;
+                continue;
+            }
+            alive |= 1u << k;
+            material[k] = &scene.materials[scene.soa.material[p.hit[k]]];
+            exponent[k] = &scene.exponents[scene.soa.material[p.hit[k]]];
+            hit_point[k] = p.at(k);
+            normal[k] = cached ? primary[rays[k].pixel].normal : (hit_point[k] - scene.soa.center(p.hit[k])).normalize();
+            view_dir[k] = (p.origin(k) - hit_point[k]).normalize();
+            n_dot_v[k] = normal[k].dot(view_dir[k]);
+            color[k] = material[k]->color * material[k]->ambient;
+            if (records) records[rays[k].pixel]->addPoint(hit_point[k]);
+        }
+        if (!alive) return;
+        
+        // One shadow packet per light, covering the surviving lanes the light
+        // isn't culled for (same tests as Scene::trace). When sampling, pass s
+        // is each lane's own s-th draw instead, so lanes may target different lights
+        int* last_occluder = scene.shadowCache();
+        bool sampled = settings.samplesLights(scene.lights.size());
+        int passes = sampled ? settings.light_samples : int(scene.lights.size());
+        for (int s = 0; s < passes; s++) {
+            RayPacket shadow;
+            Real light_diff[PACKET_SIZE];
+            Real scale[PACKET_SIZE];
+            int lane_light[PACKET_SIZE];
+            unsigned cast = 0;
+            for (int k = 0; k < count; k++) {
+                if (!((alive >> k) & 1)) continue;
+                lane_light[k] = s;
+                scale[k] = 1;
+                if (sampled) {
+                    Real pdf;
+                    lane_light[k] = scene.light_sampler.sample(settings.lightSample(rays[k].seed, rays[k].depth, s, passes), pdf);
+                    if (pdf <= 0) continue;
+                    scale[k] = 1 / (passes * pdf);
+                }
+                const Light& light = scene.lights[lane_light[k]];
+                Vec3 light_dir;
+                Real light_distance;
+                towardsLight(hit_point[k], light.position, settings.fast_shading, light_dir, light_distance);
+                shadow.set(k, settings.fast_shading ? Ray(hit_point[k], light_dir, Ray::Normalized()) : Ray(hit_point[k], light_dir),
+                           light_distance);
+                
+                Real diff = normal[k].dot(light_dir);
+                if (diff <= 0 || settings.cullsLight(*material[k], diff, light, rays[k].weight * scale[k])) {
+                    counters.lights_culled++;
+                    continue;
+                }
+                light_diff[k] = diff;
+                cast |= 1u << k;
+            }
+            if (!cast) continue;
+            
+            // Lanes without a shadow ray repeat the first one that has one
+            int lead = __builtin_ctz(cast);
+            for (int k = 0; k < PACKET_SIZE; k++) {
+                if (!((cast >> k) & 1)) {
+                    shadow.set(k, Ray(shadow.origin(lead), shadow.direction(lead), Ray::Normalized()), shadow.t[lead]);
+                }
+            }
+            shadow.active = cast;
+            counters.shadow += __builtin_popcount(cast);
+            unsigned lit = cast & ~scene.occludedPacketCached(shadow, last_occluder[lane_light[lead]]);
+            
+            while (lit) {
+                int k = __builtin_ctz(lit);
+                lit &= lit - 1;
+                const Light& light = scene.lights[lane_light[k]];
+                const Material& m = *material[k];
+                Color diffuse = m.color * m.diffuse * light_diff[k] * light.intensity;
+                Real spec = specularTerm(view_dir[k], normal[k], shadow.direction(k), light_diff[k], n_dot_v[k], m,
+                                         *exponent[k], settings.fast_shading);
+                Color specular = light.color * m.specular * spec * light.intensity;
+                color[k] = color[k] + (diffuse + specular) * scale[k];
+            }
+        }
+        
+        // Reflecting lanes split their weight and continue in the next stream
+        while (alive) {
+            int k = __builtin_ctz(alive);
+            alive &= alive - 1;
+            const StreamRay& r = rays[k];
+            Vec3 reflect_dir = (view_dir[k] * -1).reflect(normal[k]);
+            Bounce b = settings.bounce(r.weight, material[k]->reflectivity, r.depth, r.seed);
+            out[r.pixel] = out[r.pixel] + color[k] * b.local;
+            if (b.reflected > 0) {
+                StreamRay bounce;
+                bounce.origin = hit_point[k];
+                bounce.direction = reflect_dir.normalize();
+                bounce.weight = b.reflected;
+                bounce.pixel = r.pixel;
+                bounce.depth = r.depth + 1;
+                bounce.seed = r.seed;
+                next.push_back(bounce);
+                if (records) records[r.pixel]->addReflection(bounce.origin, bounce.direction);
+            }
+        }
+    }
+};
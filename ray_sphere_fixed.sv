@@ -0,0 +1,177 @@
+// Synthesizable streaming ray-sphere intersection in fixed point. Same
+// valid/ready handshake and job IDs as ray_sphere_stream, with operands in
+// Q(WIDTH-FRAC).FRAC. Like Sphere::intersect it assumes a unit direction, so
+// a = 1 and the b/2 form needs no divider and no 4ac:
+//     b' = oc.d    c = oc.oc - r2    t = -b' -/+ sqrt(b'^2 - c)
+// One job in and one result out per cycle; a result leaves LATENCY cycles
+// after its job was taken (3 stages, the square root, the output register).
+// b' and the root keep GUARD extra fraction bits, because b'^2 - c cancels
+// for rays that graze a sphere: on the stream testbench's random jobs the C++
+// model of this datapath (FixedPointModel) is off by at most 4e-4 in t at
+// GUARD = 1 and 8e-6 at 8. Requires 0 < GUARD < FRAC
+module ray_sphere_fixed #(
+    parameter int WIDTH = 32,
+    parameter int FRAC = 16,
+    parameter int GUARD = 8,
+    parameter int ID_WIDTH = 16,
+    parameter int SQRT_STEPS_PER_STAGE = 2  // root bits per isqrt stage: clock rate vs latency
+) (
+    input  logic clk,
+    input  logic rst_n,
+    
+    // Jobs: taken on a cycle where in_valid && in_ready
+    input  logic in_valid,
+    output logic in_ready,
+    input  logic [ID_WIDTH-1:0] in_id,
+    input  logic signed [WIDTH-1:0] ray_ox, ray_oy, ray_oz,
+    input  logic signed [WIDTH-1:0] ray_dx, ray_dy, ray_dz,     // unit length
+    input  logic signed [WIDTH-1:0] sphere_cx, sphere_cy, sphere_cz,
+    input  logic signed [WIDTH-1:0] sphere_r2,
+    
+    // Results: delivered on a cycle where out_valid && out_ready
+    output logic out_valid,
+    input  logic out_ready,
+    output logic [ID_WIDTH-1:0] out_id,
+    output logic hit,
+    output logic signed [WIDTH-1:0] t_out
+);
+    
+    // oc is one bit wider than the operands. Products of two oc/d terms and
+    // sums of three take PW bits, in Q.2FRAC
+    localparam int OW = WIDTH + 1;
+    localparam int PW = 2 * OW + 2;
+    // b' in Q.(FRAC+GUARD): |b'| <= |oc| for a unit direction. The
+    // discriminant is in Q.2(FRAC+GUARD), so its root comes out like b'
+    localparam int BW = WIDTH + 2 + GUARD;
+    localparam int DW = 2 * BW;
+    localparam int TW = BW + 2;
+    localparam int SQRT_STAGES = (DW / 2 + SQRT_STEPS_PER_STAGE - 1) / SQRT_STEPS_PER_STAGE;
+    /* verilator lint_off UNUSED */
+    localparam int LATENCY = 3 + SQRT_STAGES + 1;   // for reference; testbenches measure it
+    /* verilator lint_on UNUSED */
+    localparam int EPS = (1 << FRAC) / 1000;    // t > 0.001, as in the software tracer
+    localparam int PAYLOAD = 1 + ID_WIDTH + 1 + BW;
+    
+    // The stages move in lockstep; the pipeline only stalls while a result
+    // waits on the output and nobody takes it
+    logic advance;
+    assign advance = !out_valid || out_ready;
+    assign in_ready = advance;
+    
+    // Stage 1: oc = o - c
+    logic s1_valid;
+    logic [ID_WIDTH-1:0] s1_id;
+    logic signed [OW-1:0] s1_ocx, s1_ocy, s1_ocz;
+    logic signed [WIDTH-1:0] s1_dx, s1_dy, s1_dz, s1_r2;
+    
+    // Stage 2: the six products, in Q.2FRAC
+    logic s2_valid;
+    logic [ID_WIDTH-1:0] s2_id;
+    logic signed [PW-1:0] s2_bx, s2_by, s2_bz;     // oc_i * d_i
+    logic signed [PW-1:0] s2_cx, s2_cy, s2_cz;     // oc_i * oc_i
+    logic signed [PW-1:0] s2_r2;
+    
+    // Stage 3: b' (rounded to Q.(FRAC+GUARD)) and c (Q.2FRAC)
+    logic s3_valid;
+    logic [ID_WIDTH-1:0] s3_id;
+    logic signed [BW-1:0] s3_b;
+    logic signed [PW-1:0] s3_c;
+    
+    logic signed [PW-1:0] b_sum;
+    assign b_sum = s2_bx + s2_by + s2_bz + PW'(1 << (FRAC - GUARD - 1));
+    
+    always_ff @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            s1_valid <= 0;
+            s2_valid <= 0;
+            s3_valid <= 0;
+        end else if (advance) begin
+            s1_valid <= in_valid;
+            s1_id <= in_id;
+            s1_ocx <= OW'(ray_ox) - OW'(sphere_cx);
+            s1_ocy <= OW'(ray_oy) - OW'(sphere_cy);
+            s1_ocz <= OW'(ray_oz) - OW'(sphere_cz);
+            s1_dx <= ray_dx;
+            s1_dy <= ray_dy;
+            s1_dz <= ray_dz;
+            s1_r2 <= sphere_r2;
+            
+            s2_valid <= s1_valid;
+            s2_id <= s1_id;
+            s2_bx <= PW'(s1_ocx) * PW'(s1_dx);
+            s2_by <= PW'(s1_ocy) * PW'(s1_dy);
+            s2_bz <= PW'(s1_ocz) * PW'(s1_dz);
+            s2_cx <= PW'(s1_ocx) * PW'(s1_ocx);
+            s2_cy <= PW'(s1_ocy) * PW'(s1_ocy);
+            s2_cz <= PW'(s1_ocz) * PW'(s1_ocz);
+            s2_r2 <= PW'(s1_r2) <<< FRAC;
+            
+            s3_valid <= s2_valid;
+            s3_id <= s2_id;
+            s3_b <= BW'(b_sum >>> (FRAC - GUARD));
+            s3_c <= s2_cx + s2_cy + s2_cz - s2_r2;
+        end
+    end
+    
+    // Discriminant b'^2 - c in Q.2(FRAC+GUARD), whose integer square root is
+    // sqrt(b'^2 - c) in Q.(FRAC+GUARD). Negative means a miss; the root of 0 is taken
+    logic signed [DW-1:0] disc;
+    assign disc = DW'(s3_b) * DW'(s3_b) - (DW'(s3_c) <<< (2 * GUARD));
+    
+    logic [DW/2-1:0] root;
+    logic [PAYLOAD-1:0] sq_payload;
+    isqrt_pipe #(
+        .IN_WIDTH(DW),
+        .STEPS_PER_STAGE(SQRT_STEPS_PER_STAGE),
+        .PAYLOAD_WIDTH(PAYLOAD)
+    ) sqrt_unit (
+        .clk(clk),
+        .rst_n(rst_n),
+        .en(advance),
+        .in_value(disc[DW-1] ? '0 : disc),
+        .in_payload({s3_valid, s3_id, disc[DW-1], s3_b}),
+        .out_root(root),
+        .out_payload(sq_payload)
+    );
+    
+    logic sq_valid, sq_miss;
+    logic [ID_WIDTH-1:0] sq_id;
+    logic signed [BW-1:0] sq_b;
+    assign {sq_valid, sq_id, sq_miss, sq_b} = sq_payload;
+    
+    // Both roots; the near one unless it is behind the origin (ray inside)
+    logic signed [TW-1:0] t1, t2;
+    assign t1 = -TW'(sq_b) - TW'({2'b00, root});
+    assign t2 = -TW'(sq_b) + TW'({2'b00, root});
+    
+    // Rounds t to Q.FRAC; hits further away than t_out can hold report the largest value
+    localparam logic signed [TW-1:0] T_MAX = TW'({1'b0, {(WIDTH-1){1'b1}}});
+    function automatic logic signed [WIDTH-1:0] to_output(input logic signed [TW-1:0] t);
+        logic signed [TW-1:0] rounded;
+        rounded = (t + TW'(1 << (GUARD - 1))) >>> GUARD;
+        return (rounded > T_MAX) ? WIDTH'(T_MAX) : WIDTH'(rounded);
+    endfunction
+    
+    always_ff @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            out_valid <= 0;
+            out_id <= '0;
+            hit <= 0;
+            t_out <= '0;
+        end else if (advance) begin
+            out_valid <= sq_valid;
+            out_id <= sq_id;
+            if (!sq_miss && t1 > (TW'(EPS) <<< GUARD)) begin
+                hit <= 1;
+                t_out <= to_output(t1);
+            end else if (!sq_miss && t2 > (TW'(EPS) <<< GUARD)) begin
+                hit <= 1;
+                t_out <= to_output(t2);
+            end else begin
+                hit <= 0;
+                t_out <= '0;
+            end
+        end
+    end
+
+endmodule
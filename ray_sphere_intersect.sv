@@ -1,3 +1,7 @@
+// Single-job interface to ray_sphere_fixed: pulse start with the operands
+// applied, wait for done. Q16.16 operands; the direction must be unit length
+// (the testbench normalizes it). done drops on start and rises once the
+// result has come through the pipeline, LATENCY cycles later
 module ray_sphere_intersect (
     input  logic clk,
     input  logic rst_n,
@@ -12,62 +16,49 @@ module ray_sphere_intersect (
     output logic hit,
     output logic signed [31:0] t_out
 );
-
-    logic [3:0] cycle;
     
-    // Use doubles for now - just get it working
-    real rox, roy, roz, rdx, rdy, rdz;
-    real scx, scy, scz, sr2;
-    real ocx, ocy, ocz;
-    real a, b, c, disc, t;
+    logic result_valid, result_hit;
+    logic signed [31:0] result_t;
+    
+    // Always ready for the result and only one job in flight, so the handshake
+    // signals and job ID go unused
+    /* verilator lint_off UNUSED */
+    logic job_ready;
+    logic result_id;
+    /* verilator lint_on UNUSED */
+    
+    ray_sphere_fixed #(
+        .WIDTH(32),
+        .FRAC(16),
+        .ID_WIDTH(1)
+    ) datapath (
+        .clk(clk),
+        .rst_n(rst_n),
+        .in_valid(start),
+        .in_ready(job_ready),
+        .in_id(1'b0),
+        .ray_ox(ray_ox), .ray_oy(ray_oy), .ray_oz(ray_oz),
+        .ray_dx(ray_dx), .ray_dy(ray_dy), .ray_dz(ray_dz),
+        .sphere_cx(sphere_cx), .sphere_cy(sphere_cy), .sphere_cz(sphere_cz),
+        .sphere_r2(sphere_r2),
+        .out_valid(result_valid),
+        .out_ready(1'b1),
+        .out_id(result_id),
+        .hit(result_hit),
+        .t_out(result_t)
+    );
     
     always_ff @(posedge clk or negedge rst_n) begin
         if (!rst_n) begin
             done <= 0;
             hit <= 0;
-            cycle <= 0;
+            t_out <= 0;
         end else if (start) begin
-            cycle <= 1;
             done <= 0;
-            
-            // Convert to real
-            rox = $itor(ray_ox) / 65536.0;
-            roy = $itor(ray_oy) / 65536.0;
-            roz = $itor(ray_oz) / 65536.0;
-            rdx = $itor(ray_dx) / 65536.0;
-            rdy = $itor(ray_dy) / 65536.0;
-            rdz = $itor(ray_dz) / 65536.0;
-            scx = $itor(sphere_cx) / 65536.0;
-            scy = $itor(sphere_cy) / 65536.0;
-            scz = $itor(sphere_cz) / 65536.0;
-            sr2 = $itor(sphere_r2) / 65536.0;
-            
-        end else if (cycle == 1) begin
-            // Compute
-            ocx = rox - scx;
-            ocy = roy - scy;
-            ocz = roz - scz;
-            
-            a = rdx*rdx + rdy*rdy + rdz*rdz;
-            b = 2.0 * (ocx*rdx + ocy*rdy + ocz*rdz);
-            c = ocx*ocx + ocy*ocy + ocz*ocz - sr2;
-            
-            disc = b*b - 4.0*a*c;
-            
-            if (disc >= 0.0 && a != 0.0) begin
-                t = (-b - $sqrt(disc)) / (2.0 * a);
-                if (t > 0.001) begin
-                    hit <= 1;
-                    t_out <= $rtoi(t * 65536.0);
-                end else begin
-                    hit <= 0;
-                end
-            end else begin
-                hit <= 0;
-            end
-            
+        end else if (result_valid) begin
             done <= 1;
-            cycle <= 0;
+            hit <= result_hit;
+            t_out <= result_t;
         end
     end
 
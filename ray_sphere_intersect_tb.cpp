@@ -6,6 +6,10 @@
 #include <iostream>
 #include <cmath>
 #include <cstdint>
+#include <random>
+#include <vector>
+
+#include "intersect_backend.h"  // FixedPointModel, the reference for the wrapped ray_sphere_fixed
 
 // Q16.16 fixed-point conversion utilities
 const int FRAC_BITS = 16;
@@ -56,33 +60,63 @@ public:
     }
     
     // Main intersection test function
-    // Returns true if hit, and sets t to the intersection distance
+    // Returns true if hit, and sets t to the intersection distance (in units
+    // of the direction given; the hardware wants it unit length, so it gets
+    // the normalized direction and its t is scaled back)
     bool intersect(double ray_ox, double ray_oy, double ray_oz,
                    double ray_dx, double ray_dy, double ray_dz,
                    double sphere_cx, double sphere_cy, double sphere_cz,
                    double sphere_radius,
                    double& t) {
         
-        // Convert inputs to fixed-point
-        dut->ray_ox = double_to_fixed(ray_ox);
-        dut->ray_oy = double_to_fixed(ray_oy);
-        dut->ray_oz = double_to_fixed(ray_oz);
+        double length = sqrt(ray_dx*ray_dx + ray_dy*ray_dy + ray_dz*ray_dz);
+        if (length == 0) return false;
+        
+        AcceleratorResult r;
+        if (!intersect(fixed_job(ray_ox, ray_oy, ray_oz, ray_dx, ray_dy, ray_dz, sphere_cx, sphere_cy, sphere_cz,
+                                 sphere_radius), r)) {
+            return false;
+        }
+        if (r.hit) t = fixed_to_double(r.t) / length;
+        return r.hit;
+    }
+    
+    // The Q16.16 job intersect() drives: direction normalized, radius
+    // squared before rounding
+    static AcceleratorJob fixed_job(double ray_ox, double ray_oy, double ray_oz,
+                                    double ray_dx, double ray_dy, double ray_dz,
+                                    double sphere_cx, double sphere_cy, double sphere_cz,
+                                    double sphere_radius) {
+        double length = sqrt(ray_dx*ray_dx + ray_dy*ray_dy + ray_dz*ray_dz);
+        AcceleratorJob j = {double_to_fixed(ray_ox), double_to_fixed(ray_oy), double_to_fixed(ray_oz),
+                            double_to_fixed(ray_dx / length), double_to_fixed(ray_dy / length),
+                            double_to_fixed(ray_dz / length),
+                            double_to_fixed(sphere_cx), double_to_fixed(sphere_cy), double_to_fixed(sphere_cz),
+                            double_to_fixed(sphere_radius * sphere_radius)};
+        return j;
+    }
+    
+    // Runs one job as given; false on timeout
+    bool intersect(const AcceleratorJob& job, AcceleratorResult& result) {
+        dut->ray_ox = job.ox;
+        dut->ray_oy = job.oy;
+        dut->ray_oz = job.oz;
         
-        dut->ray_dx = double_to_fixed(ray_dx);
-        dut->ray_dy = double_to_fixed(ray_dy);
-        dut->ray_dz = double_to_fixed(ray_dz);
+        dut->ray_dx = job.dx;
+        dut->ray_dy = job.dy;
+        dut->ray_dz = job.dz;
         
-        dut->sphere_cx = double_to_fixed(sphere_cx);
-        dut->sphere_cy = double_to_fixed(sphere_cy);
-        dut->sphere_cz = double_to_fixed(sphere_cz);
-        dut->sphere_r2 = double_to_fixed(sphere_radius * sphere_radius);
+        dut->sphere_cx = job.cx;
+        dut->sphere_cy = job.cy;
+        dut->sphere_cz = job.cz;
+        dut->sphere_r2 = job.r2;
         
         // Assert start signal
         dut->start = 1;
         tick();
         dut->start = 0;
         
-        // Wait for done signal (with timeout)
+        // Wait for done signal (with timeout; the pipeline takes ~25 cycles)
         int timeout = 100;
         while (!dut->done && timeout > 0) {
             tick();
@@ -95,12 +129,9 @@ public:
         }
         
         // Read results
-        bool hit = dut->hit;
-        if (hit) {
-            t = fixed_to_double(dut->t_out);
-        }
-        
-        return hit;
+        result.hit = dut->hit;
+        result.t = result.hit ? int32_t(dut->t_out) : 0;
+        return true;
     }
 };
 
@@ -183,35 +214,17 @@ void test_inside_sphere() {
     }
 }
 
-void compare_with_software() {
-    std::cout << "\nTest 5: Accuracy Comparison" << std::endl;
+// The wrapper against FixedPointModel::evaluate, the model the renderer's
+// accel backend uses, on the very operands the wrapper was driven with:
+// every hit flag must match and t_out may differ by at most
+// T_TOLERANCE_LSB. The model is written to be bit-exact, so that is 0
+const int32_t T_TOLERANCE_LSB = 0;
+
+bool compare_with_model() {
+    std::cout << "\nTest 5: Accuracy Comparison (FixedPointModel, t within " << T_TOLERANCE_LSB << " LSB)"
+              << std::endl;
     RaySphereAccelerator accel;
     
-    // Software implementation (from the raytracer)
-    auto software_intersect = [](double ox, double oy, double oz,
-                                  double dx, double dy, double dz,
-                                  double cx, double cy, double cz,
-                                  double radius) -> std::pair<bool, double> {
-        double oc_x = ox - cx;
-        double oc_y = oy - cy;
-        double oc_z = oz - cz;
-        
-        double a = dx*dx + dy*dy + dz*dz;
-        double b = 2.0 * (oc_x*dx + oc_y*dy + oc_z*dz);
-        double c = oc_x*oc_x + oc_y*oc_y + oc_z*oc_z - radius*radius;
-        
-        double discriminant = b*b - 4*a*c;
-        if (discriminant < 0) return {false, 0.0};
-        
-        double t1 = (-b - sqrt(discriminant)) / (2.0*a);
-        if (t1 > 0.001) return {true, t1};
-        
-        double t2 = (-b + sqrt(discriminant)) / (2.0*a);
-        if (t2 > 0.001) return {true, t2};
-        
-        return {false, 0.0};
-    };
-    
     // Test several cases
     struct TestCase {
         double ray_ox, ray_oy, ray_oz;
@@ -223,58 +236,46 @@ void compare_with_software() {
         {2, 0, 3,  0, 0, -1,  0, 0, 0,  1.0},
         {0, 2, 5,  0, -1, 0,  0, 0, 0,  1.5},
         {-3, -3, 5,  1, 1, -1,  0, 0, 0,  2.0},
+        {5, 0, 0,  0, 0, -1,  0, 0, 0,  1.0},     // miss
+        {0, 1, 5,  0, 0, -1,  0, 0, 0,  1.0},     // tangent
+        {0, 0, 0,  1, 0, 0,   0, 0, 0,  2.0},     // origin inside the sphere
     };
     
-    int passed = 0;
-    int total = sizeof(test_cases) / sizeof(test_cases[0]);
+    std::vector<AcceleratorJob> jobs;
+    for (const TestCase& tc : test_cases) {
+        jobs.push_back(RaySphereAccelerator::fixed_job(tc.ray_ox, tc.ray_oy, tc.ray_oz, tc.ray_dx, tc.ray_dy, tc.ray_dz,
+                                                       tc.sphere_cx, tc.sphere_cy, tc.sphere_cz, tc.radius));
+    }
+    // and primary-ray-like jobs towards spheres near the origin
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> u(-1.0, 1.0);
+    for (int i = 0; i < 1000; i++) {
+        jobs.push_back(RaySphereAccelerator::fixed_job(2 * u(rng), 2 * u(rng), 5 + u(rng), 0.3 * u(rng), 0.3 * u(rng), -1,
+                                                       u(rng), u(rng), u(rng), 1 + 0.5 * u(rng)));
+    }
     
+    int passed = 0;
+    int total = int(jobs.size());
     for (int i = 0; i < total; i++) {
-        auto& tc = test_cases[i];
-        
-        // Hardware
-        double t_hw;
-        bool hit_hw = accel.intersect(
-            tc.ray_ox, tc.ray_oy, tc.ray_oz,
-            tc.ray_dx, tc.ray_dy, tc.ray_dz,
-            tc.sphere_cx, tc.sphere_cy, tc.sphere_cz,
-            tc.radius, t_hw
-        );
-        
-        // Software
-        auto [hit_sw, t_sw] = software_intersect(
-            tc.ray_ox, tc.ray_oy, tc.ray_oz,
-            tc.ray_dx, tc.ray_dy, tc.ray_dz,
-            tc.sphere_cx, tc.sphere_cy, tc.sphere_cz,
-            tc.radius
-        );
-        
-        bool match = (hit_hw == hit_sw);
-        if (hit_hw && hit_sw) {
-            double error = fabs(t_hw - t_sw);
-            match = match && (error < 0.01); // 1% tolerance for fixed-point
-            
-            std::cout << "Case " << i+1 << ": HW t=" << t_hw 
-                      << ", SW t=" << t_sw 
-                      << ", error=" << error << " ";
-        } else {
-            std::cout << "Case " << i+1 << ": HW hit=" << hit_hw 
-                      << ", SW hit=" << hit_sw << " ";
-        }
-        
-        if (match) {
-            std::cout << "[PASS]" << std::endl;
-            passed++;
-        } else {
-            std::cout << "[FAIL]" << std::endl;
+        AcceleratorResult hw = {false, 0};
+        AcceleratorResult model = FixedPointModel::evaluate(jobs[i]);
+        bool match = accel.intersect(jobs[i], hw) && hw.hit == model.hit &&
+                     (!hw.hit || std::abs(int64_t(hw.t) - model.t) <= T_TOLERANCE_LSB);
+        passed += match;
+        if (!match || i < int(sizeof(test_cases) / sizeof(test_cases[0]))) {
+            std::cout << "Case " << i+1 << ": HW hit=" << hw.hit << " t=" << hw.t
+                      << ", model hit=" << model.hit << " t=" << model.t
+                      << (match ? " [PASS]" : " [FAIL]") << std::endl;
         }
     }
     
     std::cout << "\nPassed: " << passed << "/" << total << std::endl;
+    return passed == total;
 }
 
 int main(int argc, char** argv) {
     Verilated::commandArgs(argc, argv);
-
+    
     std::cout << "Ray-Sphere Intersection Accelerator" << std::endl;
     std::cout << "Hardware Testbench (Verilator)" << std::endl;
     
@@ -282,9 +283,9 @@ int main(int argc, char** argv) {
     test_miss();
     test_tangent();
     test_inside_sphere();
-    compare_with_software();
+    bool matched = compare_with_model();
     
-    std::cout << "\nAll tests complete" << std::endl;
+    std::cout << "\n" << (matched ? "All tests complete" : "Accuracy comparison failed") << std::endl;
     
-    return 0;
+    return matched ? 0 : 1;
 }
\ No newline at end of file
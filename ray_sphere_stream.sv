@@ -0,0 +1,112 @@
+// Streaming ray-sphere intersection: a 4-stage pipeline that accepts one job
+// and returns one result per cycle. Both ends use a valid/ready handshake;
+// every job carries an ID that comes back with its result, in the order the
+// jobs went in. Same Q16.16 interface as ray_sphere_intersect
+module ray_sphere_stream #(
+    parameter int ID_WIDTH = 16
+) (
+    input  logic clk,
+    input  logic rst_n,
+    
+    // Jobs: taken on a cycle where in_valid && in_ready
+    input  logic in_valid,
+    output logic in_ready,
+    input  logic [ID_WIDTH-1:0] in_id,
+    input  logic signed [31:0] ray_ox, ray_oy, ray_oz,
+    input  logic signed [31:0] ray_dx, ray_dy, ray_dz,
+    input  logic signed [31:0] sphere_cx, sphere_cy, sphere_cz,
+    input  logic signed [31:0] sphere_r2,
+    
+    // Results: delivered on a cycle where out_valid && out_ready
+    output logic out_valid,
+    input  logic out_ready,
+    output logic [ID_WIDTH-1:0] out_id,
+    output logic hit,
+    output logic signed [31:0] t_out
+);
+    
+    // The stages move in lockstep; the pipeline only stalls while a result
+    // waits on the output and nobody takes it
+    logic advance;
+    assign advance = !out_valid || out_ready;
+    assign in_ready = advance;
+    
+    // Still doubles inside, like ray_sphere_intersect (simulation only)
+    
+    // Stage 1: operands to real
+    logic s1_valid;
+    logic [ID_WIDTH-1:0] s1_id;
+    real s1_ox, s1_oy, s1_oz, s1_dx, s1_dy, s1_dz;
+    real s1_cx, s1_cy, s1_cz, s1_r2;
+    
+    // Stage 2: quadratic coefficients
+    logic s2_valid;
+    logic [ID_WIDTH-1:0] s2_id;
+    real s2_a, s2_b, s2_c;
+    
+    // Stage 3: discriminant
+    logic s3_valid;
+    logic [ID_WIDTH-1:0] s3_id;
+    real s3_a, s3_b, s3_disc;
+    
+    // Stage 4 (the output registers): nearest root past the epsilon, either
+    // root, so rays starting inside a sphere hit its far side
+    real s3_sqrt, s3_t1, s3_t2;
+    always_comb begin
+        s3_sqrt = (s3_disc >= 0.0) ? $sqrt(s3_disc) : 0.0;
+        s3_t1 = (s3_a != 0.0) ? (-s3_b - s3_sqrt) / (2.0 * s3_a) : 0.0;
+        s3_t2 = (s3_a != 0.0) ? (-s3_b + s3_sqrt) / (2.0 * s3_a) : 0.0;
+    end
+    
+    always_ff @(posedge clk or negedge rst_n) begin
+        if (!rst_n) begin
+            s1_valid <= 0;
+            s2_valid <= 0;
+            s3_valid <= 0;
+            out_valid <= 0;
+            out_id <= 0;
+            hit <= 0;
+            t_out <= 0;
+        end else if (advance) begin
+            s1_valid <= in_valid;
+            s1_id <= in_id;
+            s1_ox <= $itor(ray_ox) / 65536.0;
+            s1_oy <= $itor(ray_oy) / 65536.0;
+            s1_oz <= $itor(ray_oz) / 65536.0;
+            s1_dx <= $itor(ray_dx) / 65536.0;
+            s1_dy <= $itor(ray_dy) / 65536.0;
+            s1_dz <= $itor(ray_dz) / 65536.0;
+            s1_cx <= $itor(sphere_cx) / 65536.0;
+            s1_cy <= $itor(sphere_cy) / 65536.0;
+            s1_cz <= $itor(sphere_cz) / 65536.0;
+            s1_r2 <= $itor(sphere_r2) / 65536.0;
+            
+            s2_valid <= s1_valid;
+            s2_id <= s1_id;
+            s2_a <= s1_dx*s1_dx + s1_dy*s1_dy + s1_dz*s1_dz;
+            s2_b <= 2.0 * ((s1_ox - s1_cx)*s1_dx + (s1_oy - s1_cy)*s1_dy + (s1_oz - s1_cz)*s1_dz);
+            s2_c <= (s1_ox - s1_cx)*(s1_ox - s1_cx) + (s1_oy - s1_cy)*(s1_oy - s1_cy) +
+                    (s1_oz - s1_cz)*(s1_oz - s1_cz) - s1_r2;
+            
+            s3_valid <= s2_valid;
+            s3_id <= s2_id;
+            s3_a <= s2_a;
+            s3_b <= s2_b;
+            s3_disc <= s2_b*s2_b - 4.0*s2_a*s2_c;
+            
+            out_valid <= s3_valid;
+            out_id <= s3_id;
+            if (s3_disc >= 0.0 && s3_a != 0.0 && s3_t1 > 0.001) begin
+                hit <= 1;
+                t_out <= $rtoi(s3_t1 * 65536.0);
+            end else if (s3_disc >= 0.0 && s3_a != 0.0 && s3_t2 > 0.001) begin
+                hit <= 1;
+                t_out <= $rtoi(s3_t2 * 65536.0);
+            end else begin
+                hit <= 0;
+                t_out <= 0;
+            end
+        end
+    end
+
+endmodule
@@ -0,0 +1,324 @@
+// Verilator C++ Testbench for the streaming Ray-Sphere Intersection Accelerator
+// Provides a batch interface: queue thousands of jobs, let the pipeline run,
+// and collect results by job ID as they come out
+
+#include "Vray_sphere_stream.h"
+#include "verilated.h"
+#include <iostream>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <random>
+#include <chrono>
+
+#include "intersect_backend.h"  // FixedPointModel, the reference for ray_sphere_fixed
+
+// Q16.16 fixed-point conversion utilities
+const int FRAC_BITS = 16;
+const double SCALE = (1 << FRAC_BITS);
+
+int32_t double_to_fixed(double val) {
+    return static_cast<int32_t>(val * SCALE);
+}
+
+double fixed_to_double(int32_t val) {
+    return static_cast<double>(val) / SCALE;
+}
+
+struct RaySphereJob {
+    double ray_ox, ray_oy, ray_oz;
+    double ray_dx, ray_dy, ray_dz;
+    double sphere_cx, sphere_cy, sphere_cz;
+    double radius;
+};
+
+struct RaySphereResult {
+    uint64_t id;    // as returned by submit()
+    bool hit;
+    double t;
+    int32_t t_fixed;    // t_out as the module presented it
+};
+
+// The Q16.16 operands a job is driven with, radius squared before rounding
+static AcceleratorJob fixed_job(const RaySphereJob& job) {
+    AcceleratorJob j = {double_to_fixed(job.ray_ox), double_to_fixed(job.ray_oy), double_to_fixed(job.ray_oz),
+                        double_to_fixed(job.ray_dx), double_to_fixed(job.ray_dy), double_to_fixed(job.ray_dz),
+                        double_to_fixed(job.sphere_cx), double_to_fixed(job.sphere_cy), double_to_fixed(job.sphere_cz),
+                        double_to_fixed(job.radius * job.radius)};
+    return j;
+}
+
+// Batch interface to ray_sphere_stream. submit() only queues a job and
+// returns its ID; the clock advances in step()/drain(), which offer the next
+// queued job every cycle and collect whatever result the pipeline presents.
+// Completed results wait in a queue until poll() takes them
+class RaySphereStream {
+private:
+    Vray_sphere_stream* dut;
+    uint64_t cycle_count;
+    uint64_t next_id;
+    uint64_t stall_cycles;                  // cycles a queued job was refused
+    std::deque<std::pair<uint64_t, RaySphereJob>> queued;
+    std::deque<uint64_t> in_flight;         // accepted, result not seen yet
+    std::deque<RaySphereResult> completed;
+    std::mt19937 rng;
+    double backpressure;                    // chance per cycle that out_ready is low
+    bool id_error;
+    
+    static const uint32_t ID_MASK = 0xFFFF;  // the module's ID_WIDTH
+    
+    // One clock cycle. Inputs are driven and both handshakes sampled while the
+    // clock is low, so they see the state before this cycle's edge
+    void tick() {
+        bool offer = !queued.empty();
+        if (offer) {
+            AcceleratorJob job = fixed_job(queued.front().second);
+            dut->in_id = uint32_t(queued.front().first) & ID_MASK;
+            dut->ray_ox = job.ox;
+            dut->ray_oy = job.oy;
+            dut->ray_oz = job.oz;
+            dut->ray_dx = job.dx;
+            dut->ray_dy = job.dy;
+            dut->ray_dz = job.dz;
+            dut->sphere_cx = job.cx;
+            dut->sphere_cy = job.cy;
+            dut->sphere_cz = job.cz;
+            dut->sphere_r2 = job.r2;
+        }
+        dut->in_valid = offer;
+        dut->out_ready = !(backpressure > 0 && std::uniform_real_distribution<double>(0, 1)(rng) < backpressure);
+        
+        dut->clk = 0;
+        dut->eval();
+        bool accepted = dut->in_valid && dut->in_ready;
+        bool delivered = dut->out_valid && dut->out_ready;
+        if (offer && !accepted) stall_cycles++;
+        
+        if (delivered) {
+            // Results come back in job order, so the oldest job in flight owns it
+            if (in_flight.empty() || (uint32_t(in_flight.front()) & ID_MASK) != dut->out_id) {
+                id_error = true;
+            } else {
+                RaySphereResult r;
+                r.id = in_flight.front();
+                r.hit = dut->hit;
+                r.t_fixed = r.hit ? int32_t(dut->t_out) : 0;
+                r.t = fixed_to_double(r.t_fixed);
+                completed.push_back(r);
+                in_flight.pop_front();
+            }
+        }
+        
+        dut->clk = 1;
+        dut->eval();
+        cycle_count++;
+        
+        if (accepted) {
+            in_flight.push_back(queued.front().first);
+            queued.pop_front();
+        }
+    }
+    
+    void reset() {
+        dut->in_valid = 0;
+        dut->out_ready = 1;
+        dut->rst_n = 0;
+        tick();
+        tick();
+        dut->rst_n = 1;
+        cycle_count = 0;
+        stall_cycles = 0;
+    }
+
+public:
+    RaySphereStream() : cycle_count(0), next_id(0), stall_cycles(0), rng(42), backpressure(0), id_error(false) {
+        dut = new Vray_sphere_stream;
+        reset();
+    }
+    
+    ~RaySphereStream() {
+        dut->final();
+        delete dut;
+    }
+    
+    // Queues a job; its result carries the returned ID
+    uint64_t submit(const RaySphereJob& job) {
+        queued.push_back(std::make_pair(next_id, job));
+        return next_id++;
+    }
+    
+    void step(int cycles = 1) {
+        for (int c = 0; c < cycles; c++) tick();
+    }
+    
+    // Runs until every submitted job has a result waiting; false on timeout
+    // (the pipeline is short, so anything beyond a few cycles per job means
+    // it has hung) or if a result came back under the wrong ID
+    bool drain() {
+        uint64_t limit = cycle_count + 100 + 16 * (queued.size() + in_flight.size());
+        while ((!queued.empty() || !in_flight.empty()) && cycle_count < limit && !id_error) tick();
+        if (id_error) {
+            std::cerr << "Result ID out of order!" << std::endl;
+            return false;
+        }
+        if (!queued.empty() || !in_flight.empty()) {
+            std::cerr << "Hardware timeout!" << std::endl;
+            return false;
+        }
+        return true;
+    }
+    
+    // Takes the oldest completed result, if any
+    bool poll(RaySphereResult& result) {
+        if (completed.empty()) return false;
+        result = completed.front();
+        completed.pop_front();
+        return true;
+    }
+    
+    size_t pending() const { return queued.size() + in_flight.size(); }
+    uint64_t cycles() const { return cycle_count; }
+    uint64_t stalls() const { return stall_cycles; }
+    
+    // Makes the consumer refuse results at random, to exercise stalls
+    void setBackpressure(double p) { backpressure = p; }
+};
+
+// The reference each module is held to, on the operands it was driven with.
+// ray_sphere_fixed (run.sh builds this testbench for it with
+// -DRAY_SPHERE_FIXED) is held to FixedPointModel::evaluate, the model the
+// renderer's accel backend uses: every hit flag must match and t_out may
+// differ by at most T_TOLERANCE_LSB. The model is written to be bit-exact,
+// so that is 0. ray_sphere_stream computes in real, so it is held to the
+// same quadratic in double on the rounded operands: every hit flag must
+// match, and t_out, which truncates t to Q16.16, may be up to one LSB low
+static const int32_t T_TOLERANCE_LSB = 0;
+
+static double q(double v) { return fixed_to_double(double_to_fixed(v)); }
+
+static bool software_intersect(const RaySphereJob& job, double& t) {
+    RaySphereJob j = {q(job.ray_ox), q(job.ray_oy), q(job.ray_oz), q(job.ray_dx), q(job.ray_dy), q(job.ray_dz),
+                      q(job.sphere_cx), q(job.sphere_cy), q(job.sphere_cz), 0};
+    double r2 = q(job.radius * job.radius);
+    double oc_x = j.ray_ox - j.sphere_cx;
+    double oc_y = j.ray_oy - j.sphere_cy;
+    double oc_z = j.ray_oz - j.sphere_cz;
+    
+    double a = j.ray_dx*j.ray_dx + j.ray_dy*j.ray_dy + j.ray_dz*j.ray_dz;
+    double b = 2.0 * (oc_x*j.ray_dx + oc_y*j.ray_dy + oc_z*j.ray_dz);
+    double c = oc_x*oc_x + oc_y*oc_y + oc_z*oc_z - r2;
+    
+    double discriminant = b*b - 4*a*c;
+    if (discriminant < 0) return false;
+    
+    double t1 = (-b - sqrt(discriminant)) / (2.0*a);
+    if (t1 > 0.001) { t = t1; return true; }
+    
+    double t2 = (-b + sqrt(discriminant)) / (2.0*a);
+    if (t2 > 0.001) { t = t2; return true; }
+    
+    return false;
+}
+
+// Whether a hardware result agrees with its module's reference; 'error' is
+// how far t is off, in LSBs
+static bool matches_reference(const RaySphereJob& job, const RaySphereResult& r, double& error) {
+    error = 0;
+#ifdef RAY_SPHERE_FIXED
+    AcceleratorResult expected = FixedPointModel::evaluate(fixed_job(job));
+    if (r.hit != expected.hit) return false;
+    if (!r.hit) return true;
+    error = std::fabs(double(r.t_fixed) - double(expected.t));
+    return error <= T_TOLERANCE_LSB;
+#else
+    double t_sw = 0;
+    if (r.hit != software_intersect(job, t_sw)) return false;
+    if (!r.hit) return true;
+    error = std::fabs(t_sw * SCALE - r.t_fixed);
+    return error < 1.0;
+#endif
+}
+
+// Random primary-ray-like jobs: unit directions from around z = 5 towards
+// spheres near the origin; about a fifth of them hit
+static std::vector<RaySphereJob> random_jobs(int n, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> u(-1.0, 1.0);
+    std::vector<RaySphereJob> jobs;
+    for (int i = 0; i < n; i++) {
+        RaySphereJob j;
+        j.ray_ox = 2 * u(rng); j.ray_oy = 2 * u(rng); j.ray_oz = 5 + u(rng);
+        double dx = 0.3 * u(rng), dy = 0.3 * u(rng), dz = -1;
+        double len = std::sqrt(dx*dx + dy*dy + dz*dz);
+        j.ray_dx = dx / len; j.ray_dy = dy / len; j.ray_dz = dz / len;
+        j.sphere_cx = u(rng); j.sphere_cy = u(rng); j.sphere_cz = u(rng);
+        j.radius = 0.5 + 0.5 * (u(rng) + 1);
+        jobs.push_back(j);
+    }
+    return jobs;
+}
+
+// Runs a batch and checks every result against the module's reference
+static bool check_batch(const char* name, const std::vector<RaySphereJob>& jobs, double backpressure) {
+    std::cout << "\n" << name << std::endl;
+    RaySphereStream accel;
+    accel.setBackpressure(backpressure);
+    
+    for (const RaySphereJob& j : jobs) accel.submit(j);
+    auto start = std::chrono::high_resolution_clock::now();
+    bool drained = accel.drain();
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    
+    int passed = 0, hits = 0, received = 0;
+    double max_error = 0;
+    RaySphereResult r;
+    while (accel.poll(r)) {
+        received++;
+        double error = 0;
+        bool match = matches_reference(jobs[r.id], r, error);
+        if (match) max_error = std::max(max_error, error);
+        passed += match;
+        hits += r.hit;
+    }
+    
+    std::cout << "Jobs: " << jobs.size() << ", results: " << received << ", hits: " << hits << std::endl;
+    std::cout << "Cycles: " << accel.cycles() << " (" << double(jobs.size()) / accel.cycles()
+              << " results/cycle, " << accel.stalls() << " stall cycles)" << std::endl;
+    std::cout << "Simulated " << jobs.size() / seconds / 1e6 << " M jobs/sec, max t error " << max_error << " LSB"
+              << std::endl;
+    
+    bool ok = drained && received == int(jobs.size()) && passed == received;
+    std::cout << "Matched reference: " << passed << "/" << jobs.size() << (ok ? " [PASS]" : " [FAIL]") << std::endl;
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    Verilated::commandArgs(argc, argv);
+    
+    std::cout << "Ray-Sphere Intersection Accelerator (streaming)" << std::endl;
+    std::cout << "Hardware Testbench (Verilator)" << std::endl;
+#ifdef RAY_SPHERE_FIXED
+    std::cout << "Reference: FixedPointModel, t within " << T_TOLERANCE_LSB << " LSB" << std::endl;
+#else
+    std::cout << "Reference: double quadratic, t_out within 1 LSB below it" << std::endl;
+#endif
+    
+    // The single-job module's test cases, as one batch
+    std::vector<RaySphereJob> basic = {
+        {0, 0, 5,  0, 0, -1,  0, 0, 0,  1.0},     // basic intersection
+        {5, 0, 0,  0, 0, -1,  0, 0, 0,  1.0},     // miss
+        {0, 1, 5,  0, 0, -1,  0, 0, 0,  1.0},     // tangent
+        {0, 0, 0,  1, 0, 0,   0, 0, 0,  2.0},     // origin inside the sphere
+        {2, 0, 3,  0, 0, -1,  0, 0, 0,  1.0},
+        {0, 2, 5,  0, -1, 0,  0, 0, 0,  1.5},
+    };
+    
+    int failed = 0;
+    failed += !check_batch("Test 1: Single-job cases as a batch", basic, 0.0);
+    failed += !check_batch("Test 2: 10000 random jobs, full throughput", random_jobs(10000, 1), 0.0);
+    failed += !check_batch("Test 3: 10000 random jobs, consumer stalls 30% of cycles", random_jobs(10000, 2), 0.3);
+    
+    std::cout << "\n" << (failed ? "Some tests failed" : "All tests complete") << std::endl;
+    return failed ? 1 : 0;
+}
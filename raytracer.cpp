@@ -1,405 +1,295 @@
-#include <SDL2/SDL.h>
 #include <iostream>
-#include <vector>
+#include <string>
+#include <cstdlib>
 #include <cmath>
-#include <limits>
 #include <algorithm>
-#include <omp.h>
-#include <chrono>
 
+#include "renderer.h"
+#include "scene_io.h"
+#include "distributed.h"
+#include "sequence.h"
+#include "stream_output.h"
+#include "render_server.h"
+#ifndef RAYTRACER_NO_SDL
+#include "sdl_display.h"
+#endif
 
-// 3D vector structure (same as original, but with additional utilities)
-struct Vec3 {
-    double x, y, z;
-    
-    Vec3(double x = 0, double y = 0, double z = 0) : x(x), y(y), z(z) {}
-    
-    Vec3 operator+(const Vec3& v) const { return Vec3(x + v.x, y + v.y, z + v.z); }
-    Vec3 operator-(const Vec3& v) const { return Vec3(x - v.x, y - v.y, z - v.z); }
-    Vec3 operator*(double t) const { return Vec3(x * t, y * t, z * t); }
-    Vec3 operator/(double t) const { return Vec3(x / t, y / t, z / t); }
-    
-    double dot(const Vec3& v) const { return x * v.x + y * v.y + z * v.z; }
-    
-    Vec3 cross(const Vec3& v) const {
-        return Vec3(y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x);
-    }
-    
-    double length() const { return sqrt(x * x + y * y + z * z); }
-    double lengthSquared() const { return x * x + y * y + z * z; }  // ADDED: Avoid sqrt when possible
-    
-    Vec3 normalize() const {
-        double len = length();
-        return len > 0 ? *this / len : Vec3(0, 0, 0);
-    }
-    
-    Vec3 reflect(const Vec3& normal) const {
-        return *this - normal * 2 * this->dot(normal);
-    }
-};
-
-using Color = Vec3;
-
-struct Ray {
-    Vec3 origin, direction;
-    
-    Ray(const Vec3& o, const Vec3& d) : origin(o), direction(d.normalize()) {}
+// Built-in demo scene, used when no --scene file is given
+static void setupDefaultScene(Scene& scene) {
+     // Define materials
+    Material red(Color(1.0, 0.2, 0.2), 0.1, 0.7, 0.8, 64, 0.4);
+    Material green(Color(0.2, 1.0, 0.2), 0.1, 0.8, 0.6, 32, 0.2);
+    Material blue(Color(0.2, 0.2, 1.0), 0.1, 0.6, 0.9, 128, 0.6);
+    Material gold(Color(1.0, 0.84, 0.0), 0.2, 0.5, 1.0, 256, 0.5);
+    Material silver(Color(0.75, 0.75, 0.75), 0.1, 0.4, 1.0, 256, 0.8);
     
-    Vec3 at(double t) const { return origin + direction * t; }
-};
-
-struct Material {
-    Color color;
-    double ambient, diffuse, specular, shininess, reflectivity;
+    // Build scene geometry
+    scene.addSphere(Sphere(Vec3(0, 0, 0), 1.0, red));
+    scene.addSphere(Sphere(Vec3(-2.5, 0, -1), 0.8, green));
+    scene.addSphere(Sphere(Vec3(2.5, 0.5, -0.5), 1.2, blue));
+    scene.addSphere(Sphere(Vec3(0, -101, 0), 100, silver));
+    scene.addSphere(Sphere(Vec3(-1, 1.5, 1), 0.5, gold));
     
-    Material(const Color& c = Color(1, 1, 1), double amb = 0.1, double diff = 0.7, 
-             double spec = 0.6, double shin = 32, double refl = 0.3)
-        : color(c), ambient(amb), diffuse(diff), specular(spec), shininess(shin), reflectivity(refl) {}
-};
-
+    // Configure lighting
+    scene.addLight(Light(Vec3(-5, 5, 5), Color(1, 1, 1), 0.8));
+    scene.addLight(Light(Vec3(5, 3, 3), Color(1, 1, 1), 0.6));
+}
 
-// Improvement: Assumes normalized ray direction (a = 1), uses b/2 optimization
-struct Sphere {
-    Vec3 center;
-    double radius;
-    Material material;
-    
-    Sphere(const Vec3& c, double r, const Material& m) : center(c), radius(r), material(m) {}
-    
-    // IMPROVED: Optimized for normalized ray direction
-    bool intersect(const Ray& ray, double& t) const {
-        Vec3 oc = ray.origin - center;
-        
-        // Since ray.direction is normalized in Ray constructor:
-        // a = ray.direction.dot(ray.direction) = 1.0
-        
-        // Use b/2 optimization: let b' = oc.dot(direction)
-        double b_half = oc.dot(ray.direction);
-        double c = oc.lengthSquared() - radius * radius;
-        
-        // Discriminant = b'² - ac = b'² - c (since a = 1)
-        double discriminant = b_half * b_half - c;
-        
-        if (discriminant < 0) return false;
-        
-        double sqrt_disc = sqrt(discriminant);
-        
-        // t = (-b' - sqrt(discriminant)) / a = -b' - sqrt(discriminant)
-        double t1 = -b_half - sqrt_disc;
-        if (t1 > 0.001) {
-            t = t1;
-            return true;
-        }
-        
-        double t2 = -b_half + sqrt_disc;
-        if (t2 > 0.001) {
-            t = t2;
-            return true;
-        }
-        
-        return false;
+// --validate-shading: renders the frame with the reference and the fast
+// shading kernel and reports how far the fast one strays
+static void validateShading(Renderer& renderer, const Scene& scene, const Camera& camera, int width, int height) {
+    TraceSettings settings = renderer.traceSettings();
+    renderer.setVerbose(false);
+    FrameBuffer images[2] = {FrameBuffer(width, height), FrameBuffer(width, height)};
+    for (int k = 0; k < 2; k++) {
+        TraceSettings s = settings;
+        s.fast_shading = k == 1;
+        renderer.setTraceSettings(s);
+        renderer.resetAccumulation();
+        do {
+            renderer.render(scene, camera, images[k]);
+        } while (renderer.refining(scene));
+        renderer.resolve(images[k]);
     }
+    renderer.setTraceSettings(settings);
     
-    Vec3 getNormal(const Vec3& point) const {
-        return (point - center).normalize();
+    double max_linear = 0;
+    int max_level = 0;
+    size_t differing = 0;
+    for (size_t i = 0; i < images[0].pixels.size(); i++) {
+        bool differs = false;
+        for (int c = 0; c < 3; c++) {
+            max_linear = std::max(max_linear, double(std::fabs(images[0].linear[c][i] - images[1].linear[c][i])));
+            int shift = 16 - 8 * c;
+            int level = std::abs(int((images[0].pixels[i] >> shift) & 0xFF) - int((images[1].pixels[i] >> shift) & 0xFF));
+            max_level = std::max(max_level, level);
+            differs = differs || level > 0;
+        }
+        differing += differs;
     }
-};
-
-struct Light {
-    Vec3 position;
-    Color color;
-    double intensity;
-    
-    Light(const Vec3& p, const Color& c, double i = 1.0) 
-        : position(p), color(c), intensity(i) {}
-};
+    std::cout << "Shading validation (fast vs reference): max error " << max_level << "/255 (linear "
+              << max_linear << "), " << differing << " of " << images[0].pixels.size() << " pixels differ ("
+              << 100.0 * differing / images[0].pixels.size() << "%)" << std::endl;
+}
 
-// OPTIMIZATION 2: Separate shadow ray intersection with early exit
-class Scene {
-public:
-    std::vector<Sphere> spheres;
-    std::vector<Light> lights;
-    Color background;
-    
-    Scene() : background(0.1, 0.1, 0.15) {}
-    
-    void addSphere(const Sphere& sphere) { spheres.push_back(sphere); }
-    void addLight(const Light& light) { lights.push_back(light); }
-    
-    // Original intersection - finds closest hit
-    bool intersect(const Ray& ray, double& closest_t, int& hit_idx) const {
-        closest_t = std::numeric_limits<double>::max();
-        hit_idx = -1;
-        
-        for (size_t i = 0; i < spheres.size(); i++) {
-            double t;
-            if (spheres[i].intersect(ray, t) && t < closest_t) {
-                closest_t = t;
-                hit_idx = i;
+int main(int argc, char* argv[]) {
+    // Initialize renderer
+    int width = 800;
+    int height = 600;
+    Renderer renderer;
+    TraceSettings trace_settings;
+    int aa_grid = 0;
+    Real aa_threshold = 0.1;
+    std::string output;
+    std::string scene_path;
+    std::string save_scene_path;
+    std::string sequence_path;
+    const IntersectBackend* backend = &simdBackend();
+    int listen_port = 0;        // > 0: coordinate workers instead of rendering
+    int min_workers = 1;
+    int dist_tile_size = 128;
+    std::string worker_of;      // coordinator address: run as a worker
+    bool validate_shading = false;
+    bool stream = false;
+    int band_rows = 64;
+    int band_buffers = 3;
+    int serve_port = 0;         // > 0: run the render server
+    std::string scene_dir = "scenes";
+    int max_batch = 16;
+    double batch_window = 0;    // ms
+#ifdef RAYTRACER_NO_SDL
+    bool headless = true;
+#else
+    bool headless = false;
+#endif
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--packets") {
+            renderer.setTraceMode(TraceMode::Packet);
+        } else if (arg == "--device") {
+            renderer.setTraceMode(TraceMode::Device);
+            std::cerr << "--device is experimental: verified only on the host fallback (" << renderer.deviceName()
+                      << ")" << std::endl;
+        } else if (arg == "--backend" && a + 1 < argc) {
+            backend = findBackend(argv[++a]);
+            if (!backend) {
+                std::cerr << "Unknown backend " << argv[a] << " (scalar, simd or accel)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--shading" && a + 1 < argc) {
+            std::string shading = argv[++a];
+            if (shading != "fast" && shading != "reference") {
+                std::cerr << "Unknown shading " << shading << " (fast or reference)" << std::endl;
+                return 1;
             }
+            trace_settings.fast_shading = shading == "fast";
+        } else if (arg == "--validate-shading") {
+            validate_shading = true;
+        } else if (arg == "--generic-kernel") {
+            renderer.setSpecializedKernels(false);
+        } else if (arg == "--max-depth" && a + 1 < argc) {
+            trace_settings.max_depth = std::max(0, atoi(argv[++a]));
+        } else if (arg == "--min-weight" && a + 1 < argc) {
+            trace_settings.min_weight = Real(atof(argv[++a]));
+        } else if (arg == "--roulette" && a + 1 < argc) {
+            trace_settings.roulette_weight = Real(atof(argv[++a]));
+        } else if (arg == "--light-cutoff" && a + 1 < argc) {
+            trace_settings.light_cutoff = Real(atof(argv[++a]));
+        } else if (arg == "--light-samples" && a + 1 < argc) {
+            trace_settings.light_samples = std::max(0, atoi(argv[++a]));
+        } else if (arg == "--frames" && a + 1 < argc) {
+            renderer.setMaxFrames(atoi(argv[++a]));
+        } else if (arg == "--aa" && a + 1 < argc) {
+            aa_grid = atoi(argv[++a]);
+        } else if (arg == "--aa-threshold" && a + 1 < argc) {
+            aa_threshold = Real(atof(argv[++a]));
+        } else if (arg == "--tile-size" && a + 1 < argc) {
+            renderer.setTileSize(atoi(argv[++a]));
+        } else if (arg == "--tile-order" && a + 1 < argc) {
+            std::string order = argv[++a];
+            if (order != "hilbert" && order != "morton" && order != "scanline") {
+                std::cerr << "Unknown tile order " << order << " (hilbert, morton or scanline)" << std::endl;
+                return 1;
+            }
+            renderer.setTileOrder(order == "morton" ? TileOrder::Morton :
+                                  order == "scanline" ? TileOrder::Scanline : TileOrder::Hilbert);
+        } else if (arg == "--incremental") {
+            renderer.setIncremental(true);
+        } else if (arg == "--gbuffer") {
+            renderer.setPrimaryCache(true);
+        } else if (arg == "--no-pin") {
+            renderer.setThreadPinning(false);
+        } else if (arg == "--replicate-scene") {
+            renderer.setSceneReplication(true);
+        } else if (arg == "--stats") {
+            renderer.setPrintStats(true);
+        } else if (arg == "--scene" && a + 1 < argc) {
+            scene_path = argv[++a];
+        } else if (arg == "--save-scene" && a + 1 < argc) {
+            save_scene_path = argv[++a];
+        } else if (arg == "--sequence" && a + 1 < argc) {
+            sequence_path = argv[++a];
+        } else if (arg == "--listen" && a + 1 < argc) {
+            listen_port = atoi(argv[++a]);
+        } else if (arg == "--workers" && a + 1 < argc) {
+            min_workers = atoi(argv[++a]);
+        } else if (arg == "--dist-tile-size" && a + 1 < argc) {
+            dist_tile_size = atoi(argv[++a]);
+        } else if (arg == "--worker" && a + 1 < argc) {
+            worker_of = argv[++a];
+        } else if (arg == "--headless") {
+            headless = true;
+        } else if (arg == "--output" && a + 1 < argc) {
+            output = argv[++a];
+        } else if (arg == "--serve" && a + 1 < argc) {
+            serve_port = atoi(argv[++a]);
+        } else if (arg == "--scene-dir" && a + 1 < argc) {
+            scene_dir = argv[++a];
+        } else if (arg == "--max-batch" && a + 1 < argc) {
+            max_batch = std::max(1, atoi(argv[++a]));
+        } else if (arg == "--batch-window" && a + 1 < argc) {
+            batch_window = std::max(0.0, atof(argv[++a]));
+        } else if (arg == "--stream") {
+            stream = true;
+        } else if (arg == "--band-rows" && a + 1 < argc) {
+            band_rows = std::max(1, atoi(argv[++a]));
+        } else if (arg == "--band-buffers" && a + 1 < argc) {
+            band_buffers = std::max(2, atoi(argv[++a]));
+        } else if (arg == "--width" && a + 1 < argc) {
+            width = std::max(1, atoi(argv[++a]));
+        } else if (arg == "--height" && a + 1 < argc) {
+            height = std::max(1, atoi(argv[++a]));
         }
-        return hit_idx != -1;
     }
+    // Workers get the scene and every setting from the coordinator
+    if (!worker_of.empty()) return distributed::runWorker(worker_of, renderer);
     
-    // NEW: Optimized shadow ray intersection - early exit on first hit
-    bool intersectShadow(const Ray& ray, double max_distance) const {
-        for (const auto& sphere : spheres) {
-            double t;
-            // Early exit as soon as we find ANY intersection before light
-            if (sphere.intersect(ray, t) && t > 0.001 && t < max_distance) {
-                return true;  // In shadow
-            }
-        }
-        return false;  // No occlusion
+    renderer.setTraceSettings(trace_settings);
+    renderer.setAntialiasing(aa_grid, aa_threshold);
+    
+    Scene scene;
+    scene.setBackend(*backend);
+    Camera camera(Vec3(0, 1, 5), Vec3(0, 0, 0));
+    if (scene_path.empty()) {
+        setupDefaultScene(scene);
+    } else if (!loadScene(scene_path, scene, &camera)) {
+        return 1;
     }
+    // Build the acceleration structure once the geometry is final
+    // (binary scenes come with theirs)
+    if (scene.bvh.empty()) scene.buildBVH();
     
-    // OPTIMIZATION 3: Energy-conserving reflections
-    Color trace(const Ray& ray, int depth = 0) const {
-        if (depth > 3) return background;
-        
-        double t;
-        int hit_idx;
-        
-        if (!intersect(ray, t, hit_idx)) {
-            return background;
+    // Convert only: write the scene back out (format by extension) and stop
+    if (!save_scene_path.empty()) {
+        if (!saveScene(save_scene_path, scene, &camera)) {
+            std::cerr << "Failed to write " << save_scene_path << std::endl;
+            return 1;
         }
-        
-        const Sphere& sphere = spheres[hit_idx];
-        Vec3 hit_point = ray.at(t);
-        Vec3 normal = sphere.getNormal(hit_point);
-        Vec3 view_dir = (ray.origin - hit_point).normalize();
-        
-        // Ambient component
-        Color color = sphere.material.color * sphere.material.ambient;
-        
-        // Process each light source
-        for (const Light& light : lights) {
-            Vec3 light_dir = (light.position - hit_point).normalize();
-            double light_distance = (light.position - hit_point).length();
-            
-            // IMPROVED: Use optimized shadow ray with early exit
-            bool in_shadow = intersectShadow(Ray(hit_point, light_dir), light_distance);
-            
-            if (!in_shadow) {
-                // Diffuse lighting
-                double diff = std::max(0.0, normal.dot(light_dir));
-                Color diffuse = sphere.material.color * sphere.material.diffuse * diff * light.intensity;
-                
-                // Specular highlights
-                Vec3 reflect_dir = (light_dir * -1).reflect(normal);
-                double spec = pow(std::max(0.0, view_dir.dot(reflect_dir)), sphere.material.shininess);
-                Color specular = light.color * sphere.material.specular * spec * light.intensity;
-                
-                color = color + (diffuse + specular);
-            }
-        }
-        
-        // IMPROVED: Energy-conserving reflections
-        if (sphere.material.reflectivity > 0 && depth < 3) {
-            Vec3 reflect_dir = (view_dir * -1).reflect(normal);
-            Ray reflect_ray(hit_point, reflect_dir);
-            Color reflect_color = trace(reflect_ray, depth + 1);
-            
-            // FIX: Blend instead of add for energy conservation
-            // The surface reflects some light and absorbs the rest
-            double refl = sphere.material.reflectivity;
-            color = color * (1.0 - refl) + reflect_color * refl;
-        }
-        
-        return color;
+        std::cout << "Saved " << save_scene_path << " (" << scene.soa.size() << " spheres)" << std::endl;
+        return 0;
     }
-};
-
-Color clamp(const Color& c) {
-    return Color(
-        std::min(1.0, std::max(0.0, c.x)),
-        std::min(1.0, std::max(0.0, c.y)),
-        std::min(1.0, std::max(0.0, c.z))
-    );
-}
-
-class Camera {
-public:
-    Vec3 position;
-    Vec3 target;
-    Vec3 up;
-    double fov;
-    
-    Camera(const Vec3& pos, const Vec3& tgt, const Vec3& u = Vec3(0, 1, 0), double f = 60.0)
-        : position(pos), target(tgt), up(u), fov(f) {}
     
-    Ray getRay(double u, double v, double aspect_ratio) const {
-        double theta = fov * M_PI / 180.0;
-        double h = tan(theta / 2.0);
-        double viewport_height = 2.0 * h;
-        double viewport_width = aspect_ratio * viewport_height;
-        
-        Vec3 w = (position - target).normalize();
-        Vec3 u_vec = up.cross(w).normalize();
-        Vec3 v_vec = w.cross(u_vec);
-        
-        Vec3 horizontal = u_vec * viewport_width;
-        Vec3 vertical = v_vec * viewport_height;
-        Vec3 lower_left = position - horizontal / 2 - vertical / 2 - w;
-        
-        Vec3 direction = lower_left + horizontal * u + vertical * v - position;
-        return Ray(position, direction);
+    if (validate_shading) {
+        validateShading(renderer, scene, camera, width, height);
+        return 0;
     }
-};
-
-// OPTIMIZATION 4: Better scheduling with guided instead of dynamic
-class Renderer {
-private:
-    SDL_Window* window;
-    SDL_Renderer* renderer;
-    SDL_Texture* texture;
-    int width, height;
-    Uint32* pixels;
     
-public:
-    Renderer(int w, int h) : width(w), height(h) {
-        if (SDL_Init(SDL_INIT_VIDEO) < 0) {
-            std::cerr << "SDL initialization failed: " << SDL_GetError() << std::endl;
-            exit(1);
-        }
-        
-        window = SDL_CreateWindow("Ray Tracer (Optimized)", 
-                                   SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-                                   width, height, SDL_WINDOW_SHOWN);
-        if (!window) {
-            std::cerr << "Window creation failed: " << SDL_GetError() << std::endl;
-            exit(1);
-        }
-        
-        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-        if (!renderer) {
-            std::cerr << "Renderer creation failed: " << SDL_GetError() << std::endl;
-            exit(1);
-        }
-        
-        texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
-                                    SDL_TEXTUREACCESS_STREAMING, width, height);
-        if (!texture) {
-            std::cerr << "Texture creation failed: " << SDL_GetError() << std::endl;
-            exit(1);
-        }
-        
-        pixels = new Uint32[width * height];
+    // Server: stays up and renders requested views of cached scenes, headless
+    if (serve_port > 0) {
+        server::RenderServer render_server(renderer, *backend, scene_dir, max_batch, batch_window);
+        render_server.addScene("default", scene, camera);
+        return render_server.run(serve_port);
     }
     
-    ~Renderer() {
-        delete[] pixels;
-        SDL_DestroyTexture(texture);
-        SDL_DestroyRenderer(renderer);
-        SDL_DestroyWindow(window);
-        SDL_Quit();
+    // Animation: every frame to a numbered file, headless
+    if (!sequence_path.empty()) {
+        Sequence sequence;
+        if (!sequence.load(sequence_path)) return 1;
+        return renderSequence(renderer, scene, camera, sequence, width, height,
+                              output.empty() ? "frame.png" : output) ? 0 : 1;
     }
     
-    void render(const Scene& scene, const Camera& camera) {
-        double aspect_ratio = double(width) / height;
-        
-        std::cout << "Rendering with " << omp_get_max_threads() << " threads (OPTIMIZED)..." << std::endl;
-        
-        auto start_time = std::chrono::high_resolution_clock::now();
-        
-        // OPTIMIZATION: Use 'guided' schedule instead of 'dynamic'
-        // Guided starts with large chunks and progressively reduces size
-        // Better than dynamic(1) for reducing scheduling overhead
-        #pragma omp parallel for schedule(guided) 
-        for (int j = 0; j < height; j++) {
-            // Progress reporting in critical section
-            #pragma omp critical
-            {
-                if (j % 50 == 0) {
-                    std::cout << "Progress: " << (100 * j / height) << "%\r" << std::flush;
-                }
-            }
-            
-            for (int i = 0; i < width; i++) {
-                double u = double(i) / (width - 1);
-                double v = double(height - 1 - j) / (height - 1);
-                
-                Ray ray = camera.getRay(u, v, aspect_ratio);
-                Color pixel_color = scene.trace(ray);
-                pixel_color = clamp(pixel_color);
-                
-                Uint8 r = Uint8(255.99 * pixel_color.x);
-                Uint8 g = Uint8(255.99 * pixel_color.y);
-                Uint8 b = Uint8(255.99 * pixel_color.z);
-                
-                pixels[j * width + i] = (0xFF << 24) | (r << 16) | (g << 8) | b;
-            }
-        }
-        
-        auto end_time = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
-        
-        std::cout << "Progress: 100% - Done!     " << std::endl;
-        std::cout << "Render time: " << (duration.count() / 1000.0) << " seconds" << std::endl;
-        
-        // Calculate rays per second
-        long total_rays = width * height;
-        double rays_per_sec = total_rays / (duration.count() / 1000.0);
-        std::cout << "Throughput: " << (rays_per_sec / 1000000.0) << " Mrays/sec" << std::endl;
-        
-        SDL_UpdateTexture(texture, nullptr, pixels, width * sizeof(Uint32));
-        SDL_RenderClear(renderer);
-        SDL_RenderCopy(renderer, texture, nullptr, nullptr);
-        SDL_RenderPresent(renderer);
+    if ((headless || listen_port > 0 || stream) && output.empty()) {
+        output = "render.png";
     }
     
-    bool handleEvents() {
-        SDL_Event e;
-        while (SDL_PollEvent(&e)) {
-            if (e.type == SDL_QUIT) {
-                return false;
-            }
-            if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE) {
-                return false;
-            }
+    // Posters: band by band into the file, never the whole image in memory
+    if (stream) return renderStreamed(renderer, scene, camera, width, height, output, band_rows, band_buffers) ? 0 : 1;
+    
+    FrameBuffer frame(width, height, FrameBuffer::Untouched());
+    if (listen_port > 0) {
+        // The workers render; this process only deals tiles and saves the image
+        distributed::Coordinator coordinator(listen_port, min_workers, dist_tile_size);
+        if (!coordinator.render(scene, camera, distributed::makeJob(renderer, width, height, *backend), frame)) {
+            return 1;
+        }
+        if (!frame.save(output)) {
+            std::cerr << "Failed to write " << output << std::endl;
+            return 1;
         }
-        return true;
+        std::cout << "Saved " << output << std::endl;
+        return 0;
     }
-    
-    void waitForClose() {
-        std::cout << "Press ESC or close window to exit..." << std::endl;
-        bool running = true;
-        while (running) {
-            running = handleEvents();
-            SDL_Delay(16);
+    if (headless || !output.empty()) {
+        // Sampled lights average progressive frames up to --frames
+        do {
+            renderer.render(scene, camera, frame);
+        } while (renderer.refining(scene));
+        renderer.resolve(frame);
+        if (!frame.save(output)) {
+            std::cerr << "Failed to write " << output << std::endl;
+            return 1;
         }
+        std::cout << "Saved " << output << std::endl;
     }
-};
 
-int main(int argc, char* argv[]) {
-    Scene scene;
-     // Define materials
-    Material red(Color(1.0, 0.2, 0.2), 0.1, 0.7, 0.8, 64, 0.4);
-    Material green(Color(0.2, 1.0, 0.2), 0.1, 0.8, 0.6, 32, 0.2);
-    Material blue(Color(0.2, 0.2, 1.0), 0.1, 0.6, 0.9, 128, 0.6);
-    Material gold(Color(1.0, 0.84, 0.0), 0.2, 0.5, 1.0, 256, 0.5);
-    Material silver(Color(0.75, 0.75, 0.75), 0.1, 0.4, 1.0, 256, 0.8);
-    
-    // Build scene geometry
-    scene.addSphere(Sphere(Vec3(0, 0, 0), 1.0, red));
-    scene.addSphere(Sphere(Vec3(-2.5, 0, -1), 0.8, green));
-    scene.addSphere(Sphere(Vec3(2.5, 0.5, -0.5), 1.2, blue));
-    scene.addSphere(Sphere(Vec3(0, -101, 0), 100, silver));
-    scene.addSphere(Sphere(Vec3(-1, 1.5, 1), 0.5, gold));
-    
-    // Configure lighting
-    scene.addLight(Light(Vec3(-5, 5, 5), Color(1, 1, 1), 0.8));
-    scene.addLight(Light(Vec3(5, 3, 3), Color(1, 1, 1), 0.6));
-    // Setup camera
-    Camera camera(Vec3(0, 1, 5), Vec3(0, 0, 0));
-    
-    // Initialize renderer
-    int width = 800;
-    int height = 600;
-    Renderer display(width, height);
-    
-    display.render(scene, camera);
-    display.waitForClose();
+#ifndef RAYTRACER_NO_SDL
+    if (!headless) {
+        // Start from a coarse preview unless a full frame was just rendered
+        SDLDisplay display(width, height);
+        display.runInteractive(renderer, scene, camera, frame, output.empty());
+    }
+#endif
     
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,623 @@
+// Render server: one long-running process that renders cached scenes on request
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/time.h>
+
+#include "renderer.h"
+#include "scene_io.h"
+#include "distributed.h"
+
+// HTTP/1.1 with keep-alive, GET only:
+//
+//   /render?scene=ID&width=W&height=H&eye=X,Y,Z&target=X,Y,Z&up=X,Y,Z&fov=DEG&format=png|ppm
+//       the image (every parameter is optional; the camera defaults to the
+//       scene's own, the size to 320x240 and the format to PNG). The
+//       Server-Timing header gives the request's queue, render and encode
+//       times and X-Batch-Size how many requests shared its batch
+//   /metrics
+//       request, batch and scene cache counters, and latency percentiles
+//       over the last LATENCY_WINDOW renders, one "name value" per line
+//
+// Scene "default" is the one the server was started with. Any other ID names
+// DIR/ID.rtb or DIR/ID.scene in the scene directory; it is loaded and its BVH
+// built on first use, then kept until MAX_CACHED_SCENES other loaded scenes
+// have been used since
+namespace server {
+
+static const int MAX_SIDE = 2048;               // pixels per side of a requested image
+static const size_t MAX_REQUEST = 16384;        // bytes of request line and headers
+static const size_t LATENCY_WINDOW = 4096;      // renders the percentiles cover
+static const int MAX_CONNECTIONS = 256;         // open at once; more are answered 503
+static const size_t MAX_PENDING = 256;          // queued renders; more are answered 503
+static const int IDLE_TIMEOUT_S = 30;           // a connection silent this long is closed
+static const size_t MAX_CACHED_SCENES = 16;     // loaded scenes kept; the least recently used goes first
+
+// A scene ready to render, with the camera its file gave
+struct CachedScene {
+    std::unique_ptr<Scene> storage;             // null for scenes the caller owns
+    const Scene* scene;
+    Camera camera;
+    
+    CachedScene() : scene(nullptr), camera(Vec3(0, 1, 5), Vec3(0, 0, 0)) {}
+};
+
+// One /render request on its way through the queue. The dispatcher
+// allocates the target when it takes the job, so queued requests hold no
+// image memory
+struct RenderJob {
+    std::shared_ptr<const CachedScene> scene;   // keeps it alive if the cache evicts it
+    Camera camera;
+    int width, height;
+    std::unique_ptr<FrameBuffer> target;
+    std::chrono::high_resolution_clock::time_point queued;
+    double queue_ms, render_ms;
+    int batch_size;
+    bool done;
+    
+    RenderJob(const std::shared_ptr<const CachedScene>& s, const Camera& c, int w, int h)
+        : scene(s), camera(c), width(w), height(h), queue_ms(0), render_ms(0), batch_size(0), done(false) {}
+};
+
+// The most recent LATENCY_WINDOW samples of one latency, in ms
+class LatencyWindow {
+public:
+    LatencyWindow() : added(0) {}
+    
+    void add(double ms) {
+        if (samples.size() < LATENCY_WINDOW) {
+            samples.push_back(ms);
+        } else {
+            samples[added % LATENCY_WINDOW] = ms;
+        }
+        added++;
+    }
+    
+    // The q quantile (0 to 1) of the window; 0 while it is empty
+    double quantile(double q) const {
+        if (samples.empty()) return 0;
+        std::vector<double> sorted = samples;
+        size_t k = std::min(sorted.size() - 1, size_t(q * (sorted.size() - 1) + 0.5));
+        std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+        return sorted[k];
+    }
+
+private:
+    std::vector<double> samples;
+    uint64_t added;
+};
+
+struct Response {
+    int status;
+    std::string type;
+    std::string body;
+    std::string timing;         // Server-Timing value, if any
+    int batch_size;             // 0: not a render
+    
+    Response(int s, const std::string& message) : status(s), type("text/plain"), body(message + "\n"), batch_size(0) {}
+};
+
+// %XX escapes and '+' for spaces, as in query strings
+inline std::string urlDecode(const std::string& s) {
+    std::string out;
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '+') {
+            out += ' ';
+        } else if (s[i] == '%' && i + 2 < s.size() && isxdigit(uint8_t(s[i + 1])) && isxdigit(uint8_t(s[i + 2]))) {
+            out += char(strtol(s.substr(i + 1, 2).c_str(), nullptr, 16));
+            i += 2;
+        } else {
+            out += s[i];
+        }
+    }
+    return out;
+}
+
+// "a=1&b=2" -> {a: 1, b: 2}
+inline std::map<std::string, std::string> parseQuery(const std::string& query) {
+    std::map<std::string, std::string> params;
+    std::stringstream ss(query);
+    std::string pair;
+    while (std::getline(ss, pair, '&')) {
+        size_t eq = pair.find('=');
+        if (eq == std::string::npos) {
+            params[urlDecode(pair)] = "";
+        } else {
+            params[urlDecode(pair.substr(0, eq))] = urlDecode(pair.substr(eq + 1));
+        }
+    }
+    return params;
+}
+
+// "x,y,z"; false if that's not what it is
+inline bool parseVec3(const std::string& s, Vec3& v) {
+    double x, y, z;
+    char tail;
+    if (sscanf(s.c_str(), "%lf,%lf,%lf%c", &x, &y, &z, &tail) != 3) return false;
+    v = Vec3(Real(x), Real(y), Real(z));
+    return std::isfinite(x) && std::isfinite(y) && std::isfinite(z);
+}
+
+inline const char* statusText(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 431: return "Request Header Fields Too Large";
+        case 503: return "Service Unavailable";
+        default: return "Internal Server Error";
+    }
+}
+
+// NEW: Render server (--serve). Parsed scenes and their BVHs stay cached by
+// ID, and the render threads stay up, so a request costs only its own frame:
+// no process start, scene parse or BVH build. Every connection has a thread
+// that parses its requests and encodes their images; the renders themselves
+// go through one queue to a dispatcher thread, which owns the Renderer and
+// takes everything queued (up to max_batch requests) as one
+// Renderer::renderBatch(). Requests that arrive while a batch renders are
+// thus batched together, and with a batch window the dispatcher also waits
+// that long for more before it starts a batch that isn't full. Connections
+// beyond MAX_CONNECTIONS and renders beyond MAX_PENDING queued are turned
+// away with 503, and a connection idle for IDLE_TIMEOUT_S is closed
+class RenderServer {
+public:
+    RenderServer(Renderer& r, const IntersectBackend& b, const std::string& dir, int batch, double window_ms)
+        : renderer(r), backend(b), scene_dir(dir), max_batch(std::max(1, batch)),
+          batch_window_ms(std::max(0.0, window_ms)), cache_clock(0), connections(0), stopping(false), batches(0),
+          batched_frames(0), requests(0), errors(0), rejected(0), scene_loads(0), scene_evictions(0),
+          scene_load_ms(0) {}
+    
+    // Serves 'scene', which the caller keeps alive and unchanged, as 'id';
+    // it is never evicted
+    void addScene(const std::string& id, const Scene& scene, const Camera& camera) {
+        std::shared_ptr<CachedScene> s(new CachedScene());
+        s->scene = &scene;
+        s->camera = camera;
+        std::lock_guard<std::mutex> guard(cache_lock);
+        CacheEntry& entry = cache[id];
+        entry.scene = s;
+        entry.loading = false;
+        entry.last_used = ++cache_clock;
+    }
+    
+    // Accepts connections on 'port' until listening fails; returns the
+    // process exit status
+    int run(int port) {
+        int fd = distributed::listenOn(port);
+        if (fd < 0) {
+            std::cerr << "Cannot listen on port " << port << std::endl;
+            return 1;
+        }
+        renderer.setVerbose(false);
+        std::cout << "Serving on port " << port << ": " << renderer.threadPool().size()
+                  << " render threads, batches of up to " << max_batch << " requests, scenes from "
+                  << scene_dir << "/" << std::endl;
+        
+        std::thread dispatcher([this]() { dispatch(); });
+        while (true) {
+            int client = accept(fd, nullptr, nullptr);
+            if (client < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                std::cerr << "accept() failed: " << strerror(errno) << std::endl;
+                break;
+            }
+            {
+                std::lock_guard<std::mutex> guard(connection_lock);
+                if (connections >= MAX_CONNECTIONS) {
+                    // The accept loop can't wait on a client: this small
+                    // reply fits the new socket's send buffer
+                    static const char busy[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Type: text/plain\r\n"
+                                               "Content-Length: 17\r\nConnection: close\r\n\r\nToo many clients\n";
+                    send(client, busy, sizeof(busy) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+                    close(client);
+                    std::lock_guard<std::mutex> m(metrics_lock);
+                    rejected++;
+                    continue;
+                }
+                connections++;
+            }
+            int one = 1;
+            setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            timeval idle = {IDLE_TIMEOUT_S, 0};
+            setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof(idle));
+            setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &idle, sizeof(idle));
+            std::thread([this, client]() {
+                serve(client);
+                std::lock_guard<std::mutex> guard(connection_lock);
+                connections--;
+            }).detach();
+        }
+        
+        {
+            std::lock_guard<std::mutex> guard(queue_lock);
+            stopping = true;
+            queue_changed.notify_all();
+        }
+        dispatcher.join();
+        close(fd);
+        return 1;
+    }
+
+private:
+    typedef std::chrono::high_resolution_clock Clock;
+    
+    Renderer& renderer;                 // the dispatcher's alone
+    const IntersectBackend& backend;
+    std::string scene_dir;
+    int max_batch;
+    double batch_window_ms;
+    
+    // Scenes by ID. A load runs without the lock, under an entry marked
+    // loading: other requests for that ID wait for it rather than load the
+    // scene again, and requests for other scenes don't wait at all
+    struct CacheEntry {
+        std::shared_ptr<const CachedScene> scene;   // null while loading
+        bool loading;
+        uint64_t last_used;                         // cache_clock at the last lookup
+        
+        CacheEntry() : loading(false), last_used(0) {}
+    };
+    std::mutex cache_lock;
+    std::condition_variable scene_loaded;   // a load finished or failed
+    std::map<std::string, CacheEntry> cache;
+    uint64_t cache_clock;
+    
+    std::mutex connection_lock;
+    int connections;                    // open ones, each with a serve() thread
+    
+    // Requests waiting for the dispatcher, oldest first
+    std::mutex queue_lock;
+    std::condition_variable queue_changed;  // a request queued, or stopping
+    std::condition_variable job_done;       // a batch finished
+    std::deque<RenderJob*> pending;
+    bool stopping;
+    uint64_t batches, batched_frames;
+    
+    std::mutex metrics_lock;            // also keeps log lines whole
+    uint64_t requests, errors, rejected, scene_loads, scene_evictions;
+    double scene_load_ms;
+    LatencyWindow total_ms, queue_ms, render_ms, encode_ms;
+    
+    static double msSince(Clock::time_point t) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - t).count();
+    }
+    
+    // Renders queued requests a batch at a time until stopping
+    void dispatch() {
+        std::unique_lock<std::mutex> guard(queue_lock);
+        while (true) {
+            queue_changed.wait(guard, [&]() { return !pending.empty() || stopping; });
+            if (pending.empty()) return;
+            if (batch_window_ms > 0 && int(pending.size()) < max_batch) {
+                queue_changed.wait_for(guard, std::chrono::duration<double, std::milli>(batch_window_ms),
+                                       [&]() { return int(pending.size()) >= max_batch || stopping; });
+            }
+            std::vector<RenderJob*> jobs;
+            while (!pending.empty() && int(jobs.size()) < max_batch) {
+                jobs.push_back(pending.front());
+                pending.pop_front();
+            }
+            guard.unlock();
+            
+            Clock::time_point start = Clock::now();
+            std::vector<Renderer::BatchFrame> batch;
+            for (RenderJob* job : jobs) {
+                job->queue_ms = std::chrono::duration<double, std::milli>(start - job->queued).count();
+                job->target.reset(new FrameBuffer(job->width, job->height, FrameBuffer::Untouched()));
+                Renderer::BatchFrame f = {job->scene->scene, job->camera.prepare(job->width, job->height),
+                                          job->target.get()};
+                batch.push_back(f);
+            }
+            renderer.renderBatch(batch);
+            double ms = msSince(start);
+            
+            guard.lock();
+            for (RenderJob* job : jobs) {
+                job->render_ms = ms;
+                job->batch_size = int(jobs.size());
+                job->done = true;
+            }
+            batches++;
+            batched_frames += jobs.size();
+            job_done.notify_all();
+        }
+    }
+    
+    // The scene called 'id', loaded into the cache if it isn't yet; null
+    // (with the reason in 'error') if there is no such scene
+    std::shared_ptr<const CachedScene> findScene(const std::string& id, std::string& error) {
+        bool valid = !id.empty();
+        for (char c : id) valid = valid && (isalnum(uint8_t(c)) || c == '_' || c == '-');
+        if (!valid) {
+            error = "Scene IDs are letters, digits, '_' and '-'";
+            return nullptr;
+        }
+        
+        std::unique_lock<std::mutex> guard(cache_lock);
+        while (true) {
+            auto found = cache.find(id);
+            if (found == cache.end()) break;
+            if (!found->second.loading) {
+                found->second.last_used = ++cache_clock;
+                return found->second.scene;
+            }
+            scene_loaded.wait(guard);
+        }
+        cache[id].loading = true;
+        guard.unlock();
+        
+        std::shared_ptr<CachedScene> loaded = loadFromDir(id, error);
+        
+        guard.lock();
+        if (!loaded) {
+            cache.erase(id);
+        } else {
+            CacheEntry& entry = cache[id];
+            entry.scene = loaded;
+            entry.loading = false;
+            entry.last_used = ++cache_clock;
+            evictScenes();
+        }
+        scene_loaded.notify_all();
+        return loaded;
+    }
+    
+    // Loads DIR/ID.rtb or DIR/ID.scene and builds its BVH; called without
+    // cache_lock
+    std::shared_ptr<CachedScene> loadFromDir(const std::string& id, std::string& error) {
+        const char* extensions[2] = {".rtb", ".scene"};
+        for (const char* ext : extensions) {
+            std::string path = scene_dir + "/" + id + ext;
+            if (!std::ifstream(path)) continue;
+            
+            Clock::time_point start = Clock::now();
+            std::shared_ptr<CachedScene> s(new CachedScene());
+            s->storage.reset(new Scene());
+            s->storage->setBackend(backend);
+            if (!loadScene(path, *s->storage, &s->camera)) {
+                error = "Cannot load scene " + id;
+                return nullptr;
+            }
+            if (s->storage->bvh.empty()) s->storage->buildBVH();
+            s->scene = s->storage.get();
+            double ms = msSince(start);
+            std::lock_guard<std::mutex> m(metrics_lock);
+            scene_loads++;
+            scene_load_ms += ms;
+            std::cout << "Loaded scene " << id << " from " << path << ": " << s->scene->soa.size()
+                      << " spheres in " << ms << " ms" << std::endl;
+            return s;
+        }
+        error = "No scene " + id + " in " + scene_dir;
+        return nullptr;
+    }
+    
+    // Drops the least recently used loaded scenes beyond MAX_CACHED_SCENES;
+    // renders still using one keep it alive until they finish. Scenes the
+    // caller added stay. Called with cache_lock held
+    void evictScenes() {
+        while (true) {
+            size_t owned = 0;
+            auto oldest = cache.end();
+            for (auto e = cache.begin(); e != cache.end(); ++e) {
+                if (e->second.loading || !e->second.scene->storage) continue;
+                owned++;
+                if (oldest == cache.end() || e->second.last_used < oldest->second.last_used) oldest = e;
+            }
+            if (owned <= MAX_CACHED_SCENES) return;
+            {
+                std::lock_guard<std::mutex> m(metrics_lock);
+                scene_evictions++;
+                std::cout << "Evicted scene " << oldest->first << std::endl;
+            }
+            cache.erase(oldest);
+        }
+    }
+    
+    Response handleRender(const std::map<std::string, std::string>& params) {
+        auto get = [&](const char* name, const std::string& fallback) {
+            auto p = params.find(name);
+            return p == params.end() ? fallback : p->second;
+        };
+        int width = atoi(get("width", "320").c_str());
+        int height = atoi(get("height", "240").c_str());
+        if (width < 1 || height < 1 || width > MAX_SIDE || height > MAX_SIDE) {
+            return Response(400, "width and height must be 1 to " + std::to_string(MAX_SIDE));
+        }
+        std::string format = get("format", "png");
+        if (format != "png" && format != "ppm") return Response(400, "format must be png or ppm");
+        
+        std::string error;
+        std::shared_ptr<const CachedScene> cached = findScene(get("scene", "default"), error);
+        if (!cached) return Response(404, error);
+        
+        Camera camera = cached->camera;
+        const char* vectors[3] = {"eye", "target", "up"};
+        Vec3* fields[3] = {&camera.position, &camera.target, &camera.up};
+        for (int v = 0; v < 3; v++) {
+            if (params.count(vectors[v]) && !parseVec3(params.at(vectors[v]), *fields[v])) {
+                return Response(400, std::string(vectors[v]) + " must be x,y,z");
+            }
+        }
+        if (params.count("fov")) camera.fov = Real(atof(params.at("fov").c_str()));
+        if (!(camera.fov > 0 && camera.fov < 180)) return Response(400, "fov must be between 0 and 180 degrees");
+        Vec3 view = camera.target - camera.position;
+        if (view.dot(view) == 0 || view.cross(camera.up).dot(view.cross(camera.up)) == 0) {
+            return Response(400, "eye, target and up don't make a camera");
+        }
+        
+        RenderJob job(cached, camera, width, height);
+        {
+            std::unique_lock<std::mutex> guard(queue_lock);
+            if (pending.size() >= MAX_PENDING) return Response(503, "Too many renders queued; try again later");
+            job.queued = Clock::now();
+            pending.push_back(&job);
+            queue_changed.notify_all();
+            job_done.wait(guard, [&]() { return job.done; });
+        }
+        
+        Clock::time_point start = Clock::now();
+        char* image = nullptr;
+        size_t image_size = 0;
+        FILE* f = open_memstream(&image, &image_size);
+        if (!f) return Response(500, "Out of memory");
+        if (format == "png") {
+            job.target->writePNG(f);
+        } else {
+            job.target->writePPM(f);
+        }
+        fclose(f);
+        std::unique_ptr<char, void (*)(void*)> image_owner(image, free);
+        double encode = msSince(start);
+        
+        Response r(200, "");
+        r.type = format == "png" ? "image/png" : "image/x-portable-pixmap";
+        r.body.assign(image, image_size);
+        char timing[128];
+        snprintf(timing, sizeof(timing), "queue;dur=%.3f, render;dur=%.3f, encode;dur=%.3f", job.queue_ms,
+                 job.render_ms, encode);
+        r.timing = timing;
+        r.batch_size = job.batch_size;
+        std::lock_guard<std::mutex> guard(metrics_lock);
+        queue_ms.add(job.queue_ms);
+        render_ms.add(job.render_ms);
+        encode_ms.add(encode);
+        return r;
+    }
+    
+    Response handleMetrics() {
+        std::ostringstream out;
+        size_t cached;
+        {
+            std::lock_guard<std::mutex> guard(cache_lock);
+            cached = cache.size();
+        }
+        {
+            std::lock_guard<std::mutex> guard(queue_lock);
+            out << "batches " << batches << "\n";
+            out << "frames_per_batch " << (batches ? double(batched_frames) / batches : 0.0) << "\n";
+            out << "queued " << pending.size() << "\n";
+        }
+        std::lock_guard<std::mutex> guard(metrics_lock);
+        out << "requests " << requests << "\n";
+        out << "errors " << errors << "\n";
+        out << "rejected_connections " << rejected << "\n";
+        out << "scenes_cached " << cached << "\n";
+        out << "scene_loads " << scene_loads << "\n";
+        out << "scene_evictions " << scene_evictions << "\n";
+        out << "scene_load_ms " << scene_load_ms << "\n";
+        const char* names[4] = {"total", "queue", "render", "encode"};
+        const LatencyWindow* windows[4] = {&total_ms, &queue_ms, &render_ms, &encode_ms};
+        const double quantiles[4] = {0.5, 0.9, 0.99, 1.0};
+        for (int w = 0; w < 4; w++) {
+            for (double q : quantiles) {
+                out << "latency_ms{stage=\"" << names[w] << "\",quantile=\"" << q << "\"} " << windows[w]->quantile(q)
+                    << "\n";
+            }
+        }
+        Response r(200, "");
+        r.body = out.str();
+        return r;
+    }
+    
+    Response handle(const std::string& method, const std::string& target) {
+        if (method != "GET") return Response(405, "Only GET is supported");
+        size_t question = target.find('?');
+        std::string path = target.substr(0, question);
+        std::map<std::string, std::string> params;
+        if (question != std::string::npos) params = parseQuery(target.substr(question + 1));
+        if (path == "/render") return handleRender(params);
+        if (path == "/metrics") return handleMetrics();
+        return Response(404, "Try /render or /metrics");
+    }
+    
+    // Answers the requests of one connection until it closes
+    void serve(int client) {
+        std::string buffer;
+        bool keep_alive = true;
+        while (keep_alive) {
+            size_t end;
+            bool too_large = false;
+            while ((end = buffer.find("\r\n\r\n")) == std::string::npos && !too_large) {
+                char chunk[4096];
+                ssize_t got = recv(client, chunk, sizeof(chunk), 0);
+                if (got < 0 && errno == EINTR) continue;
+                if (got <= 0) {
+                    close(client);
+                    return;
+                }
+                buffer.append(chunk, size_t(got));
+                too_large = buffer.size() > MAX_REQUEST;
+            }
+            Clock::time_point start = Clock::now();
+            
+            std::string method, target, version;
+            if (!too_large) {
+                std::istringstream head(buffer.substr(0, end));
+                buffer.erase(0, end + 4);
+                std::string line;
+                std::getline(head, line);
+                std::istringstream(line) >> method >> target >> version;
+                keep_alive = version == "HTTP/1.1";
+                while (std::getline(head, line)) {
+                    std::string lower = line;
+                    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+                    if (lower.compare(0, 11, "connection:") == 0) {
+                        if (lower.find("close") != std::string::npos) keep_alive = false;
+                        if (lower.find("keep-alive") != std::string::npos) keep_alive = true;
+                    }
+                }
+            }
+            
+            // Bodies aren't read, so nothing but a GET can keep the connection
+            Response r = too_large ? Response(431, "Request too large") : handle(method, target);
+            keep_alive = keep_alive && method == "GET" && !too_large;
+            std::ostringstream head;
+            head << "HTTP/1.1 " << r.status << " " << statusText(r.status) << "\r\n"
+                 << "Content-Type: " << r.type << "\r\n"
+                 << "Content-Length: " << r.body.size() << "\r\n";
+            if (!r.timing.empty()) head << "Server-Timing: " << r.timing << "\r\n";
+            if (r.batch_size > 0) head << "X-Batch-Size: " << r.batch_size << "\r\n";
+            if (!keep_alive) head << "Connection: close\r\n";
+            head << "\r\n";
+            std::string header = head.str();
+            bool sent = distributed::sendAll(client, header.data(), header.size()) &&
+                        distributed::sendAll(client, r.body.data(), r.body.size());
+            double ms = msSince(start);
+            
+            {
+                std::lock_guard<std::mutex> guard(metrics_lock);
+                requests++;
+                errors += r.status >= 400;
+                if (r.batch_size > 0) total_ms.add(ms);
+                std::cout << method << " " << target << " " << r.status << " " << ms << " ms";
+                if (r.batch_size > 0) std::cout << " (" << r.timing << ", batch of " << r.batch_size << ")";
+                std::cout << std::endl;
+            }
+            if (!sent) break;
+        }
+        close(client);
+    }
+};
+    
+} // namespace server
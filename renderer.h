@@ -0,0 +1,781 @@
+// Tile-parallel render loop; writes into a FrameBuffer and knows nothing about SDL
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <cmath>
+#include <functional>
+#include <mutex>
+#include <omp.h>
+
+#include "scene.h"
+#include "packet_tracer.h"
+#include "camera.h"
+#include "tile_scheduler.h"
+#include "framebuffer.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "dirty_region.h"
+#include "gbuffer.h"
+#include "device_tracer.h"
+
+enum class TraceMode {
+    Single,     // one ray at a time through Scene::trace
+    Packet,     // 4x2 primary packets, reflections regrouped into streams
+    Device      // whole frames as one OpenMP target kernel (DeviceTracer)
+};
+
+class Renderer {
+private:
+    TraceMode mode;
+    TraceSettings trace_settings;
+    bool specialized_kernels;       // Scene::kernelFor() instead of the generic kernel
+    Scene::TraceKernel kernel;      // this frame's, for single rays
+    int tile_size;
+    TileOrder tile_order;
+    bool verbose;
+    bool print_stats;
+    RenderStats last_stats;         // measured by the last render()
+    
+    // NEW: Progressive accumulation for stochastic light sampling. Frames of
+    // the same view are summed unclamped in the target's linear image
+    // (FrameBuffer::linear), which shows their mean
+    int accumulated;                // frames summed in the target
+    int max_frames;                 // frames averaged before the image is final
+    bool accumulating;              // this frame adds to the target's sum
+    const Scene* accumulated_scene;
+    uint64_t accumulated_edit;      // the scene's edit version the sum started at
+    CameraFrame accumulated_view;
+    
+    // NEW: Adaptive antialiasing. The first pass keeps each pixel's color and
+    // first hit; pixels on an edge then get an aa_grid x aa_grid subpixel grid
+    int aa_grid;                    // 0 or 1: off
+    Real aa_threshold;              // per-channel contrast that marks an edge
+    bool antialiasing;              // this frame takes the extra pass
+    std::vector<Color> frame_color; // first-pass colors
+    std::vector<int> frame_hit;     // SoA slot of the first hit, -1 for a miss
+    std::vector<uint8_t> edge;
+    
+    // NEW: Incremental re-renders (setIncremental). What the last exact
+    // full-resolution frame was rendered from. If the next one differs only
+    // by scene edits and goes to the same, untouched target, it re-traces
+    // just the tiles those edits can have changed (DirtyTiles); the others,
+    // what their paths depend on and antialiasing's first-pass data for
+    // them are kept
+    bool incremental;
+    bool recording;                 // this frame records its paths
+    std::vector<PathBounds> cell_paths;
+    int path_tiles_x;
+    struct RenderedFrame {
+        uint64_t id;                // the target's FrameBuffer::render_id; 0: none
+        const Scene* scene;
+        const IntersectBackend* backend;
+        uint64_t edit_version, layout_version;
+        CameraFrame view;
+        TraceSettings settings;
+        TraceMode mode;
+        Scene::TraceKernel kernel;
+        int tile_size, aa_grid;
+        Real aa_threshold;
+    };
+    RenderedFrame last_frame;
+    
+    // NEW: Primary-hit cache (setPrimaryCache). Full-resolution frames whose
+    // view and geometry match the G-buffer shade from it; the others fill it
+    bool primary_cache;
+    GBuffer gbuffer;
+    bool reuse_hits, store_hits;    // this frame reads / writes the G-buffer
+    
+    // NEW: Device frames (TraceMode::Device). Exact full-resolution frames
+    // are traced by the DeviceTracer's kernel and written out by the render
+    // threads; previews, light-sampled frames and antialiasing's edge pixels
+    // stay on the CPU single-ray path, and device frames aren't recorded for
+    // incremental re-renders or the G-buffer
+    DeviceTracer device;
+    bool on_device;                 // this frame is traced by 'device'
+    std::vector<Color> device_colors;
+    
+    // Render threads, kept from frame to frame; sized by OpenMP's thread
+    // count (OMP_NUM_THREADS, omp_set_num_threads) and recreated if it changes
+    std::unique_ptr<ThreadPool> pool;
+    bool pin_threads;
+    bool replicate_scene;           // per-node scene copies (Scene::replicate)
+    
+    // What paths depend on is recorded per PATH_CELL x PATH_CELL pixels, in
+    // cells of their own per tile; the tiles are in DirtyTiles::mask() order
+    static const int PATH_CELL = 4;
+    
+    int cellsPerTile() const {
+        int per_row = (tile_size + PATH_CELL - 1) / PATH_CELL;
+        return per_row * per_row;
+    }
+    
+    PathBounds* pathsOf(int i, int j) {
+        int tx = i / tile_size, ty = j / tile_size;
+        int per_row = (tile_size + PATH_CELL - 1) / PATH_CELL;
+        size_t cell = (size_t(ty) * path_tiles_x + tx) * cellsPerTile() +
+                      ((j - ty * tile_size) / PATH_CELL) * per_row + (i - tx * tile_size) / PATH_CELL;
+        return &cell_paths[cell];
+    }
+    
+    // Every pixel write goes through here; antialiased frames hold them back
+    // until the edge pixels have been refined
+    void writePixel(FrameBuffer& target, int idx, const Color& color) {
+        if (antialiasing) {
+            frame_color[idx] = color;
+            return;
+        }
+        presentPixel(target, idx, color);
+    }
+    
+    // Into the linear image; FrameBuffer::resolve() quantizes it later
+    void presentPixel(FrameBuffer& target, int idx, const Color& color) {
+        if (accumulating && accumulated > 0) {
+            target.addLinear(idx, color);
+        } else {
+            target.setLinear(idx, color);
+        }
+    }
+    
+    // Distinct across renderers, so a target can't be mistaken for another's
+    static uint64_t nextRenderId() {
+        static std::atomic<uint64_t> last(0);
+        return ++last;
+    }
+    
+    RenderedFrame describe(const Scene& scene, const CameraFrame& frame) const {
+        RenderedFrame f;
+        f.id = 0;
+        f.scene = &scene;
+        f.backend = &scene.intersectBackend();
+        f.edit_version = scene.editVersion();
+        f.layout_version = scene.layoutVersion();
+        f.view = frame;
+        f.settings = trace_settings;
+        f.mode = mode;
+        f.kernel = kernel;
+        f.tile_size = tile_size;
+        f.aa_grid = aa_grid;
+        f.aa_threshold = aa_threshold;
+        return f;
+    }
+    
+    // Whether b reproduces a's untouched pixels exactly. First hits are SoA
+    // slots, so antialiased frames also need the slot order unchanged
+    static bool sameFrame(const RenderedFrame& a, const RenderedFrame& b) {
+        const TraceSettings& sa = a.settings;
+        const TraceSettings& sb = b.settings;
+        bool same = a.scene == b.scene && a.backend == b.backend && a.view.sameRays(b.view) && a.mode == b.mode &&
+                    a.kernel == b.kernel &&
+                    a.tile_size == b.tile_size && a.aa_grid == b.aa_grid && a.aa_threshold == b.aa_threshold &&
+                    sa.max_depth == sb.max_depth && sa.min_weight == sb.min_weight &&
+                    sa.roulette_weight == sb.roulette_weight && sa.light_cutoff == sb.light_cutoff &&
+                    sa.light_samples == sb.light_samples && sa.fast_shading == sb.fast_shading;
+        return same && (a.aa_grid <= 1 || a.layout_version == b.layout_version);
+    }
+    
+    // One ray at a time through Scene::trace, with the frame's trace kernel
+    void renderTile(const Scene& scene, const CameraFrame& frame, const Tile& tile, FrameBuffer& target,
+                    Scene::TraceKernel trace_kernel) {
+        std::vector<Vec3> dirs(tile.pixelCount());
+        {
+            PROFILE_STAGE(STAGE_RAY_GEN);
+            frame.generateRays(tile, dirs.data());
+        }
+        
+        const Vec3* dir = dirs.data();
+        for (int j = tile.y0; j < tile.y1; j++) {
+            for (int i = tile.x0; i < tile.x1; i++) {
+                int idx = j * target.width + i;
+                Ray ray(frame.origin, *dir++, Ray::Normalized());
+                PrimaryHit hit;
+                if (reuse_hits) {
+                    hit = gbuffer[idx];
+                    threadCounters().primary_cached++;
+                } else {
+                    hit = scene.firstHit(ray);
+                    if (store_hits) gbuffer[idx] = hit;
+                }
+                if (antialiasing) frame_hit[idx] = hit.slot;
+                Color color = (scene.*trace_kernel)(ray, hit, trace_settings, frame.seed(i, j), recording ? pathsOf(i, j) : nullptr);
+                
+                PROFILE_STAGE(STAGE_WRITE);
+                writePixel(target, idx, color);
+            }
+        }
+    }
+    
+    // Preview: one ray per scale x scale block, splatted over the whole block
+    void renderTileScaled(const Scene& scene, const CameraFrame& frame, const Tile& tile, int scale, FrameBuffer& target) {
+        for (int j = tile.y0; j < tile.y1; j += scale) {
+            for (int i = tile.x0; i < tile.x1; i += scale) {
+                int idx = j * target.width + i;
+                target.setPixel(idx, scene.trace(frame.ray(i, j), trace_settings, frame.seed(i, j)));
+                
+                uint32_t packed = target.pixels[idx];
+                int x1 = std::min(i + scale, tile.x1);
+                int y1 = std::min(j + scale, tile.y1);
+                for (int y = j; y < y1; y++) {
+                    std::fill(target.pixels.begin() + y * target.width + i,
+                              target.pixels.begin() + y * target.width + x1, packed);
+                }
+            }
+        }
+    }
+    
+    // The tile as 4x2 pixel packets, with its reflections as one stream
+    void renderTilePackets(const Scene& scene, const CameraFrame& frame, const Tile& tile, FrameBuffer& target) {
+        int tw = tile.width();
+        std::vector<Vec3> dirs(tile.pixelCount());
+        std::vector<StreamRay> stream;
+        std::vector<PathBounds*> paths(recording ? tile.pixelCount() : 0);
+        
+        {
+            PROFILE_STAGE(STAGE_RAY_GEN);
+            frame.generateRays(tile, dirs.data());
+            stream.reserve(tile.pixelCount());
+            for (int j0 = 0; j0 < tile.height(); j0 += 2) {
+                for (int i0 = 0; i0 < tw; i0 += 4) {
+                    for (int k = 0; k < 8; k++) {
+                        int i = i0 + (k & 3);
+                        int j = j0 + (k >> 2);
+                        if (i >= tw || j >= tile.height()) continue;
+                        
+                        StreamRay r;
+                        r.origin = frame.origin;
+                        r.direction = dirs[j * tw + i];
+                        r.weight = 1.0;
+                        r.pixel = j * tw + i;
+                        r.depth = 0;
+                        r.seed = frame.seed(tile.x0 + i, tile.y0 + j);
+                        stream.push_back(r);
+                        if (recording) paths[r.pixel] = pathsOf(tile.x0 + i, tile.y0 + j);
+                    }
+                }
+            }
+        }
+        
+        std::vector<Color> accum(tile.pixelCount(), Color(0, 0, 0));
+        std::vector<int> hits(antialiasing ? tile.pixelCount() : 0);
+        std::vector<PrimaryHit> first(reuse_hits || store_hits ? tile.pixelCount() : 0);
+        if (reuse_hits) {
+            for (int j = 0; j < tile.height(); j++) {
+                std::copy(&gbuffer[(tile.y0 + j) * target.width + tile.x0],
+                          &gbuffer[(tile.y0 + j) * target.width + tile.x0] + tw, first.begin() + j * tw);
+            }
+        }
+        PacketTracer tracer(scene, trace_settings);
+        tracer.trace(stream, accum.data(), antialiasing ? hits.data() : nullptr, recording ? paths.data() : nullptr,
+                     first.empty() ? nullptr : first.data(), reuse_hits);
+        
+        PROFILE_STAGE(STAGE_WRITE);
+        for (int j = 0; j < tile.height(); j++) {
+            for (int i = 0; i < tw; i++) {
+                int idx = (tile.y0 + j) * target.width + tile.x0 + i;
+                if (antialiasing) frame_hit[idx] = hits[j * tw + i];
+                if (store_hits) gbuffer[idx] = first[j * tw + i];
+                writePixel(target, idx, accum[j * tw + i]);
+            }
+        }
+    }
+    
+    // Whether neighbouring pixels a and b straddle an edge: different first
+    // hits (a silhouette, or sphere against sphere) or visible contrast
+    bool differs(int a, int b) const {
+        if (frame_hit[a] != frame_hit[b]) return true;
+        Color ca = clamp(frame_color[a]), cb = clamp(frame_color[b]);
+        Real contrast = std::max(std::max(std::fabs(ca.x - cb.x), std::fabs(ca.y - cb.y)), std::fabs(ca.z - cb.z));
+        return contrast > aa_threshold;
+    }
+    
+    // Marks the tile's edge pixels (both sides of every edge); returns how many
+    int markEdges(const Tile& tile, int width, int height) {
+        int marked = 0;
+        for (int j = tile.y0; j < tile.y1; j++) {
+            for (int i = tile.x0; i < tile.x1; i++) {
+                int idx = j * width + i;
+                bool e = (i > 0 && differs(idx, idx - 1)) || (i + 1 < width && differs(idx, idx + 1)) ||
+                         (j > 0 && differs(idx, idx - width)) || (j + 1 < height && differs(idx, idx + width));
+                edge[idx] = e;
+                marked += e;
+            }
+        }
+        return marked;
+    }
+    
+    // Presents the tile's edge pixels as the mean of an aa_grid x aa_grid grid
+    // of subpixel samples, leaving frame_color to the first pass. Sample s of
+    // a pixel is seeded seed + s * pixels, so sample 0 repeats the first
+    // pass's decisions and the rest are all distinct
+    void renderTileAA(const Scene& scene, const CameraFrame& frame, const Tile& tile, FrameBuffer& target) {
+        int width = target.width;
+        std::vector<int> marked;
+        for (int j = tile.y0; j < tile.y1; j++) {
+            for (int i = tile.x0; i < tile.x1; i++) {
+                if (edge[j * width + i]) marked.push_back(j * width + i);
+            }
+        }
+        if (marked.empty()) return;
+        
+        int n = aa_grid;
+        uint32_t pixel_count = frame.imagePixels();
+        std::vector<Color> sum(marked.size(), Color(0, 0, 0));
+        std::vector<PathBounds*> paths(recording ? marked.size() : 0);
+        for (size_t e = 0; e < paths.size(); e++) paths[e] = pathsOf(marked[e] % width, marked[e] / width);
+        auto subpixel = [&](int idx, int s) {
+            return frame.subpixelDirection(idx % width, idx / width, (s % n + Real(0.5)) / n, (s / n + Real(0.5)) / n);
+        };
+        
+        if (mode == TraceMode::Packet) {
+            // A pixel's samples are adjacent in the stream, so packets stay coherent
+            std::vector<StreamRay> stream;
+            {
+                PROFILE_STAGE(STAGE_RAY_GEN);
+                stream.reserve(marked.size() * n * n);
+                for (size_t e = 0; e < marked.size(); e++) {
+                    for (int s = 0; s < n * n; s++) {
+                        StreamRay r;
+                        r.origin = frame.origin;
+                        r.direction = subpixel(marked[e], s);
+                        r.weight = 1.0;
+                        r.pixel = int(e);
+                        r.depth = 0;
+                        r.seed = frame.seed(marked[e] % width, marked[e] / width) + uint32_t(s) * pixel_count;
+                        stream.push_back(r);
+                    }
+                }
+            }
+            PacketTracer tracer(scene, trace_settings);
+            tracer.trace(stream, sum.data(), nullptr, recording ? paths.data() : nullptr);
+        } else {
+            for (size_t e = 0; e < marked.size(); e++) {
+                for (int s = 0; s < n * n; s++) {
+                    Ray ray(frame.origin, subpixel(marked[e], s), Ray::Normalized());
+                    uint32_t seed = frame.seed(marked[e] % width, marked[e] / width) + uint32_t(s) * pixel_count;
+                    sum[e] = sum[e] + (scene.*kernel)(ray, scene.firstHit(ray), trace_settings, seed,
+                                                      recording ? paths[e] : nullptr);
+                }
+            }
+        }
+        
+        Real inv = Real(1) / (n * n);
+        PROFILE_STAGE(STAGE_WRITE);
+        for (size_t e = 0; e < marked.size(); e++) presentPixel(target, marked[e], sum[e] * inv);
+    }
+
+public:
+    Renderer()
+        : mode(TraceMode::Single), specialized_kernels(true), kernel(&Scene::traceKernel<0, true>), tile_size(16), tile_order(TileOrder::Hilbert), verbose(true), print_stats(false),
+          accumulated(0), max_frames(64), accumulating(false), accumulated_scene(nullptr), accumulated_edit(0),
+          aa_grid(0), aa_threshold(0.1), antialiasing(false), incremental(false), recording(false), path_tiles_x(0),
+          primary_cache(false), reuse_hits(false), store_hits(false), on_device(false), pin_threads(true),
+          replicate_scene(false) {
+        last_frame.id = 0;
+    }
+    
+    // Packets and single rays may round a hit differently
+    void setTraceMode(TraceMode m) {
+        if (m != mode) gbuffer.clear();
+        mode = m;
+    }
+    void setTraceSettings(const TraceSettings& s) { trace_settings = s; }
+    
+    // Single rays go through the scene's specialized trace kernel; off, the
+    // generic one (for comparison; see Scene::kernelFor())
+    void setSpecializedKernels(bool on) { specialized_kernels = on; }
+    void setTileSize(int size) { tile_size = std::max(1, size); }
+    void setTileOrder(TileOrder order) { tile_order = order; }
+    void setVerbose(bool v) { verbose = v; }
+    void setPrintStats(bool p) { print_stats = p; }
+    void setMaxFrames(int frames) { max_frames = std::max(1, frames); }
+    void setThreadPinning(bool pin) { pin_threads = pin; }
+    void setSceneReplication(bool r) { replicate_scene = r; }
+    
+    // Exact frames after scene edits re-trace only the tiles the edits can
+    // have changed; off by default
+    void setIncremental(bool on) { incremental = on; }
+    bool incrementalRendering() const { return incremental; }
+    
+    // Keeps every pixel's first hit (GBuffer), so frames that change only
+    // lighting or materials skip primary intersection; off by default.
+    // Costs one PrimaryHit per pixel
+    void setPrimaryCache(bool on) {
+        primary_cache = on;
+        if (!on) gbuffer.clear();
+    }
+    bool primaryCache() const { return primary_cache; }
+    
+    // grid x grid samples on edge pixels (0 or 1: one sample everywhere). An
+    // edge is a change of first hit or a channel contrast above 'threshold';
+    // a negative threshold marks every pixel, i.e. plain supersampling
+    void setAntialiasing(int grid, Real threshold = 0.1) {
+        aa_grid = std::max(0, grid);
+        aa_threshold = threshold;
+    }
+    
+    TraceMode traceMode() const { return mode; }
+    const TraceSettings& traceSettings() const { return trace_settings; }
+    int tileSize() const { return tile_size; }
+    int maxFrames() const { return max_frames; }
+    int antialiasingGrid() const { return aa_grid; }
+    Real antialiasingThreshold() const { return aa_threshold; }
+    
+    const RenderStats& stats() const { return last_stats; }
+    
+    // One frame of a renderBatch(): the whole image of 'frame' into 'target'
+    struct BatchFrame {
+        const Scene* scene;
+        CameraFrame frame;
+        FrameBuffer* target;
+    };
+    
+    // Where TraceMode::Device frames run
+    std::string deviceName() const { return device.describe(); }
+    
+    // The render threads, started on first use
+    ThreadPool& threadPool() {
+        int threads = omp_get_max_threads();
+        if (!pool || pool->size() != threads || pool->pinned() != pin_threads) {
+            pool.reset();
+            pool.reset(new ThreadPool(threads, pin_threads));
+        }
+        return *pool;
+    }
+    
+    // Progressive frames averaged into the current image (0 when every frame
+    // is exact). Accumulation restarts on its own when the view, the target
+    // size, the scene object or its edit version changes; call
+    // resetAccumulation() for any other reason to start over
+    int accumulatedFrames() const { return accumulated; }
+    void resetAccumulation() { accumulated = 0; }
+    
+    // Whether another full-resolution frame would still refine the image
+    bool refining(const Scene& scene) const {
+        return trace_settings.samplesLights(scene.lights.size()) && accumulated < max_frames;
+    }
+    
+    // Tonemaps the target's linear image into its pixels, split over the
+    // render threads; FrameBuffer::resolve() does it on the calling thread.
+    // Call before showing or saving a frame; a no-op if it's current
+    void resolve(FrameBuffer& target) {
+        if (target.quantized || target.linear_frames == 0) return;
+        ThreadPool& workers = threadPool();
+        workers.run([&](int thread) {
+            int begin, end;
+            ThreadPool::staticRange(target.height, thread, workers.size(), begin, end);
+            target.resolveRows(begin, end);
+        });
+        target.quantized = true;
+    }
+    
+    // Renders one frame into 'target' and returns the wall time in seconds.
+    // scale > 1 traces one ray per scale x scale block (progressive preview);
+    // only full-resolution frames are reported
+    double render(const Scene& scene, const Camera& camera, FrameBuffer& target, int scale = 1) {
+        return render(scene, camera.prepare(target.width, target.height), target, scale);
+    }
+    
+    // Renders 'frame', possibly a window of a larger image, into a target of
+    // the window's size. A window's pixels get the rays and seeds they have
+    // in the full image, so tiles rendered apart match a whole-image render
+    double render(const Scene& scene, const CameraFrame& frame, FrameBuffer& target, int scale = 1) {
+        int width = target.width;
+        int height = target.height;
+        scale = std::max(1, scale);
+        bool report = verbose && scale == 1;
+        
+        // Previews and exact frames replace the image; sampled full-resolution
+        // frames of an unchanged view add to it
+        accumulating = scale == 1 && trace_settings.samplesLights(scene.lights.size());
+        if (!accumulating || accumulated_scene != &scene || accumulated_edit != scene.editVersion() ||
+            !frame.sameRays(accumulated_view) || target.linear_frames != accumulated) {
+            accumulated = 0;
+        }
+        if (accumulating) {
+            accumulated_scene = &scene;
+            accumulated_edit = scene.editVersion();
+            accumulated_view = frame;
+        }
+        
+        // Full-resolution frames go to the linear image; previews write their
+        // 8-bit pixels directly
+        target.linear_frames = scale > 1 ? 0 : accumulating ? accumulated + 1 : 1;
+        target.quantized = scale > 1;
+        trace_settings.frame = uint32_t(accumulated);
+        kernel = specialized_kernels ? scene.kernelFor(trace_settings) : &Scene::traceKernel<0, true>;
+        
+        // Previews stay at one sample per pixel
+        ThreadPool& workers = threadPool();
+        int threads = workers.size();
+        if (replicate_scene) scene.replicate(workers);
+        antialiasing = scale == 1 && aa_grid > 1;
+        std::unique_ptr<TileScheduler> aa_scheduler;
+        if (antialiasing) {
+            frame_color.resize(target.pixels.size());
+            frame_hit.resize(target.pixels.size());
+            edge.resize(target.pixels.size());
+        }
+        
+        // Any frame overwrites the first-pass data an incremental one reuses
+        RenderedFrame previous = last_frame;
+        RenderedFrame current = describe(scene, frame);
+        last_frame.id = 0;
+        on_device = mode == TraceMode::Device && scale == 1 && !accumulating;
+        recording = incremental && scale == 1 && !accumulating && !on_device;
+        if (recording) {
+            path_tiles_x = (width + tile_size - 1) / tile_size;
+            cell_paths.resize(size_t(path_tiles_x) * ((height + tile_size - 1) / tile_size) * cellsPerTile());
+        }
+        std::unique_ptr<DirtyTiles> dirty;
+        if (recording && previous.id != 0 && target.render_id == previous.id && sameFrame(previous, current)) {
+            dirty.reset(new DirtyTiles(frame, tile_size));
+            dirty->markEdits(scene, previous.edit_version, cell_paths, cellsPerTile());
+            if (antialiasing) dirty->dilate();      // edges reach one pixel into clean tiles
+            if (dirty->all()) dirty.reset();
+        }
+        target.render_id = 0;
+        const std::vector<uint8_t>* mask = dirty ? &dirty->mask() : nullptr;
+        
+        // A frame that traces only some tiles can't fill the G-buffer
+        reuse_hits = primary_cache && scale == 1 && !on_device && gbuffer.holds(scene, frame);
+        store_hits = primary_cache && scale == 1 && !on_device && !reuse_hits && !mask;
+        if (store_hits) gbuffer.prepare(scene, frame);
+        if (antialiasing) aa_scheduler.reset(new TileScheduler(width, height, tile_size, tile_order, threads, mask));
+        
+        if (report) {
+            std::cout << "Rendering with " << threads << " threads";
+            if (workers.nodeCount() > 1) std::cout << " on " << workers.nodeCount() << " NUMA nodes";
+            std::cout << " (" << (on_device ? "DEVICE, " + device.describe() : mode == TraceMode::Packet ? "PACKETS" : "OPTIMIZED")
+                      << ")..." << std::endl;
+        }
+        
+        auto start_time = std::chrono::high_resolution_clock::now();
+        
+        // Preview tiles grow with the scale so each still holds tile_size^2 rays
+        TileScheduler scheduler(width, height, tile_size * scale, tile_order, threads, mask);
+        int tile_count = scheduler.tileCount();
+        
+        // A fresh target is first written by the threads that will render
+        // each tile, so its pages end up on their nodes
+        bool first_touch = target.untouched;
+        target.untouched = false;
+        
+        RenderStats totals;
+        totals.threads = threads;
+        totals.pixels = uint64_t(width) * height;
+        totals.tiles = dirty ? dirty->tilesX() * dirty->tilesY() : tile_count;
+        totals.tiles_traced = tile_count;
+        if (on_device) {
+            device_colors.resize(target.pixels.size());
+            device.render(scene, frame, trace_settings, device_colors.data(), antialiasing ? frame_hit.data() : nullptr,
+                          totals.rays);
+        }
+        std::mutex totals_lock;
+        workers.run([&](int thread) {
+            ThreadStats& local = threadStats();
+            local.rays = RayCounters();
+            local.timer.reset();
+            Tile tile;
+            if (first_touch) {
+                int begin, end;
+                scheduler.dealtRange(thread, begin, end);
+                for (int t = begin; t < end; t++) {
+                    const Tile& dealt = scheduler.tile(t);
+                    for (int j = dealt.y0; j < dealt.y1; j++) {
+                        std::fill(target.pixels.begin() + j * width + dealt.x0,
+                                  target.pixels.begin() + j * width + dealt.x1, 0xFF000000u);
+                        for (int c = 0; c < 3; c++) {
+                            std::fill(target.linear[c].begin() + j * width + dealt.x0,
+                                      target.linear[c].begin() + j * width + dealt.x1, Real(0));
+                        }
+                    }
+                }
+            }
+            if (on_device) {
+                if (first_touch) workers.barrier();     // the fill above covers dealt tiles, not rows
+                PROFILE_STAGE(STAGE_WRITE);
+                int begin, end;
+                ThreadPool::staticRange(height, thread, threads, begin, end);
+                for (int idx = begin * width; idx < end * width; idx++) writePixel(target, idx, device_colors[idx]);
+            }
+            while (!on_device && scheduler.next(thread, tile)) {
+                if (recording) {
+                    size_t first = size_t((tile.y0 / tile_size) * path_tiles_x + tile.x0 / tile_size) * cellsPerTile();
+                    for (int c = 0; c < cellsPerTile(); c++) cell_paths[first + c].reset();
+                }
+                if (scale > 1) {
+                    renderTileScaled(scene, frame, tile, scale, target);
+                } else if (mode == TraceMode::Packet) {
+                    renderTilePackets(scene, frame, tile, target);
+                } else {
+                    renderTile(scene, frame, tile, target, kernel);
+                }
+                
+                // Only the first thread prints; everyone else just bumps the counter
+                int finished = scheduler.finish();
+                if (report && thread == 0) {
+                    std::cout << "Progress: " << (100 * finished / std::max(1, tile_count)) << "%\r" << std::flush;
+                }
+            }
+            
+            // Edge pixels need their neighbours' first-pass results, so every
+            // phase waits for the previous one to finish on all threads. The
+            // static splits follow the tiles' curve order, like the deal
+            int marked = 0;
+            if (antialiasing) {
+                int begin, end;
+                workers.barrier();
+                ThreadPool::staticRange(tile_count, thread, threads, begin, end);
+                for (int t = begin; t < end; t++) marked += markEdges(scheduler.tile(t), width, height);
+                workers.barrier();
+                
+                while (aa_scheduler->next(thread, tile)) renderTileAA(scene, frame, tile, target);
+                
+                PROFILE_STAGE(STAGE_WRITE);
+                for (int t = begin; t < end; t++) {
+                    const Tile& own = scheduler.tile(t);
+                    for (int j = own.y0; j < own.y1; j++) {
+                        for (int idx = j * width + own.x0; idx < j * width + own.x1; idx++) {
+                            if (!edge[idx]) presentPixel(target, idx, frame_color[idx]);
+                        }
+                    }
+                }
+            }
+            
+            local.timer.enter(STAGE_OTHER);
+            std::lock_guard<std::mutex> guard(totals_lock);
+            totals.rays += local.rays;
+            totals.aa_pixels += marked;
+            for (int s = 0; s < STAGE_COUNT; s++) totals.stage_seconds[s] += local.timer.seconds[s];
+        });
+        
+        auto end_time = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(end_time - start_time).count();
+        totals.frame_seconds = seconds;
+        last_stats = totals;
+        if (accumulating) accumulated++;
+        if (store_hits) gbuffer.commit();
+        if (recording) {
+            last_frame = current;
+            last_frame.id = target.render_id = nextRenderId();
+        }
+        
+        if (report) {
+            std::cout << "Progress: 100% - Done!     " << std::endl;
+            std::cout << "Render time: " << seconds << " seconds" << std::endl;
+            if (accumulating) std::cout << "Accumulated frames: " << accumulated << std::endl;
+            if (dirty) {
+                std::cout << "Incremental: re-traced " << tile_count << " of " << totals.tiles << " tiles" << std::endl;
+            }
+            
+            // Every traced ray counts, not just one per pixel
+            std::cout << "Throughput: " << (totals.raysPerSecond() / 1000000.0) << " Mrays/sec ("
+                      << totals.rays.total() << " rays)" << std::endl;
+            if (print_stats) totals.print(std::cout);
+        }
+        
+        return seconds;
+    }
+    
+    // OPTIMIZATION 15: Batched small frames
+    // Renders every frame of 'batch' to its final, resolved image, as
+    // render() and resolve() would one by one, but in a single dispatch of
+    // the render threads: the tiles of all the frames are dealt from one
+    // counter and all their rows resolved in the same pass. A thumbnail has
+    // too few tiles to keep every thread busy to its end, and each frame on
+    // its own pays a dispatch, a barrier and a resolve; a batch pays them
+    // once. Antialiased, light-sampled and device frames, which need more
+    // than one pass, are rendered one by one. Returns the wall time; stats()
+    // covers the whole batch
+    double renderBatch(std::vector<BatchFrame>& batch) {
+        bool single_pass = aa_grid <= 1 && mode != TraceMode::Device;
+        for (const BatchFrame& b : batch) single_pass = single_pass && !trace_settings.samplesLights(b.scene->lights.size());
+        if (!single_pass || batch.size() == 1) {
+            double seconds = 0;
+            for (BatchFrame& b : batch) {
+                do {
+                    seconds += render(*b.scene, b.frame, *b.target);
+                } while (refining(*b.scene));
+                resolve(*b.target);
+            }
+            return seconds;
+        }
+        
+        ThreadPool& workers = threadPool();
+        int threads = workers.size();
+        accumulating = antialiasing = recording = reuse_hits = store_hits = on_device = false;
+        accumulated = 0;
+        last_frame.id = 0;
+        trace_settings.frame = 0;
+        
+        // Every frame's tiles in its own curve order, frame after frame
+        struct BatchTile {
+            int frame;
+            Tile tile;
+        };
+        std::vector<BatchTile> tiles;
+        std::vector<Scene::TraceKernel> kernels;
+        std::vector<int> first_row;     // of each frame in all the frames' rows, end to end
+        int rows = 0;
+        RenderStats totals;
+        totals.threads = threads;
+        for (size_t f = 0; f < batch.size(); f++) {
+            const BatchFrame& b = batch[f];
+            if (replicate_scene) b.scene->replicate(workers);
+            kernels.push_back(specialized_kernels ? b.scene->kernelFor(trace_settings) : &Scene::traceKernel<0, true>);
+            TileScheduler order(b.target->width, b.target->height, tile_size, tile_order, 1);
+            for (int t = 0; t < order.tileCount(); t++) tiles.push_back({int(f), order.tile(t)});
+            first_row.push_back(rows);
+            rows += b.target->height;
+            b.target->linear_frames = 1;
+            b.target->quantized = false;
+            b.target->untouched = false;
+            b.target->render_id = 0;
+            totals.pixels += uint64_t(b.target->width) * b.target->height;
+        }
+        totals.tiles = totals.tiles_traced = int(tiles.size());
+        
+        auto start_time = std::chrono::high_resolution_clock::now();
+        std::atomic<size_t> next_tile(0);
+        std::mutex totals_lock;
+        workers.run([&](int thread) {
+            ThreadStats& local = threadStats();
+            local.rays = RayCounters();
+            local.timer.reset();
+            for (size_t t = next_tile++; t < tiles.size(); t = next_tile++) {
+                const BatchFrame& b = batch[tiles[t].frame];
+                if (mode == TraceMode::Packet) {
+                    renderTilePackets(*b.scene, b.frame, tiles[t].tile, *b.target);
+                } else {
+                    renderTile(*b.scene, b.frame, tiles[t].tile, *b.target, kernels[tiles[t].frame]);
+                }
+            }
+            
+            // Then this thread's share of all the rows
+            workers.barrier();
+            PROFILE_STAGE(STAGE_WRITE);
+            int begin, end;
+            ThreadPool::staticRange(rows, thread, threads, begin, end);
+            for (size_t f = 0; f < batch.size(); f++) {
+                int j0 = std::max(begin - first_row[f], 0), j1 = std::min(end - first_row[f], batch[f].target->height);
+                if (j0 < j1) batch[f].target->resolveRows(j0, j1);
+            }
+            
+            local.timer.enter(STAGE_OTHER);
+            std::lock_guard<std::mutex> guard(totals_lock);
+            totals.rays += local.rays;
+            for (int s = 0; s < STAGE_COUNT; s++) totals.stage_seconds[s] += local.timer.seconds[s];
+        });
+        for (BatchFrame& b : batch) b.target->quantized = true;
+        
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count();
+        totals.frame_seconds = seconds;
+        last_stats = totals;
+        return seconds;
+    }
+};
@@ -1,14 +1,27 @@
 #!/bin/sh
+# Stops at the first build or testbench failure
+set -e
 
 # cleanup
-rm -rf obj_dir
+rm -rf obj_dir obj_dir_stream obj_dir_fixed
 rm -f ray_sphere_intersect.vcd
 
 # run Verilator to translate Verilog into C++, including C++ testbench
-verilator -Wall --cc --trace ray_sphere_intersect.sv --exe ray_sphere_intersect_tb.cpp
+verilator -Wall --cc --trace ray_sphere_intersect.sv ray_sphere_fixed.sv isqrt_pipe.sv --top-module ray_sphere_intersect --exe ray_sphere_intersect_tb.cpp
 
 # build C++ project via make automatically generated by Verilator
 make -j -C obj_dir/ -f Vray_sphere_intersect.mk Vray_sphere_intersect
 
 # run executable simulation file
-obj_dir/Vray_sphere_intersect
\ No newline at end of file
+obj_dir/Vray_sphere_intersect
+
+# same for the streaming (pipelined) module and its batch testbench
+verilator -Wall --cc --trace ray_sphere_stream.sv --exe ray_sphere_stream_tb.cpp --Mdir obj_dir_stream
+make -j -C obj_dir_stream/ -f Vray_sphere_stream.mk Vray_sphere_stream
+obj_dir_stream/Vray_sphere_stream
+
+# and for the fixed-point pipeline, under the stream testbench's class name,
+# checked against FixedPointModel instead of the real-valued quadratic
+verilator -Wall --cc --trace ray_sphere_fixed.sv isqrt_pipe.sv --top-module ray_sphere_fixed --prefix Vray_sphere_stream --exe ray_sphere_stream_tb.cpp --Mdir obj_dir_fixed -CFLAGS -DRAY_SPHERE_FIXED
+make -j -C obj_dir_fixed/ -f Vray_sphere_stream.mk Vray_sphere_stream
+obj_dir_fixed/Vray_sphere_stream
@@ -0,0 +1,835 @@
+// Materials, spheres, lights and the scalar Whitted-style tracer
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <memory>
+
+#include "geometry.h"
+#include "sphere_soa.h"
+#include "bvh.h"
+#include "intersect_backend.h"
+#include "light_sampler.h"
+#include "stats.h"
+#include "thread_pool.h"
+
+struct Material {
+    Color color;
+    Real ambient, diffuse, specular, shininess, reflectivity;
+    
+    Material(const Color& c = Color(1, 1, 1), Real amb = 0.1, Real diff = 0.7, 
+             Real spec = 0.6, Real shin = 32, Real refl = 0.3)
+        : color(c), ambient(amb), diffuse(diff), specular(spec), shininess(shin), reflectivity(refl) {}
+};
+
+
+// Improvement: Assumes normalized ray direction (a = 1), uses b/2 optimization
+template <typename T>
+struct SphereT {
+    Vec3T<T> center;
+    T radius;
+    Material material;
+    
+    SphereT(const Vec3T<T>& c, T r, const Material& m) : center(c), radius(r), material(m) {}
+    
+    // IMPROVED: Optimized for normalized ray direction
+    bool intersect(const RayT<T>& ray, T& t) const {
+        Vec3T<T> oc = ray.origin - center;
+        
+        // Since ray.direction is normalized in Ray constructor:
+        // a = ray.direction.dot(ray.direction) = 1.0
+        
+        // Use b/2 optimization: let b' = oc.dot(direction)
+        T b_half = oc.dot(ray.direction);
+        T c = oc.lengthSquared() - radius * radius;
+        
+        // Discriminant = b'² - ac = b'² - c (since a = 1)
+        T discriminant = b_half * b_half - c;
+        
+        if (discriminant < 0) return false;
+        
+        T sqrt_disc = std::sqrt(discriminant);
+        // Relative to r², so rays leaving large spheres don't re-hit them
+        T eps = hitEpsilon(radius * radius);
+        
+        // t = (-b' - sqrt(discriminant)) / a = -b' - sqrt(discriminant)
+        T t1 = -b_half - sqrt_disc;
+        if (t1 > eps) {
+            t = t1;
+            return true;
+        }
+        
+        T t2 = -b_half + sqrt_disc;
+        if (t2 > eps) {
+            t = t2;
+            return true;
+        }
+        
+        return false;
+    }
+    
+    Vec3T<T> getNormal(const Vec3T<T>& point) const {
+        return (point - center).normalize();
+    }
+};
+
+typedef SphereT<Real> Sphere;
+
+struct Light {
+    Vec3 position;
+    Color color;
+    Real intensity;
+    
+    Light(const Vec3& p, const Color& c, Real i = 1.0) 
+        : position(p), color(c), intensity(i) {}
+};
+
+// OPTIMIZATION 13: Fast shading kernel (TraceSettings::fast_shading)
+// The reference path finds a light's direction and distance with two square
+// roots, normalizes the shadow ray's direction again, builds a reflection
+// vector for the highlight and raises it with pow(). The fast path takes
+// one square root and a divide for both, hands the shadow ray its unit
+// direction, and gets the highlight's cosine from n.l and n.v (v.r =
+// 2 (n.l)(n.v) - l.v). Integer shininess, which every preset uses, is raised
+// by repeated squaring; other exponents still go through pow(). Results
+// differ from the reference by rounding only: a few float ulps, amplified
+// by the exponent in the highlight. Builds with -DRAYTRACER_FAST_SHADING
+// (make FAST_SHADING=1) take it by default; --validate-shading measures it
+#ifdef RAYTRACER_FAST_SHADING
+static const bool FAST_SHADING_DEFAULT = true;
+#else
+static const bool FAST_SHADING_DEFAULT = false;
+#endif
+
+// A material's shininess, prepared once: integers up to MAX_SQUARED are
+// raised by repeated squaring
+struct SpecularExponent {
+    static const int MAX_SQUARED = 1 << 16;
+    
+    Real value;
+    int integer;        // 'value' as an integer, -1 if it isn't one or is too large
+    
+    explicit SpecularExponent(Real shininess = 32) : value(shininess), integer(-1) {
+        if (shininess >= 0 && shininess <= MAX_SQUARED && Real(int(shininess)) == shininess) integer = int(shininess);
+    }
+    
+    // x^value for x >= 0
+    Real raise(Real x) const {
+        if (integer < 0) return std::pow(x, value);
+        Real result = 1;
+        for (int n = integer; n > 0; n >>= 1) {
+            if (n & 1) result *= x;
+            x *= x;
+        }
+        return result;
+    }
+};
+
+// Direction and distance from a shading point to a light, by either path.
+// The fast one's direction is scaled by the inverse distance, so the two
+// round differently
+inline void towardsLight(const Vec3& point, const Vec3& light, bool fast, Vec3& dir, Real& distance) {
+    Vec3 to = light - point;
+    if (!fast) {
+        dir = to.normalize();
+        distance = to.length();
+        return;
+    }
+    distance = to.length();
+    dir = distance > 0 ? to * (Real(1) / distance) : Vec3(0, 0, 0);
+}
+
+// The Phong highlight max(0, v.r)^shininess, where r is the light direction
+// mirrored about the normal; n_dot_l and n_dot_v feed the fast path
+inline Real specularTerm(const Vec3& view_dir, const Vec3& normal, const Vec3& light_dir, Real n_dot_l, Real n_dot_v,
+                         const Material& m, const SpecularExponent& e, bool fast) {
+    if (!fast) {
+        Vec3 reflect_dir = (light_dir * -1).reflect(normal);
+        return std::pow(std::max(Real(0), view_dir.dot(reflect_dir)), m.shininess);
+    }
+    return e.raise(std::max(Real(0), 2 * n_dot_l * n_dot_v - light_dir.dot(view_dir)));
+}
+
+// How a surface's shading and its reflection split the weight a path arrives with
+struct Bounce {
+    Real local;         // weight of the surface's own shading
+    Real reflected;     // weight carried on by the reflection ray, 0 if the path ends here
+};
+
+// NEW: Path termination shared by Scene::trace() and the PacketTracer.
+// A path ends at max_depth reflections, or earlier once its reflected
+// weight falls below min_weight; either way the last surface's shading takes
+// the whole weight, as the recursive tracer did at its depth limit. Below
+// roulette_weight, Russian roulette decides instead: the reflection survives
+// with probability reflected / roulette_weight and carries roulette_weight,
+// which keeps the expected image unchanged. Both thresholds default to off.
+// With light_samples = k, each shading point draws k lights in proportion to
+// their power instead of visiting every light, weighting each by 1 / (k p);
+// the draws change with 'frame' so averaged frames converge to the full loop
+struct TraceSettings {
+    int max_depth;
+    Real min_weight;
+    Real roulette_weight;
+    Real light_cutoff;      // skip shadow rays for lights adding less than this (0: off)
+    int light_samples;      // lights drawn per shading point (0: all of them)
+    uint32_t frame;         // progressive frame index, set by the Renderer
+    bool fast_shading;      // the fast shading kernel instead of the reference one
+    
+    TraceSettings()
+        : max_depth(3), min_weight(0), roulette_weight(0), light_cutoff(0), light_samples(0), frame(0),
+          fast_shading(FAST_SHADING_DEFAULT) {}
+    
+    // Sampling only pays off when it visits fewer lights than the full loop
+    bool samplesLights(size_t light_count) const {
+        return light_samples > 0 && size_t(light_samples) < light_count;
+    }
+    
+    // Whether a light is too faint to be worth a shadow ray: its diffuse term
+    // plus the brightest possible highlight, on a path of this weight, stays
+    // below light_cutoff
+    bool cullsLight(const Material& m, Real diff, const Light& light, Real weight) const {
+        if (light_cutoff <= 0) return false;
+        Color bound = (m.color * (m.diffuse * diff) + light.color * m.specular) * (light.intensity * weight);
+        return std::max(std::max(bound.x, bound.y), bound.z) < light_cutoff;
+    }
+    
+    // 'seed' identifies the path (its pixel), so roulette decisions are the
+    // same in both tracers and don't depend on thread scheduling
+    Bounce bounce(Real weight, Real reflectivity, int depth, uint32_t seed) const {
+        if (reflectivity <= 0 || depth >= max_depth) return Bounce{weight, 0};
+        Real reflected = weight * reflectivity;
+        if (reflected < min_weight) return Bounce{weight, 0};
+        
+        Bounce b = {weight * (1 - reflectivity), reflected};
+        if (reflected < roulette_weight) {
+            bool survives = rouletteSample(seed, depth) * roulette_weight < reflected;
+            b.reflected = survives ? roulette_weight : 0;
+        }
+        return b;
+    }
+    
+    // Uniform [0, 1) per (path, depth), via the murmur3 finalizer
+    static Real rouletteSample(uint32_t seed, int depth) {
+        uint32_t h = seed * 0x9e3779b1u ^ uint32_t(depth) * 0x85ebca6bu;
+        h ^= h >> 16; h *= 0x85ebca6bu;
+        h ^= h >> 13; h *= 0xc2b2ae35u;
+        h ^= h >> 16;
+        return Real(h >> 8) * Real(1.0 / 16777216.0);
+    }
+    
+    // Stratified [0, 1) for light draw s of 'count' at this path vertex: each
+    // draw gets its own 1 / count of the range, jittered per pixel and frame
+    Real lightSample(uint32_t seed, int depth, int s, int count) const {
+        uint32_t h = (frame * uint32_t(count) + uint32_t(s) + 1) * 0xcc9e2d51u;
+        h ^= h >> 15; h *= 0x1b873593u;
+        return (Real(s) + rouletteSample(seed ^ h, depth + 1)) / Real(count);
+    }
+};
+
+// NEW: What a block of pixels' paths depend on, for incremental re-renders
+// (DirtyTiles). Scene::trace() and the PacketTracer add every shading point
+// of a path they are given one for, whose color depends on its shadow rays,
+// and every reflection ray, kept as the box of their origins and a cone
+// holding their directions
+struct PathBounds {
+    AABB points;
+    AABB origins;
+    Vec3 axis;
+    Real cos_spread;    // cosine of the cone's half-angle; -1 holds every direction
+    int reflections;
+    
+    PathBounds() { reset(); }
+    
+    void reset() {
+        points = origins = AABB();
+        axis = Vec3(0, 0, 1);
+        cos_spread = 1;
+        reflections = 0;
+    }
+    
+    void addPoint(const Vec3& p) { points.expand(p); }
+    
+    void addReflection(const Vec3& origin, const Vec3& dir) {
+        origins.expand(origin);
+        if (reflections++ == 0) {
+            axis = dir;
+            cos_spread = 1;
+            return;
+        }
+        Real c = axis.dot(dir);
+        if (c < cos_spread && cos_spread > -1) widen(dir, c);
+    }
+
+private:
+    // Grows the cone just enough to hold 'dir' (unit, at cosine c to the axis)
+    void widen(const Vec3& dir, Real c) {
+        Real spread = std::acos(std::max(Real(-1), cos_spread));
+        Real angle = std::acos(std::max(Real(-1), std::min(Real(1), c)));
+        Real grown = (spread + angle) / 2;
+        Vec3 side = dir - axis * c;
+        Real side_length = side.length();
+        if (grown > Real(M_PI / 2) || side_length < Real(1e-6)) {
+            cos_spread = -1;            // wider cones would hardly exclude anything
+            return;
+        }
+        Real turn = grown - spread;
+        axis = (axis * std::cos(turn) + side * (std::sin(turn) / side_length)).normalize();
+        cos_spread = std::cos(grown);
+    }
+};
+
+// Where a camera ray hits first, as Scene::trace() starts its path from: the
+// SoA slot (-1 for a miss), the distance along the ray and the unit normal.
+// A G-buffer (gbuffer.h) keeps one per pixel
+struct PrimaryHit {
+    int slot;
+    Real t;
+    Vec3 normal;
+};
+
+// OPTIMIZATION 2: Separate shadow ray intersection with early exit
+class Scene {
+public:
+    std::vector<Sphere> spheres;    // empty for memory-mapped scenes
+    std::vector<Light> lights;
+    Color background;
+    
+    // Render-side mirror of 'spheres', maintained by addSphere()
+    std::vector<Material> materials;
+    std::vector<SpecularExponent> exponents;    // per material, for fast shading
+    SphereSoA soa;
+    BVH bvh;
+    
+    // Lights by power (intensity times mean color), for TraceSettings::light_samples.
+    // Shading has no falloff, so power is the whole estimate of a light's share
+    AliasTable light_sampler;
+    
+    // Keeps the file behind a memory-mapped scene alive; soa and bvh may view it
+    std::shared_ptr<const void> storage;
+    
+    Scene() : background(0.1, 0.1, 0.15), backend(&simdBackend()) {
+        edit_version = layout_version = geometry_version = whole_frame_version = nextVersion();
+    }
+    
+    // Where intersect()/intersectShadow() and their packet forms send their
+    // sphere tests (see intersect_backend.h); the SIMD CPU kernels by default
+    void setBackend(const IntersectBackend& b) { backend = &b; }
+    const IntersectBackend& intersectBackend() const { return *backend; }
+    
+    // Adding geometry invalidates the BVH; call buildBVH() again before rendering
+    void addSphere(const Sphere& sphere) {
+        soa.push(sphere.center, sphere.radius, materialIndex(sphere.material), int(soa.size()));
+        spheres.push_back(sphere);
+        bvh.clear();
+        slot_of.clear();
+        replicas.clear();
+        logSphere(sphere.center, sphere.radius);
+        geometry_version = edit_version;
+    }
+    
+    // NEW: Animation. Moves sphere 'index' (insertion order) in place; call
+    // refitBVH() once all of a frame's spheres are placed
+    void setSphereCenter(int index, const Vec3& c) {
+        int slot = slotOf(index);
+        Vec3 old = soa.center(slot);
+        if (old.x == c.x && old.y == c.y && old.z == c.z) return;
+        logSphere(old, soa.radius(slot));
+        soa.cx.mutableData()[slot] = c.x;
+        soa.cy.mutableData()[slot] = c.y;
+        soa.cz.mutableData()[slot] = c.z;
+        if (index < int(spheres.size())) spheres[index].center = c;
+        replicas.clear();
+        logSphere(c, soa.radius(slot));
+        geometry_version = edit_version;
+    }
+    
+    // NEW: Look-dev edits. Replaces sphere 'index' (insertion order): center,
+    // radius and material. Like setSphereCenter(), call refitBVH() before the
+    // next frame if it moved or grew. Every edit is logged with the spheres
+    // it touched (editsSince()), so an incremental Renderer re-traces only
+    // the tiles an edit can have changed
+    void updateSphere(int index, const Sphere& sphere) {
+        int slot = slotOf(index);
+        bool reshaped = soa.cx[slot] != sphere.center.x || soa.cy[slot] != sphere.center.y ||
+                        soa.cz[slot] != sphere.center.z || soa.r2[slot] != sphere.radius * sphere.radius;
+        logSphere(soa.center(slot), soa.radius(slot));
+        soa.cx.mutableData()[slot] = sphere.center.x;
+        soa.cy.mutableData()[slot] = sphere.center.y;
+        soa.cz.mutableData()[slot] = sphere.center.z;
+        soa.r2.mutableData()[slot] = sphere.radius * sphere.radius;
+        soa.material.mutableData()[slot] = materialIndex(sphere.material);
+        if (index < int(spheres.size())) spheres[index] = sphere;
+        replicas.clear();
+        logSphere(sphere.center, sphere.radius);
+        if (reshaped) geometry_version = edit_version;
+    }
+    
+    // Removes sphere 'index'; the spheres after it move down one index. The
+    // SoA is compacted and a built BVH rebuilt
+    void removeSphere(int index) {
+        int slot = slotOf(index);
+        logSphere(soa.center(slot), soa.radius(slot));
+        SphereSoA kept;
+        kept.reserve(soa.size() - 1);
+        for (int s = 0; s < int(soa.size()); s++) {
+            if (s == slot) continue;
+            int idx = soa.sphere_index[s];
+            kept.cx.push_back(soa.cx[s]);
+            kept.cy.push_back(soa.cy[s]);
+            kept.cz.push_back(soa.cz[s]);
+            kept.r2.push_back(soa.r2[s]);
+            kept.material.push_back(soa.material[s]);
+            kept.sphere_index.push_back(idx > index ? idx - 1 : idx);
+        }
+        std::swap(soa, kept);
+        if (index < int(spheres.size())) spheres.erase(spheres.begin() + index);
+        slot_of.clear();
+        replicas.clear();
+        layout_version = geometry_version = edit_version = nextVersion();
+        if (!bvh.empty()) buildBVH();
+    }
+    
+    // Fits the BVH around moved spheres without changing its topology, which
+    // is far cheaper than a build. Once motion has inflated its nodes to more
+    // than 'max_growth' times their built area (BVH::degradation()), it is
+    // rebuilt instead; returns whether that happened
+    bool refitBVH(double max_growth = 2.0) {
+        replicas.clear();
+        if (!bvh.empty()) {
+            bvh.refit(soa);
+            if (bvh.degradation() <= max_growth) return false;
+        }
+        buildBVH();
+        return true;
+    }
+    
+    // NEW: Per-node scene copies. Gives every NUMA node of 'pool' its own
+    // copy of the sphere arrays and BVH, written by one of that node's
+    // threads so its pages live there; pool threads then traverse their
+    // node's copy. Does nothing on a single node or if the copies are
+    // current. Editing the scene through its methods drops them; after
+    // touching soa or bvh directly, call dropReplicas()
+    void replicate(ThreadPool& pool) const {
+        if (pool.nodeCount() < 2 || int(replicas.size()) == pool.nodeCount()) return;
+        std::vector<std::shared_ptr<const Replica>> copies(pool.nodeCount());
+        pool.run([&](int thread) {
+            int node = pool.nodeOf(thread);
+            for (int t = 0; t < thread; t++) {
+                if (pool.nodeOf(t) == node) return;     // the node's first thread copies
+            }
+            std::shared_ptr<Replica> r(new Replica());
+            r->soa.copyFrom(soa);
+            r->bvh.nodes.assign(bvh.nodes.begin(), bvh.nodes.end());
+            copies[node] = r;
+        });
+        for (const auto& r : copies) {
+            if (!r) return;                             // fewer threads than nodes
+        }
+        replicas.swap(copies);
+    }
+    
+    void dropReplicas() { replicas.clear(); }
+    bool replicated() const { return !replicas.empty(); }
+    
+    // Light edits can change any lit pixel, so they count as whole-frame edits
+    void addLight(const Light& light) {
+        lights.push_back(light);
+        lightsChanged();
+    }
+    
+    void updateLight(int index, const Light& light) {
+        lights[index] = light;
+        lightsChanged();
+    }
+    
+    void removeLight(int index) {
+        lights.erase(lights.begin() + index);
+        lightsChanged();
+    }
+    
+    void setBackground(const Color& c) {
+        background = c;
+        shadingEdited();
+    }
+    
+    // Registers materials in order, for loaders whose sphere records already
+    // refer to material indices
+    void setMaterials(const std::vector<Material>& list) {
+        materials = list;
+        exponents.clear();
+        for (const Material& m : list) exponents.push_back(SpecularExponent(m.shininess));
+        material_lookup.clear();
+        for (size_t i = 0; i < list.size(); i++) material_lookup.insert(std::make_pair(list[i], int(i)));
+        shadingEdited();
+    }
+    
+    // Builds the BVH and reorders the SoA so every leaf is a contiguous slot range
+    void buildBVH() {
+        std::vector<int> order;
+        bvh.build(soa, order);
+        soa.permute(order);
+        slot_of.clear();
+        replicas.clear();
+        layout_version = geometry_version = edit_version = nextVersion();
+    }
+    
+    // The edit log. Every edit made through the methods above bumps the
+    // version; sphere edits also record the spheres they touched, before and
+    // after. After writing the public members directly, call markEdited().
+    // Versions are drawn from one process-wide sequence, so a (scene,
+    // version) pair never recurs, even for a new scene at a freed one's address
+    struct SphereDamage {
+        uint64_t version;
+        Vec3 center;
+        Real radius;
+    };
+    
+    uint64_t editVersion() const { return edit_version; }
+    
+    // Version of the last change of SoA slot order (a BVH build or a
+    // removal), which renumbers the slots hits are reported in
+    uint64_t layoutVersion() const { return layout_version; }
+    
+    // Version of the last edit that can change what a ray hits first: sphere
+    // geometry or slot order. Light, background and material edits leave it,
+    // so a G-buffer of primary hits stays valid across them
+    uint64_t geometryVersion() const { return geometry_version; }
+    
+    // An edit that may have changed any pixel, geometry included
+    void markEdited() {
+        exponents.clear();
+        for (const Material& m : materials) exponents.push_back(SpecularExponent(m.shininess));
+        shadingEdited();
+        geometry_version = edit_version;
+    }
+    
+    // Appends the spheres touched by edits after 'version' to 'out'; false
+    // if one of those edits may have changed anything
+    bool editsSince(uint64_t version, std::vector<SphereDamage>& out) const {
+        if (whole_frame_version > version) return false;
+        auto first = std::upper_bound(damage.begin(), damage.end(), version,
+                                      [](uint64_t v, const SphereDamage& d) { return v < d.version; });
+        out.insert(out.end(), first, damage.end());
+        return true;
+    }
+    
+    // Closest hit - goes through the BVH once it has been built
+    // hit_idx is an SoA slot; soa.sphere_index maps it back to 'spheres'
+    bool intersect(const Ray& ray, Real& closest_t, int& hit_idx) const {
+        PROFILE_STAGE(STAGE_INTERSECT);
+        closest_t = std::numeric_limits<Real>::max();
+        hit_idx = -1;
+        backend->intersect(localSoA(), localBVH(), ray, closest_t, hit_idx);
+        return hit_idx != -1;
+    }
+    
+    // NEW: Optimized shadow ray intersection - early exit on first hit.
+    // 'occluder', if given, receives the blocking slot
+    bool intersectShadow(const Ray& ray, Real max_distance, int* occluder = nullptr) const {
+        PROFILE_STAGE(STAGE_INTERSECT);
+        int slot = backend->occluded(localSoA(), localBVH(), ray, max_distance);
+        if (occluder && slot >= 0) *occluder = slot;
+        return slot >= 0;
+    }
+    
+    // NEW: Shadow test that first tries 'last', the slot that blocked the
+    // previous shadow ray towards the same light, and updates it. Nearby
+    // shading points are mostly shadowed by the same sphere, which then
+    // costs one sphere test instead of a traversal
+    bool occludedCached(const Ray& ray, Real max_distance, int& last) const {
+        if (cacheWorthwhile() && last >= 0 && last < int(soa.size())) {
+            PROFILE_STAGE(STAGE_INTERSECT);
+            if (backend->occludedRange(localSoA(), last, 1, ray, max_distance) >= 0) {
+                threadCounters().shadow_cached++;
+                return true;
+            }
+        }
+        return intersectShadow(ray, max_distance, &last);
+    }
+    
+    // Packet versions of intersect()/intersectShadow(); p.active selects the lanes
+    void intersectPacket(RayPacket& p) const {
+        PROFILE_STAGE(STAGE_INTERSECT);
+        backend->intersectPacket(localSoA(), localBVH(), p);
+    }
+    
+    // Lanes whose shadow ray is blocked before p.t
+    unsigned occludedPacket(const RayPacket& p) const {
+        PROFILE_STAGE(STAGE_INTERSECT);
+        return backend->occludedPacket(localSoA(), localBVH(), p, p.active, nullptr);
+    }
+    
+    // Packet form of occludedCached(): 'last' is tried on every lane first
+    unsigned occludedPacketCached(const RayPacket& p, int& last) const {
+        unsigned cached = 0;
+        if (cacheWorthwhile() && last >= 0 && last < int(soa.size())) {
+            PROFILE_STAGE(STAGE_INTERSECT);
+            cached = backend->occludedPacketRange(localSoA(), last, 1, p, p.active);
+            threadCounters().shadow_cached += __builtin_popcount(cached);
+            if (cached == p.active) return cached;
+        }
+        PROFILE_STAGE(STAGE_INTERSECT);
+        return cached | backend->occludedPacket(localSoA(), localBVH(), p, p.active & ~cached, &last);
+    }
+    
+    // OPTIMIZATION 3: Energy-conserving reflections
+    // IMPROVED: Iterative instead of recursive. The path carries the weight
+    // (product of reflectivities so far) its next surface contributes with,
+    // so there is no stack growth with depth; TraceSettings decides where it ends
+    // 'seed' drives Russian roulette and light sampling (see TraceSettings);
+    // 'first_hit', if given, receives the slot the ray hits first, -1 on a miss;
+    // 'paths', if given, records what the path depended on
+    Color trace(const Ray& ray, const TraceSettings& settings = TraceSettings(), uint32_t seed = 0,
+                int* first_hit = nullptr, PathBounds* paths = nullptr) const {
+        PrimaryHit primary = firstHit(ray);
+        if (first_hit) *first_hit = primary.slot;
+        return traceFrom(ray, primary, settings, seed, paths);
+    }
+    
+    // The closest hit of a camera ray and its normal; counts a primary ray
+    PrimaryHit firstHit(const Ray& ray) const {
+        threadCounters().primary++;
+        PrimaryHit h;
+        if (intersect(ray, h.t, h.slot)) {
+            h.normal = (ray.at(h.t) - soa.center(h.slot)).normalize();
+        }
+        return h;
+    }
+    
+    // NEW: trace() from a known first hit of 'ray', e.g. a G-buffer entry:
+    // the path's shading and everything after its primary intersection
+    Color traceFrom(Ray ray, const PrimaryHit& primary, const TraceSettings& settings = TraceSettings(),
+                    uint32_t seed = 0, PathBounds* paths = nullptr) const {
+        return traceKernel<0, true>(ray, primary, settings, seed, paths);
+    }
+    
+    // OPTIMIZATION 14: Specialized trace kernels
+    // traceFrom() is the generic instantiation of traceKernel(). Scenes with
+    // 1, 2 or 4 lights get one with the light loop unrolled, and scenes
+    // that can't reflect (no reflective material, or max_depth 0) one that
+    // stops at the first surface, without the bounce logic. Light sampling
+    // stays generic. They compute the same image, but the compiler may fuse
+    // different multiply-adds in the unrolled code, so the last bit can
+    // differ (it doesn't with -ffp-contract=off)
+    typedef Color (Scene::*TraceKernel)(Ray, const PrimaryHit&, const TraceSettings&, uint32_t, PathBounds*) const;
+    
+    // The kernel for rendering this scene as it is now with 'settings'
+    TraceKernel kernelFor(const TraceSettings& settings) const {
+        if (settings.samplesLights(lights.size())) return &Scene::traceKernel<0, true>;
+        bool reflects = settings.max_depth > 0 && reflective();
+        switch (lights.size()) {
+        case 1: return reflects ? &Scene::traceKernel<1, true> : &Scene::traceKernel<1, false>;
+        case 2: return reflects ? &Scene::traceKernel<2, true> : &Scene::traceKernel<2, false>;
+        case 4: return reflects ? &Scene::traceKernel<4, true> : &Scene::traceKernel<4, false>;
+        default: return reflects ? &Scene::traceKernel<0, true> : &Scene::traceKernel<0, false>;
+        }
+    }
+    
+    // Whether any material reflects
+    bool reflective() const {
+        for (const Material& m : materials) {
+            if (m.reflectivity > 0) return true;
+        }
+        return false;
+    }
+    
+    // The path of traceFrom() for exactly LIGHTS lights (0: any number) and,
+    // unless REFLECTS, without reflections; see kernelFor()
+    template <int LIGHTS, bool REFLECTS>
+    Color traceKernel(Ray ray, const PrimaryHit& primary, const TraceSettings& settings, uint32_t seed,
+                      PathBounds* paths) const {
+        PROFILE_STAGE(STAGE_SHADE);
+        RayCounters& counters = threadCounters();
+        
+        int* last_occluder = shadowCache();
+        Color result(0, 0, 0);
+        Real weight = 1;
+        for (int depth = 0; ; depth++) {
+            Real t = primary.t;
+            int hit_idx = primary.slot;
+            
+            bool hit = depth == 0 ? hit_idx != -1 : intersect(ray, t, hit_idx);
+            if (!hit) {
+                result = result + background * weight;
+                break;
+            }
+            
+            const Material& material = materials[soa.material[hit_idx]];
+            const SpecularExponent& exponent = exponents[soa.material[hit_idx]];
+            Vec3 hit_point = ray.at(t);
+            Vec3 normal = depth == 0 ? primary.normal : (hit_point - soa.center(hit_idx)).normalize();
+            Vec3 view_dir = (ray.origin - hit_point).normalize();
+            Real n_dot_v = normal.dot(view_dir);
+            if (paths) paths->addPoint(hit_point);
+            
+            // Ambient component
+            Color color = material.color * material.ambient;
+            
+            // Process each light source, or 'samples' of them drawn by power
+            // with their contribution scaled by 1 / (samples * pdf)
+            auto shadeLight = [&](int l, Real scale) {
+                const Light& light = lights[l];
+                Vec3 light_dir;
+                Real light_distance;
+                towardsLight(hit_point, light.position, settings.fast_shading, light_dir, light_distance);
+                
+                // NEW: Light culling before any shadow ray. A light behind the
+                // surface is blocked by the sphere itself; one that can't add
+                // more than the cutoff even at full highlight is skipped
+                Real diff = normal.dot(light_dir);
+                if (diff <= 0 || settings.cullsLight(material, diff, light, weight * scale)) {
+                    counters.lights_culled++;
+                    return;
+                }
+                
+                // IMPROVED: Use optimized shadow ray with early exit, trying the last blocker first
+                counters.shadow++;
+                Ray shadow = settings.fast_shading ? Ray(hit_point, light_dir, Ray::Normalized()) : Ray(hit_point, light_dir);
+                bool in_shadow = occludedCached(shadow, light_distance, last_occluder[l]);
+                
+                if (!in_shadow) {
+                    // Diffuse lighting
+                    Color diffuse = material.color * material.diffuse * diff * light.intensity;
+                    
+                    // Specular highlights
+                    Real spec = specularTerm(view_dir, normal, light_dir, diff, n_dot_v, material, exponent,
+                                             settings.fast_shading);
+                    Color specular = light.color * material.specular * spec * light.intensity;
+                    
+                    color = color + (diffuse + specular) * scale;
+                }
+            };
+            if (LIGHTS == 0 && settings.samplesLights(lights.size())) {
+                int samples = settings.light_samples;
+                for (int s = 0; s < samples; s++) {
+                    Real pdf;
+                    int l = light_sampler.sample(settings.lightSample(seed, depth, s, samples), pdf);
+                    if (pdf > 0) shadeLight(l, 1 / (samples * pdf));
+                }
+            } else {
+                int light_count = LIGHTS > 0 ? LIGHTS : int(lights.size());
+                for (int l = 0; l < light_count; l++) shadeLight(l, 1);
+            }
+            
+            // Nothing reflects: every surface ends its path, as bounce() would
+            if (!REFLECTS) {
+                result = result + color * weight;
+                break;
+            }
+            
+            // FIX: Blend instead of add for energy conservation
+            // The surface reflects some light and absorbs the rest
+            Vec3 reflect_dir = (view_dir * -1).reflect(normal);
+            Bounce b = settings.bounce(weight, material.reflectivity, depth, seed);
+            result = result + color * b.local;
+            if (b.reflected <= 0) break;
+            
+            weight = b.reflected;
+            ray = Ray(hit_point, reflect_dir);
+            counters.reflection++;
+            if (paths) paths->addReflection(ray.origin, ray.direction);
+        }
+        
+        return result;
+    }
+    
+    // The calling thread's last occluder per light, for occludedCached().
+    // Reset whenever the thread starts tracing a different scene
+    int* shadowCache() const {
+        static thread_local ShadowCache cache;
+        if (cache.owner != this || cache.last_occluder.size() != lights.size()) {
+            cache.owner = this;
+            cache.last_occluder.assign(lights.size(), -1);
+        }
+        return cache.last_occluder.data();
+    }
+
+private:
+    const IntersectBackend* backend;
+    std::vector<int> slot_of;       // SoA slot of each sphere index, built on demand
+    
+    uint64_t edit_version, layout_version, geometry_version, whole_frame_version;
+    std::vector<SphereDamage> damage;   // by version, none older than whole_frame_version
+    
+    // Beyond this many logged sphere edits the log collapses into one
+    // whole-frame edit; an incremental frame wouldn't save anything by then
+    static const size_t MAX_LOGGED_EDITS = 4096;
+    
+    static uint64_t nextVersion() {
+        static std::atomic<uint64_t> last(0);
+        return ++last;
+    }
+    
+    void logSphere(const Vec3& c, Real r) {
+        if (damage.size() >= MAX_LOGGED_EDITS) {
+            markEdited();
+            return;
+        }
+        damage.push_back(SphereDamage{edit_version = nextVersion(), c, r});
+    }
+    
+    int slotOf(int index) {
+        if (slot_of.size() != soa.size()) {
+            slot_of.resize(soa.size());
+            for (size_t s = 0; s < soa.size(); s++) slot_of[soa.sphere_index[s]] = int(s);
+        }
+        return slot_of[index];
+    }
+    
+    // An edit that may have changed any pixel's shading, but no ray's hits
+    void shadingEdited() {
+        whole_frame_version = edit_version = nextVersion();
+        damage.clear();
+    }
+    
+    void lightsChanged() {
+        std::vector<double> power(lights.size());
+        for (size_t l = 0; l < lights.size(); l++) {
+            const Light& li = lights[l];
+            power[l] = double(li.intensity) * (li.color.x + li.color.y + li.color.z) / 3.0;
+        }
+        light_sampler.build(power);
+        shadingEdited();
+    }
+    
+    struct Replica {
+        SphereSoA soa;
+        BVH bvh;
+    };
+    mutable std::vector<std::shared_ptr<const Replica>> replicas;     // per NUMA node, or none
+    
+    // What traversal reads: the calling thread's node copy, if there are any
+    const SphereSoA& localSoA() const { return replicas.empty() ? soa : replicas[ThreadPool::currentNode()]->soa; }
+    const BVH& localBVH() const { return replicas.empty() ? bvh : replicas[ThreadPool::currentNode()]->bvh; }
+    
+    struct ShadowCache {
+        const Scene* owner = nullptr;
+        std::vector<int> last_occluder;     // SoA slot, -1 if none yet
+    };
+    
+    // A scene that fits in one BVH leaf is tested whole by every shadow ray,
+    // so trying the cached sphere first would only add a test
+    bool cacheWorthwhile() const { return bvh.nodes.size() > 1; }
+    
+    struct MaterialLess {
+        bool operator()(const Material& a, const Material& b) const {
+            return std::tie(a.color.x, a.color.y, a.color.z, a.ambient, a.diffuse, a.specular, a.shininess, a.reflectivity) <
+                   std::tie(b.color.x, b.color.y, b.color.z, b.ambient, b.diffuse, b.specular, b.shininess, b.reflectivity);
+        }
+    };
+    std::map<Material, int, MaterialLess> material_lookup;
+    
+    // Identical materials share one entry in 'materials'
+    int materialIndex(const Material& m) {
+        auto it = material_lookup.find(m);
+        if (it != material_lookup.end()) return it->second;
+        materials.push_back(m);
+        exponents.push_back(SpecularExponent(m.shininess));
+        material_lookup[m] = int(materials.size()) - 1;
+        return int(materials.size()) - 1;
+    }
+};
@@ -0,0 +1,423 @@
+// Scene description files: a text format for authoring and a binary format
+// that is memory-mapped and used in place
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "scene.h"
+#include "camera.h"
+
+// Text scenes (.scene): one directive per line, '#' starts a comment
+//
+//   background r g b
+//   camera px py pz  tx ty tz  [fov]
+//   material NAME  r g b  ambient diffuse specular shininess reflectivity
+//   sphere cx cy cz radius MATERIAL
+//   light px py pz  r g b  intensity
+//
+// Materials have to be defined before the spheres that use them
+//
+// Binary scenes (.rtb): a header followed by 64-byte aligned sections holding
+// the SoA sphere arrays, materials, lights and the built BVH in the layout the
+// renderer uses. Loading maps the file and points the SoA/BVH arrays at it,
+// so there is nothing to parse or copy per sphere, only one pass that checks
+// the indices in them (validContents). Mapped scenes keep no
+// Scene::spheres copy. Files are native-endian, hold the sphere arrays in the
+// writing build's Real precision and are written by saveScene()
+namespace scene_io {
+
+static const char BINARY_MAGIC[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', '\0'};
+static const uint32_t BINARY_VERSION = 2;
+static const size_t SECTION_ALIGNMENT = 64;
+
+enum Section {
+    SECTION_CX, SECTION_CY, SECTION_CZ, SECTION_R2,
+    SECTION_MATERIAL, SECTION_SPHERE_INDEX,
+    SECTION_MATERIALS, SECTION_LIGHTS, SECTION_NODES,
+    SECTION_COUNT
+};
+
+static const int MATERIAL_DOUBLES = 8;  // color, ambient, diffuse, specular, shininess, reflectivity
+static const int LIGHT_DOUBLES = 7;     // position, color, intensity
+
+struct BinaryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t node_size;         // sizeof(BVHNode) of the writer
+    uint64_t sphere_count, material_count, light_count, node_count;
+    uint32_t has_camera;
+    uint32_t scalar_size;       // sizeof(Real) of the writer; the sphere arrays use it
+    double camera[10];          // position, target, up, fov
+    double background[3];
+    uint64_t offsets[SECTION_COUNT];
+};
+
+static_assert(std::is_trivially_copyable<BVHNode>::value, "BVH nodes are stored as raw bytes");
+
+inline bool hasSuffix(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+inline bool loadText(const std::string& path, Scene& scene, Camera* camera) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Cannot open scene " << path << std::endl;
+        return false;
+    }
+    
+    scene = Scene();
+    std::map<std::string, Material> named;
+    std::string line;
+    int line_no = 0;
+    while (std::getline(in, line)) {
+        line_no++;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        
+        std::istringstream ss(line);
+        std::string word;
+        if (!(ss >> word)) continue;
+        
+        bool ok = true;
+        if (word == "background") {
+            Color& b = scene.background;
+            ok = bool(ss >> b.x >> b.y >> b.z);
+        } else if (word == "camera") {
+            Vec3 pos, target;
+            double fov = 60.0;
+            ok = bool(ss >> pos.x >> pos.y >> pos.z >> target.x >> target.y >> target.z);
+            if (ok && !(ss >> fov)) fov = 60.0;
+            if (ok && camera) *camera = Camera(pos, target, Vec3(0, 1, 0), fov);
+        } else if (word == "material") {
+            std::string name;
+            Material m;
+            ok = bool(ss >> name >> m.color.x >> m.color.y >> m.color.z
+                         >> m.ambient >> m.diffuse >> m.specular >> m.shininess >> m.reflectivity);
+            if (ok) named[name] = m;
+        } else if (word == "sphere") {
+            Vec3 c;
+            double r;
+            std::string name;
+            ok = bool(ss >> c.x >> c.y >> c.z >> r >> name);
+            if (ok) {
+                auto it = named.find(name);
+                if (it == named.end()) {
+                    std::cerr << path << ":" << line_no << ": unknown material '" << name << "'" << std::endl;
+                    return false;
+                }
+                scene.addSphere(Sphere(c, r, it->second));
+            }
+        } else if (word == "light") {
+            Vec3 p;
+            Color c;
+            double intensity;
+            ok = bool(ss >> p.x >> p.y >> p.z >> c.x >> c.y >> c.z >> intensity);
+            if (ok) scene.addLight(Light(p, c, intensity));
+        } else {
+            std::cerr << path << ":" << line_no << ": unknown directive '" << word << "'" << std::endl;
+            return false;
+        }
+        
+        if (!ok) {
+            std::cerr << path << ":" << line_no << ": malformed '" << word << "' line" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Shortest %g form that reads back as the same Real
+inline std::string formatNumber(Real v) {
+    char buf[32];
+    for (int precision = std::numeric_limits<Real>::digits10; precision <= std::numeric_limits<Real>::max_digits10; precision++) {
+        snprintf(buf, sizeof(buf), "%.*g", precision, double(v));
+        if (Real(strtod(buf, nullptr)) == v) break;
+    }
+    return buf;
+}
+
+inline bool saveText(const std::string& path, const Scene& scene, const Camera* camera) {
+    std::ofstream out(path);
+    if (!out) return false;
+    
+    auto vec = [](const Vec3& v) { return formatNumber(v.x) + " " + formatNumber(v.y) + " " + formatNumber(v.z); };
+    
+    out << "# " << scene.soa.size() << " spheres, " << scene.materials.size() << " materials, "
+        << scene.lights.size() << " lights\n";
+    out << "background " << vec(scene.background) << "\n";
+    if (camera) {
+        out << "camera " << vec(camera->position) << "  " << vec(camera->target) << "  "
+            << formatNumber(camera->fov) << "\n";
+    }
+    for (size_t i = 0; i < scene.materials.size(); i++) {
+        const Material& m = scene.materials[i];
+        out << "material m" << i << "  " << vec(m.color) << "  " << formatNumber(m.ambient) << " "
+            << formatNumber(m.diffuse) << " " << formatNumber(m.specular) << " "
+            << formatNumber(m.shininess) << " " << formatNumber(m.reflectivity) << "\n";
+    }
+    
+    // Spheres in their original insertion order, not BVH slot order
+    const SphereSoA& soa = scene.soa;
+    std::vector<int> slot_of(soa.size());
+    for (size_t s = 0; s < soa.size(); s++) slot_of[soa.sphere_index[s]] = int(s);
+    for (int s : slot_of) {
+        out << "sphere " << vec(soa.center(s)) << "  " << formatNumber(soa.radius(s))
+            << "  m" << soa.material[s] << "\n";
+    }
+    for (const Light& l : scene.lights) {
+        out << "light " << vec(l.position) << "  " << vec(l.color) << "  " << formatNumber(l.intensity) << "\n";
+    }
+    out.flush();
+    return bool(out);
+}
+
+// Writes the binary form to an open stream (a file, or open_memstream() to
+// ship it over the network)
+inline bool writeBinary(FILE* f, const Scene& scene, const Camera* camera) {
+    const SphereSoA& soa = scene.soa;
+    BinaryHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, BINARY_MAGIC, sizeof(h.magic));
+    h.version = BINARY_VERSION;
+    h.node_size = sizeof(BVHNode);
+    h.scalar_size = sizeof(Real);
+    h.sphere_count = soa.size();
+    h.material_count = scene.materials.size();
+    h.light_count = scene.lights.size();
+    h.node_count = scene.bvh.nodes.size();
+    if (camera) {
+        const Camera& c = *camera;
+        double values[10] = {c.position.x, c.position.y, c.position.z, c.target.x, c.target.y, c.target.z,
+                             c.up.x, c.up.y, c.up.z, c.fov};
+        memcpy(h.camera, values, sizeof(values));
+        h.has_camera = 1;
+    }
+    h.background[0] = scene.background.x;
+    h.background[1] = scene.background.y;
+    h.background[2] = scene.background.z;
+    
+    std::vector<double> materials, lights;
+    for (const Material& m : scene.materials) {
+        double values[MATERIAL_DOUBLES] = {m.color.x, m.color.y, m.color.z, m.ambient,
+                                           m.diffuse, m.specular, m.shininess, m.reflectivity};
+        materials.insert(materials.end(), values, values + MATERIAL_DOUBLES);
+    }
+    for (const Light& l : scene.lights) {
+        double values[LIGHT_DOUBLES] = {l.position.x, l.position.y, l.position.z,
+                                        l.color.x, l.color.y, l.color.z, l.intensity};
+        lights.insert(lights.end(), values, values + LIGHT_DOUBLES);
+    }
+    
+    const void* data[SECTION_COUNT] = {
+        soa.cx.data(), soa.cy.data(), soa.cz.data(), soa.r2.data(),
+        soa.material.data(), soa.sphere_index.data(),
+        materials.data(), lights.data(), scene.bvh.nodes.data()
+    };
+    size_t bytes[SECTION_COUNT] = {
+        soa.size() * sizeof(Real), soa.size() * sizeof(Real),
+        soa.size() * sizeof(Real), soa.size() * sizeof(Real),
+        soa.size() * sizeof(int), soa.size() * sizeof(int),
+        materials.size() * sizeof(double), lights.size() * sizeof(double),
+        scene.bvh.nodes.size() * sizeof(BVHNode)
+    };
+    
+    uint64_t offset = sizeof(BinaryHeader);
+    for (int s = 0; s < SECTION_COUNT; s++) {
+        offset = (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+        h.offsets[s] = offset;
+        offset += bytes[s];
+    }
+    
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    static const char zeros[SECTION_ALIGNMENT] = {0};
+    uint64_t written = sizeof(h);
+    for (int s = 0; s < SECTION_COUNT && ok; s++) {
+        size_t pad = size_t(h.offsets[s] - written);
+        ok = fwrite(zeros, 1, pad, f) == pad && (!bytes[s] || fwrite(data[s], 1, bytes[s], f) == bytes[s]);
+        written = h.offsets[s] + bytes[s];
+    }
+    return ok;
+}
+
+inline bool saveBinary(const std::string& path, const Scene& scene, const Camera* camera) {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) return false;
+    bool ok = writeBinary(f, scene, camera);
+    return fclose(f) == 0 && ok;
+}
+
+// Whether the sections of a binary scene whose header says they fit hold
+// what the renderer relies on without checking: material indices below the
+// material count, a permutation in sphere_index, and a BVH whose leaves
+// stay inside the sphere arrays and whose children follow their parent
+// (as build() lays them out, so there are no cycles), no deeper than the
+// traversal stacks (BVH::STACK_SIZE) hold. One pass over each array
+inline bool validContents(const BinaryHeader& h, const char* bytes) {
+    size_t n = size_t(h.sphere_count);
+    const int* material = reinterpret_cast<const int*>(bytes + h.offsets[SECTION_MATERIAL]);
+    for (size_t i = 0; i < n; i++) {
+        if (material[i] < 0 || uint64_t(material[i]) >= h.material_count) return false;
+    }
+    
+    const int* sphere_index = reinterpret_cast<const int*>(bytes + h.offsets[SECTION_SPHERE_INDEX]);
+    std::vector<uint8_t> seen(n, 0);
+    for (size_t i = 0; i < n; i++) {
+        if (sphere_index[i] < 0 || size_t(sphere_index[i]) >= n || seen[sphere_index[i]]) return false;
+        seen[sphere_index[i]] = 1;
+    }
+    
+    // Traversal starts at node 0 whenever there are spheres
+    size_t node_count = size_t(h.node_count);
+    if (n > 0 && node_count == 0) return false;
+    const BVHNode* nodes = reinterpret_cast<const BVHNode*>(bytes + h.offsets[SECTION_NODES]);
+    std::vector<int> depth(node_count, 0);
+    for (size_t i = 0; i < node_count; i++) {
+        const BVHNode& node = nodes[i];
+        if (node.count < 0 || node.left_first < 0) return false;
+        if (node.isLeaf()) {
+            if (uint64_t(node.left_first) + uint64_t(node.count) > n) return false;
+            continue;
+        }
+        size_t left = size_t(node.left_first);
+        if (left <= i || left + 1 >= node_count || depth[i] + 1 > BVH::STACK_SIZE - 2) return false;
+        depth[left] = std::max(depth[left], depth[i] + 1);
+        depth[left + 1] = std::max(depth[left + 1], depth[i] + 1);
+    }
+    return true;
+}
+
+// Points 'scene' at a binary scene image already in memory (64-byte aligned),
+// which 'storage' keeps alive; 'path' only names it in error messages
+inline bool useBinary(const std::shared_ptr<const void>& storage, size_t file_size, const std::string& path,
+                      Scene& scene, Camera* camera) {
+    const char* bytes = static_cast<const char*>(storage.get());
+    if (file_size < sizeof(BinaryHeader)) {
+        std::cerr << path << ": not a binary scene" << std::endl;
+        return false;
+    }
+    BinaryHeader h;
+    memcpy(&h, bytes, sizeof(h));
+    if (memcmp(h.magic, BINARY_MAGIC, sizeof(h.magic)) != 0 || h.version != BINARY_VERSION) {
+        std::cerr << path << ": not a version " << BINARY_VERSION << " binary scene" << std::endl;
+        return false;
+    }
+    // The arrays are used in place, so they must already be in this build's precision
+    if (h.scalar_size != sizeof(Real) || h.node_size != sizeof(BVHNode)) {
+        std::cerr << path << ": written by a " << (h.scalar_size == 8 ? "double" : "float")
+                  << " build; this one uses " << Precision<Real>::name()
+                  << ", re-save the scene from its text form" << std::endl;
+        return false;
+    }
+    
+    // Each count is checked against the room its section has, so no
+    // count * size product can wrap around
+    uint64_t counts[SECTION_COUNT] = {
+        h.sphere_count, h.sphere_count, h.sphere_count, h.sphere_count, h.sphere_count, h.sphere_count,
+        h.material_count, h.light_count, h.node_count
+    };
+    uint64_t element_sizes[SECTION_COUNT] = {
+        sizeof(Real), sizeof(Real), sizeof(Real), sizeof(Real), sizeof(int), sizeof(int),
+        MATERIAL_DOUBLES * sizeof(double), LIGHT_DOUBLES * sizeof(double), sizeof(BVHNode)
+    };
+    bool sections_fit = h.sphere_count <= uint64_t(std::numeric_limits<int>::max()) &&
+                        h.node_count <= uint64_t(std::numeric_limits<int>::max());
+    for (int s = 0; s < SECTION_COUNT && sections_fit; s++) {
+        sections_fit = h.offsets[s] % SECTION_ALIGNMENT == 0 && h.offsets[s] <= file_size &&
+                       counts[s] <= (file_size - h.offsets[s]) / element_sizes[s];
+    }
+    if (!sections_fit || !validContents(h, bytes)) {
+        std::cerr << path << ": truncated or corrupt binary scene" << std::endl;
+        return false;
+    }
+    
+    scene = Scene();
+    scene.background = Color(h.background[0], h.background[1], h.background[2]);
+    
+    // Materials and lights are a handful of records; they are unpacked into
+    // the usual vectors. The per-sphere arrays and the BVH are used in place
+    const double* m = reinterpret_cast<const double*>(bytes + h.offsets[SECTION_MATERIALS]);
+    std::vector<Material> materials;
+    for (uint64_t i = 0; i < h.material_count; i++, m += MATERIAL_DOUBLES) {
+        materials.push_back(Material(Color(m[0], m[1], m[2]), m[3], m[4], m[5], m[6], m[7]));
+    }
+    scene.setMaterials(materials);
+    
+    const double* l = reinterpret_cast<const double*>(bytes + h.offsets[SECTION_LIGHTS]);
+    for (uint64_t i = 0; i < h.light_count; i++, l += LIGHT_DOUBLES) {
+        scene.addLight(Light(Vec3(l[0], l[1], l[2]), Color(l[3], l[4], l[5]), l[6]));
+    }
+    
+    size_t n = size_t(h.sphere_count);
+    SphereSoA& soa = scene.soa;
+    soa.cx.view(reinterpret_cast<const Real*>(bytes + h.offsets[SECTION_CX]), n);
+    soa.cy.view(reinterpret_cast<const Real*>(bytes + h.offsets[SECTION_CY]), n);
+    soa.cz.view(reinterpret_cast<const Real*>(bytes + h.offsets[SECTION_CZ]), n);
+    soa.r2.view(reinterpret_cast<const Real*>(bytes + h.offsets[SECTION_R2]), n);
+    soa.material.view(reinterpret_cast<const int*>(bytes + h.offsets[SECTION_MATERIAL]), n);
+    soa.sphere_index.view(reinterpret_cast<const int*>(bytes + h.offsets[SECTION_SPHERE_INDEX]), n);
+    scene.bvh.nodes.view(reinterpret_cast<const BVHNode*>(bytes + h.offsets[SECTION_NODES]), size_t(h.node_count));
+    scene.storage = storage;
+    
+    if (camera && h.has_camera) {
+        const double* c = h.camera;
+        *camera = Camera(Vec3(c[0], c[1], c[2]), Vec3(c[3], c[4], c[5]), Vec3(c[6], c[7], c[8]), c[9]);
+    }
+    return true;
+}
+
+inline bool loadBinary(const std::string& path, Scene& scene, Camera* camera) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Cannot open scene " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(BinaryHeader)) {
+        std::cerr << path << ": not a binary scene" << std::endl;
+        close(fd);
+        return false;
+    }
+    size_t file_size = size_t(st.st_size);
+    void* base = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << path << ": mmap failed" << std::endl;
+        return false;
+    }
+    std::shared_ptr<const void> mapping(base, [file_size](const void* p) {
+        munmap(const_cast<void*>(p), file_size);
+    });
+    return useBinary(mapping, file_size, path, scene, camera);
+}
+    
+} // namespace scene_io
+
+// Picks the format from the extension: .rtb is binary, anything else is text.
+// 'camera' is only overwritten if the file has one
+inline bool loadScene(const std::string& path, Scene& scene, Camera* camera = nullptr) {
+    if (scene_io::hasSuffix(path, ".rtb")) return scene_io::loadBinary(path, scene, camera);
+    return scene_io::loadText(path, scene, camera);
+}
+
+// Binary files store the BVH as well, so build it before saving one
+inline bool saveScene(const std::string& path, const Scene& scene, const Camera* camera = nullptr) {
+    if (scene_io::hasSuffix(path, ".rtb")) return scene_io::saveBinary(path, scene, camera);
+    return scene_io::saveText(path, scene, camera);
+}
@@ -0,0 +1,153 @@
+// SDL window frontend: presents FrameBuffers and drives the interactive camera.
+// The only part of the tracer that needs SDL
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include <chrono>
+#include <algorithm>
+
+#include "renderer.h"
+
+class SDLDisplay {
+private:
+    SDL_Window* window;
+    SDL_Renderer* renderer;
+    SDL_Texture* texture;
+    int width, height;
+    
+    static constexpr double MOVE_SPEED = 3.0;           // scene units per second
+    static constexpr double TURN_SPEED = 1.5;           // radians per second
+    static constexpr double MOUSE_SENSITIVITY = 0.005;  // radians per pixel dragged
+
+public:
+    static const int PREVIEW_SCALE = 8;
+    
+    SDLDisplay(int w, int h) : width(w), height(h) {
+        if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+            std::cerr << "SDL initialization failed: " << SDL_GetError() << std::endl;
+            exit(1);
+        }
+        
+        window = SDL_CreateWindow("Ray Tracer (Optimized)",
+                                   SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+                                   width, height, SDL_WINDOW_SHOWN);
+        if (!window) {
+            std::cerr << "Window creation failed: " << SDL_GetError() << std::endl;
+            exit(1);
+        }
+        
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+        if (!renderer) {
+            std::cerr << "Renderer creation failed: " << SDL_GetError() << std::endl;
+            exit(1);
+        }
+        
+        texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                    SDL_TEXTUREACCESS_STREAMING, width, height);
+        if (!texture) {
+            std::cerr << "Texture creation failed: " << SDL_GetError() << std::endl;
+            exit(1);
+        }
+    }
+    
+    ~SDLDisplay() {
+        SDL_DestroyTexture(texture);
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+    }
+    
+    void present(const FrameBuffer& frame) {
+        SDL_UpdateTexture(texture, nullptr, frame.pixels.data(), frame.width * sizeof(Uint32));
+        SDL_RenderClear(renderer);
+        SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+        SDL_RenderPresent(renderer);
+    }
+    
+    // Returns false once the window should close. Mouse drag and held keys move
+    // the camera by an amount proportional to 'dt'; 'moved' reports whether they did
+    bool handleEvents(Camera& camera, double dt, bool& moved) {
+        moved = false;
+        SDL_Event e;
+        while (SDL_PollEvent(&e)) {
+            if (e.type == SDL_QUIT) {
+                return false;
+            }
+            if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE) {
+                return false;
+            }
+            if (e.type == SDL_MOUSEMOTION && (e.motion.state & SDL_BUTTON_LMASK)) {
+                camera.rotate(-e.motion.xrel * MOUSE_SENSITIVITY, -e.motion.yrel * MOUSE_SENSITIVITY);
+                moved = true;
+            }
+        }
+        
+        const Uint8* keys = SDL_GetKeyboardState(nullptr);
+        double step = MOVE_SPEED * dt * (keys[SDL_SCANCODE_LSHIFT] ? 3.0 : 1.0);
+        double turn = TURN_SPEED * dt;
+        double forward = (keys[SDL_SCANCODE_W] ? step : 0) - (keys[SDL_SCANCODE_S] ? step : 0);
+        double right = (keys[SDL_SCANCODE_D] ? step : 0) - (keys[SDL_SCANCODE_A] ? step : 0);
+        double lift = (keys[SDL_SCANCODE_E] ? step : 0) - (keys[SDL_SCANCODE_Q] ? step : 0);
+        double yaw = (keys[SDL_SCANCODE_LEFT] ? turn : 0) - (keys[SDL_SCANCODE_RIGHT] ? turn : 0);
+        double pitch = (keys[SDL_SCANCODE_UP] ? turn : 0) - (keys[SDL_SCANCODE_DOWN] ? turn : 0);
+        
+        if (forward != 0 || right != 0 || lift != 0) {
+            camera.move(forward, right, lift);
+            moved = true;
+        }
+        if (yaw != 0 || pitch != 0) {
+            camera.rotate(yaw, pitch);
+            moved = true;
+        }
+        return true;
+    }
+    
+    // NEW: Progressive interactive loop. While the camera moves, frames are
+    // traced at 1/PREVIEW_SCALE resolution and upscaled; once it is still, each
+    // frame halves the scale until the full-resolution image is on screen, after
+    // which nothing is traced until the next movement, or, with sampled
+    // lights, until the renderer has averaged enough frames. 'frame' is expected to
+    // already hold a finished image when 'refine' is false
+    void runInteractive(Renderer& renderer, const Scene& scene, Camera& camera, FrameBuffer& frame, bool refine) {
+        std::cout << "WASD/QE move, arrows or left-drag look, Shift is faster, ESC or close window to exit" << std::endl;
+        
+        int scale = refine ? PREVIEW_SCALE : renderer.refining(scene) ? 1 : 0;     // 0: converged
+        if (!refine) present(frame);
+        
+        auto last = std::chrono::high_resolution_clock::now();
+        while (true) {
+            auto now = std::chrono::high_resolution_clock::now();
+            // Clamp so the first step after a long full-resolution pass doesn't jump
+            double dt = std::min(0.1, std::chrono::duration<double>(now - last).count());
+            last = now;
+            
+            bool moved;
+            if (!handleEvents(camera, dt, moved)) break;
+            if (moved) scale = PREVIEW_SCALE;
+            
+            if (scale == 0) {
+                SDL_Delay(16);
+                continue;
+            }
+            
+            double seconds = renderer.render(scene, camera, frame, scale);
+            renderer.resolve(frame);
+            present(frame);
+            
+            char title[96];
+            if (renderer.accumulatedFrames() > 0) {
+                snprintf(title, sizeof(title), "Ray Tracer (Optimized) - frame %d - %.1f ms",
+                         renderer.accumulatedFrames(), seconds * 1000.0);
+            } else {
+                snprintf(title, sizeof(title), "Ray Tracer (Optimized) - 1/%d - %.1f ms", scale, seconds * 1000.0);
+            }
+            SDL_SetWindowTitle(window, title);
+            
+            scale /= 2;     // 8 -> 4 -> 2 -> 1 -> converged
+            if (scale == 0 && renderer.refining(scene)) scale = 1;
+        }
+    }
+};
@@ -0,0 +1,239 @@
+// Animation: camera and sphere keyframes rendered as a numbered image sequence
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "renderer.h"
+#include "camera.h"
+#include "framebuffer.h"
+
+// Sequence files (.anim): one directive per line, '#' starts a comment
+//
+//   frames N                               frames 0 .. N-1 are rendered
+//   camera F  px py pz  tx ty tz  [fov]    camera at frame F
+//   sphere F INDEX  cx cy cz               center of sphere INDEX at frame F
+//
+// Spheres are numbered in the order the scene file lists them. Values are
+// interpolated linearly between keyframes and held before the first and
+// after the last; without camera keys the scene's own camera is used
+class Sequence {
+public:
+    int frames;
+    
+    Sequence() : frames(1) {}
+    
+    bool load(const std::string& path) {
+        std::ifstream in(path);
+        if (!in) {
+            std::cerr << "Cannot open sequence " << path << std::endl;
+            return false;
+        }
+        
+        std::string line;
+        int line_no = 0;
+        while (std::getline(in, line)) {
+            line_no++;
+            size_t hash = line.find('#');
+            if (hash != std::string::npos) line.erase(hash);
+            
+            std::istringstream ss(line);
+            std::string word;
+            if (!(ss >> word)) continue;
+            
+            bool ok = true;
+            if (word == "frames") {
+                ok = bool(ss >> frames) && frames > 0;
+            } else if (word == "camera") {
+                CameraKey k;
+                ok = bool(ss >> k.frame >> k.position.x >> k.position.y >> k.position.z
+                             >> k.target.x >> k.target.y >> k.target.z);
+                if (ok && !(ss >> k.fov)) k.fov = -1;
+                if (ok) insertKey(camera_keys, k);
+            } else if (word == "sphere") {
+                int index;
+                CenterKey k;
+                ok = bool(ss >> k.frame >> index >> k.center.x >> k.center.y >> k.center.z) && index >= 0;
+                if (ok) insertKey(sphere_keys[index], k);
+            } else {
+                std::cerr << path << ":" << line_no << ": unknown directive '" << word << "'" << std::endl;
+                return false;
+            }
+            
+            if (!ok) {
+                std::cerr << path << ":" << line_no << ": malformed '" << word << "' line" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    bool movesSpheres() const { return !sphere_keys.empty(); }
+    bool movesCamera() const { return !camera_keys.empty(); }
+    
+    // Highest sphere index a key refers to, -1 if none
+    int maxSphereIndex() const { return sphere_keys.empty() ? -1 : sphere_keys.rbegin()->first; }
+    
+    // 'base' at frame f: position, target and fov from the keys, up kept.
+    // A key without a fov keeps the base camera's
+    Camera cameraAt(int f, const Camera& base) const {
+        if (camera_keys.empty()) return base;
+        const CameraKey* a;
+        const CameraKey* b;
+        Real s = bracket(camera_keys, f, a, b);
+        Real fov_a = a->fov > 0 ? a->fov : base.fov, fov_b = b->fov > 0 ? b->fov : base.fov;
+        return Camera(lerp(a->position, b->position, s), lerp(a->target, b->target, s), base.up,
+                      fov_a + (fov_b - fov_a) * s);
+    }
+    
+    // Moves every keyed sphere to where it is at frame f
+    void placeSpheres(int f, Scene& scene) const {
+        for (const auto& keys : sphere_keys) {
+            const CenterKey* a;
+            const CenterKey* b;
+            Real s = bracket(keys.second, f, a, b);
+            scene.setSphereCenter(keys.first, lerp(a->center, b->center, s));
+        }
+    }
+
+private:
+    struct CameraKey {
+        int frame;
+        Vec3 position, target;
+        Real fov;           // <= 0: the base camera's
+    };
+    
+    struct CenterKey {
+        int frame;
+        Vec3 center;
+    };
+    
+    std::vector<CameraKey> camera_keys;                 // by frame
+    std::map<int, std::vector<CenterKey>> sphere_keys;  // per sphere index, by frame
+    
+    // Keeps keys sorted by frame; a repeated frame replaces the earlier key
+    template <typename Key>
+    static void insertKey(std::vector<Key>& keys, const Key& k) {
+        auto it = std::lower_bound(keys.begin(), keys.end(), k, [](const Key& x, const Key& y) { return x.frame < y.frame; });
+        if (it != keys.end() && it->frame == k.frame) {
+            *it = k;
+        } else {
+            keys.insert(it, k);
+        }
+    }
+    
+    // The keys around frame f and how far f is from a to b (0 to 1)
+    template <typename Key>
+    static Real bracket(const std::vector<Key>& keys, int f, const Key*& a, const Key*& b) {
+        auto it = std::upper_bound(keys.begin(), keys.end(), f, [](int frame, const Key& k) { return frame < k.frame; });
+        if (it == keys.begin()) {
+            a = b = &keys.front();
+            return 0;
+        }
+        if (it == keys.end()) {
+            a = b = &keys.back();
+            return 0;
+        }
+        b = &*it;
+        a = &*(it - 1);
+        return Real(f - a->frame) / Real(b->frame - a->frame);
+    }
+    
+    static Vec3 lerp(const Vec3& a, const Vec3& b, Real s) { return a + (b - a) * s; }
+};
+
+// Frame f's file name: 'pattern' with a printf integer conversion (e.g.
+// shot_%04d.png), or with _NNNN inserted before the extension if it has none
+inline std::string sequenceFileName(const std::string& pattern, int f) {
+    char buf[4096];
+    if (pattern.find('%') != std::string::npos) {
+        snprintf(buf, sizeof(buf), pattern.c_str(), f);
+        return buf;
+    }
+    size_t dot = pattern.rfind('.');
+    if (dot == std::string::npos) dot = pattern.size();
+    snprintf(buf, sizeof(buf), "_%04d", f);
+    return pattern.substr(0, dot) + buf + pattern.substr(dot);
+}
+
+// NEW: Renders every frame of 'sequence' in one process. The scene, its
+// materials and its BVH stay in memory; moved spheres only refit the BVH.
+// Frames alternate between two buffers and each is written out on its own
+// thread, so frame k+1 is placed and traced while frame k is being encoded.
+// With Renderer::setIncremental and a fixed camera, each frame starts as a
+// copy of the last one and re-traces only the tiles the moved spheres touch
+inline bool renderSequence(Renderer& renderer, Scene& scene, const Camera& base, const Sequence& sequence,
+                           int width, int height, const std::string& pattern) {
+    if (sequence.maxSphereIndex() >= int(scene.soa.size())) {
+        std::cerr << "Sequence moves sphere " << sequence.maxSphereIndex() << ", but the scene has "
+                  << scene.soa.size() << std::endl;
+        return false;
+    }
+    
+    renderer.setVerbose(false);
+    FrameBuffer buffers[2] = {FrameBuffer(width, height, FrameBuffer::Untouched()),
+                              FrameBuffer(width, height, FrameBuffer::Untouched())};
+    std::future<bool> writing;      // the previous frame
+    std::string writing_name;
+    int rebuilds = 0;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    
+    for (int f = 0; f < sequence.frames; f++) {
+        auto frame_start = std::chrono::high_resolution_clock::now();
+        bool rebuilt = false;
+        if (sequence.movesSpheres()) {
+            sequence.placeSpheres(f, scene);
+            rebuilt = scene.refitBVH();
+            rebuilds += rebuilt;
+            
+            // The spheres moved under an unchanged view
+            renderer.resetAccumulation();
+        }
+        Camera camera = sequence.cameraAt(f, base);
+        
+        // The write two frames back used this buffer and has finished: the
+        // last frame's write is awaited below before this one's starts
+        FrameBuffer& target = buffers[f & 1];
+        if (f > 0 && renderer.incrementalRendering() && !sequence.movesCamera()) target = buffers[(f - 1) & 1];
+        RenderStats stats;
+        do {
+            renderer.render(scene, camera, target);
+            stats = renderer.stats();
+        } while (renderer.refining(scene));
+        renderer.resolve(target);
+        auto frame_end = std::chrono::high_resolution_clock::now();
+        
+        if (writing.valid() && !writing.get()) {
+            std::cerr << "Failed to write " << writing_name << std::endl;
+            return false;
+        }
+        writing_name = sequenceFileName(pattern, f);
+        writing = std::async(std::launch::async, [&target, writing_name]() { return target.save(writing_name); });
+        
+        std::cout << "Frame " << f + 1 << "/" << sequence.frames << ": "
+                  << std::chrono::duration<double>(frame_end - frame_start).count() << " s, "
+                  << (stats.raysPerSecond() / 1000000.0) << " Mrays/sec"
+                  << (sequence.movesSpheres() ? (rebuilt ? ", BVH rebuilt" : ", BVH refit") : "")
+                  << (stats.tiles_traced < stats.tiles ? ", " + std::to_string(stats.tiles_traced) + "/" +
+                      std::to_string(stats.tiles) + " tiles re-traced" : "")
+                  << " -> " << writing_name << std::endl;
+    }
+    
+    if (writing.valid() && !writing.get()) {
+        std::cerr << "Failed to write " << writing_name << std::endl;
+        return false;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count();
+    std::cout << "Rendered " << sequence.frames << " frames in " << seconds << " seconds";
+    if (sequence.movesSpheres()) std::cout << " (" << rebuilds << " BVH rebuilds)";
+    std::cout << std::endl;
+    return true;
+}
@@ -0,0 +1,621 @@
+// Structure-of-arrays sphere storage and the SIMD intersection kernels
+#pragma once
+
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <vector>
+#include <immintrin.h>
+
+#include "geometry.h"
+
+// 64-byte aligned storage so the SoA arrays line up with cache lines and SIMD loads
+template <typename T>
+struct AlignedAllocator {
+    typedef T value_type;
+    static const size_t ALIGNMENT = 64;
+    
+    AlignedAllocator() {}
+    template <typename U> AlignedAllocator(const AlignedAllocator<U>&) {}
+    
+    T* allocate(size_t n) {
+        void* p = nullptr;
+        if (posix_memalign(&p, ALIGNMENT, n * sizeof(T)) != 0) throw std::bad_alloc();
+        return static_cast<T*>(p);
+    }
+    void deallocate(T* p, size_t) { free(p); }
+    
+    template <typename U> struct rebind { typedef AlignedAllocator<U> other; };
+    template <typename U> bool operator==(const AlignedAllocator<U>&) const { return true; }
+    template <typename U> bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// NEW: Read-mostly array that either owns aligned storage or views memory it
+// doesn't own (a memory-mapped binary scene). Writes on a view copy it into
+// owned storage first, so mapped scenes can still be edited
+template <typename T>
+class MappedArray {
+public:
+    MappedArray() : ptr(nullptr), count(0), mapped(false) {}
+    MappedArray(const MappedArray& o) : owned(o.owned), ptr(o.ptr), count(o.count), mapped(o.mapped) { sync(); }
+    MappedArray(MappedArray&& o) : owned(std::move(o.owned)), ptr(o.ptr), count(o.count), mapped(o.mapped) { sync(); }
+    
+    MappedArray& operator=(const MappedArray& o) {
+        owned = o.owned;
+        ptr = o.ptr;
+        count = o.count;
+        mapped = o.mapped;
+        sync();
+        return *this;
+    }
+    MappedArray& operator=(MappedArray&& o) {
+        owned = std::move(o.owned);
+        ptr = o.ptr;
+        count = o.count;
+        mapped = o.mapped;
+        sync();
+        return *this;
+    }
+    
+    const T& operator[](size_t i) const { return ptr[i]; }
+    const T* data() const { return ptr; }
+    const T* begin() const { return ptr; }
+    const T* end() const { return ptr + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool isMapped() const { return mapped; }
+    
+    void clear() {
+        owned.clear();
+        mapped = false;
+        sync();
+    }
+    void reserve(size_t n) {
+        detach();
+        owned.reserve(n);
+        sync();
+    }
+    void push_back(const T& v) {
+        detach();
+        owned.push_back(v);
+        sync();
+    }
+    template <typename It>
+    void assign(It first, It last) {
+        owned.assign(first, last);
+        mapped = false;
+        sync();
+    }
+    
+    // Writable access; a mapped view is copied into owned storage first
+    T* mutableData() {
+        detach();
+        return owned.data();
+    }
+    
+    // Points at n elements owned by someone else, who has to keep them alive
+    void view(const T* p, size_t n) {
+        AlignedVector<T>().swap(owned);
+        ptr = p;
+        count = n;
+        mapped = true;
+    }
+
+private:
+    AlignedVector<T> owned;
+    const T* ptr;
+    size_t count;
+    bool mapped;
+    
+    void sync() {
+        if (mapped) return;
+        ptr = owned.data();
+        count = owned.size();
+    }
+    
+    void detach() {
+        if (!mapped) return;
+        owned.assign(ptr, ptr + count);
+        mapped = false;
+        sync();
+    }
+};
+
+// OPTIMIZATION 5: Structure-of-arrays mirror of the scene spheres
+// Intersection only touches centers and r², so they live in their own
+// tightly packed arrays; materials are referenced by index
+struct SphereSoA {
+    MappedArray<Real> cx, cy, cz, r2;
+    MappedArray<int> material;       // index into Scene::materials
+    MappedArray<int> sphere_index;   // insertion order, i.e. index into Scene::spheres
+    
+    size_t size() const { return cx.size(); }
+    
+    void clear() {
+        cx.clear(); cy.clear(); cz.clear(); r2.clear();
+        material.clear();
+        sphere_index.clear();
+    }
+    
+    void reserve(size_t n) {
+        cx.reserve(n); cy.reserve(n); cz.reserve(n); r2.reserve(n);
+        material.reserve(n);
+        sphere_index.reserve(n);
+    }
+    
+    void push(const Vec3& c, Real radius, int mat, int idx) {
+        cx.push_back(c.x);
+        cy.push_back(c.y);
+        cz.push_back(c.z);
+        r2.push_back(radius * radius);
+        material.push_back(mat);
+        sphere_index.push_back(idx);
+    }
+    
+    // Owned copies of o's arrays, even where o views a mapped file
+    void copyFrom(const SphereSoA& o) {
+        cx.assign(o.cx.begin(), o.cx.end());
+        cy.assign(o.cy.begin(), o.cy.end());
+        cz.assign(o.cz.begin(), o.cz.end());
+        r2.assign(o.r2.begin(), o.r2.end());
+        material.assign(o.material.begin(), o.material.end());
+        sphere_index.assign(o.sphere_index.begin(), o.sphere_index.end());
+    }
+    
+    Vec3 center(int i) const { return Vec3(cx[i], cy[i], cz[i]); }
+    Real radius(int i) const { return std::sqrt(r2[i]); }
+    
+    // Reorder so that slot i holds what was previously in slot order[i]
+    void permute(const std::vector<int>& order) {
+        SphereSoA out;
+        out.reserve(order.size());
+        for (int i : order) {
+            out.cx.push_back(cx[i]);
+            out.cy.push_back(cy[i]);
+            out.cz.push_back(cz[i]);
+            out.r2.push_back(r2[i]);
+            out.material.push_back(material[i]);
+            out.sphere_index.push_back(sphere_index[i]);
+        }
+        std::swap(*this, out);
+    }
+};
+
+// SIMD batch intersection: one ray against the contiguous slots [first, first + count)
+// Same semantics as Sphere::intersect (nearest root with t > hitEpsilon(r²)).
+// Updates closest_t/hit_slot for the closest hit; the any-hit variant returns
+// on the first root below max_distance. One register holds 8 doubles or 16
+// floats with AVX-512, half that with AVX2
+#if defined(__AVX512F__)
+static const int SIMD_LANES = 64 / sizeof(Real);
+#elif defined(__AVX2__)
+static const int SIMD_LANES = 32 / sizeof(Real);
+#else
+static const int SIMD_LANES = 1;
+#endif
+
+#if defined(__AVX512F__)
+// Zero-masked forms of min/max: the unmasked intrinsics trip GCC 12's
+// -Wmaybe-uninitialized through their undefined pass-through operand
+static inline __m512d min8(__m512d a, __m512d b) { return _mm512_maskz_min_pd(0xFF, a, b); }
+static inline __m512d max8(__m512d a, __m512d b) { return _mm512_maskz_max_pd(0xFF, a, b); }
+static inline __m512 max16(__m512 a, __m512 b) { return _mm512_maskz_max_ps(0xFFFF, a, b); }
+#endif
+
+#if defined(__AVX512F__) && defined(RAYTRACER_DOUBLE)
+// Returns the lanes with a valid root and writes the chosen roots to t_out
+static inline __mmask8 sphereRoots8(const SphereSoA& soa, int i, __mmask8 live, const Ray& ray, double* t_out) {
+    __m512d cx = _mm512_maskz_loadu_pd(live, &soa.cx[i]);
+    __m512d cy = _mm512_maskz_loadu_pd(live, &soa.cy[i]);
+    __m512d cz = _mm512_maskz_loadu_pd(live, &soa.cz[i]);
+    __m512d r2 = _mm512_maskz_loadu_pd(live, &soa.r2[i]);
+    
+    __m512d ocx = _mm512_sub_pd(_mm512_set1_pd(ray.origin.x), cx);
+    __m512d ocy = _mm512_sub_pd(_mm512_set1_pd(ray.origin.y), cy);
+    __m512d ocz = _mm512_sub_pd(_mm512_set1_pd(ray.origin.z), cz);
+    __m512d dx = _mm512_set1_pd(ray.direction.x);
+    __m512d dy = _mm512_set1_pd(ray.direction.y);
+    __m512d dz = _mm512_set1_pd(ray.direction.z);
+    
+    __m512d b_half = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(ocx, dx), _mm512_mul_pd(ocy, dy)), _mm512_mul_pd(ocz, dz));
+    __m512d c = _mm512_sub_pd(_mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(ocx, ocx), _mm512_mul_pd(ocy, ocy)),
+                                            _mm512_mul_pd(ocz, ocz)), r2);
+    __m512d disc = _mm512_sub_pd(_mm512_mul_pd(b_half, b_half), c);
+    
+    __m512d zero = _mm512_setzero_pd();
+    __mmask8 has_root = _mm512_mask_cmp_pd_mask(live, disc, zero, _CMP_GE_OQ);
+    if (!has_root) return 0;
+    
+    __m512d eps = max8(_mm512_set1_pd(0.001), _mm512_mul_pd(r2, _mm512_set1_pd(Precision<double>::relativeEpsilon())));
+    __m512d sqrt_disc = _mm512_maskz_sqrt_pd(has_root, disc);
+    __m512d neg_b = _mm512_sub_pd(zero, b_half);
+    __m512d t1 = _mm512_sub_pd(neg_b, sqrt_disc);
+    __m512d t2 = _mm512_add_pd(neg_b, sqrt_disc);
+    __mmask8 near_ok = _mm512_mask_cmp_pd_mask(has_root, t1, eps, _CMP_GT_OQ);
+    __mmask8 far_ok = _mm512_mask_cmp_pd_mask(has_root & ~near_ok, t2, eps, _CMP_GT_OQ);
+    _mm512_storeu_pd(t_out, _mm512_mask_blend_pd(near_ok, t2, t1));
+    return near_ok | far_ok;
+}
+#elif defined(__AVX512F__)
+static inline __mmask16 sphereRoots16(const SphereSoA& soa, int i, __mmask16 live, const Ray& ray, float* t_out) {
+    __m512 cx = _mm512_maskz_loadu_ps(live, &soa.cx[i]);
+    __m512 cy = _mm512_maskz_loadu_ps(live, &soa.cy[i]);
+    __m512 cz = _mm512_maskz_loadu_ps(live, &soa.cz[i]);
+    __m512 r2 = _mm512_maskz_loadu_ps(live, &soa.r2[i]);
+    
+    __m512 ocx = _mm512_sub_ps(_mm512_set1_ps(ray.origin.x), cx);
+    __m512 ocy = _mm512_sub_ps(_mm512_set1_ps(ray.origin.y), cy);
+    __m512 ocz = _mm512_sub_ps(_mm512_set1_ps(ray.origin.z), cz);
+    __m512 dx = _mm512_set1_ps(ray.direction.x);
+    __m512 dy = _mm512_set1_ps(ray.direction.y);
+    __m512 dz = _mm512_set1_ps(ray.direction.z);
+    
+    __m512 b_half = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ocx, dx), _mm512_mul_ps(ocy, dy)), _mm512_mul_ps(ocz, dz));
+    __m512 c = _mm512_sub_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ocx, ocx), _mm512_mul_ps(ocy, ocy)),
+                                           _mm512_mul_ps(ocz, ocz)), r2);
+    __m512 disc = _mm512_sub_ps(_mm512_mul_ps(b_half, b_half), c);
+    
+    __m512 zero = _mm512_setzero_ps();
+    __mmask16 has_root = _mm512_mask_cmp_ps_mask(live, disc, zero, _CMP_GE_OQ);
+    if (!has_root) return 0;
+    
+    __m512 eps = max16(_mm512_set1_ps(0.001f), _mm512_mul_ps(r2, _mm512_set1_ps(Precision<float>::relativeEpsilon())));
+    __m512 sqrt_disc = _mm512_maskz_sqrt_ps(has_root, disc);
+    __m512 neg_b = _mm512_sub_ps(zero, b_half);
+    __m512 t1 = _mm512_sub_ps(neg_b, sqrt_disc);
+    __m512 t2 = _mm512_add_ps(neg_b, sqrt_disc);
+    __mmask16 near_ok = _mm512_mask_cmp_ps_mask(has_root, t1, eps, _CMP_GT_OQ);
+    __mmask16 far_ok = _mm512_mask_cmp_ps_mask(has_root & ~near_ok, t2, eps, _CMP_GT_OQ);
+    _mm512_storeu_ps(t_out, _mm512_mask_blend_ps(near_ok, t2, t1));
+    return near_ok | far_ok;
+}
+#elif defined(__AVX2__) && defined(RAYTRACER_DOUBLE)
+static inline int sphereRoots4(const SphereSoA& soa, int i, int n, const Ray& ray, double* t_out) {
+    __m256d cx, cy, cz, r2;
+    if (n == 4) {
+        cx = _mm256_loadu_pd(&soa.cx[i]);
+        cy = _mm256_loadu_pd(&soa.cy[i]);
+        cz = _mm256_loadu_pd(&soa.cz[i]);
+        r2 = _mm256_loadu_pd(&soa.r2[i]);
+    } else {
+        __m256i lane = _mm256_set_epi64x(3, 2, 1, 0);
+        __m256i live = _mm256_cmpgt_epi64(_mm256_set1_epi64x(n), lane);
+        cx = _mm256_maskload_pd(&soa.cx[i], live);
+        cy = _mm256_maskload_pd(&soa.cy[i], live);
+        cz = _mm256_maskload_pd(&soa.cz[i], live);
+        r2 = _mm256_maskload_pd(&soa.r2[i], live);
+    }
+    
+    __m256d ocx = _mm256_sub_pd(_mm256_set1_pd(ray.origin.x), cx);
+    __m256d ocy = _mm256_sub_pd(_mm256_set1_pd(ray.origin.y), cy);
+    __m256d ocz = _mm256_sub_pd(_mm256_set1_pd(ray.origin.z), cz);
+    __m256d dx = _mm256_set1_pd(ray.direction.x);
+    __m256d dy = _mm256_set1_pd(ray.direction.y);
+    __m256d dz = _mm256_set1_pd(ray.direction.z);
+    
+    __m256d b_half = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, dx), _mm256_mul_pd(ocy, dy)), _mm256_mul_pd(ocz, dz));
+    __m256d c = _mm256_sub_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, ocx), _mm256_mul_pd(ocy, ocy)),
+                                            _mm256_mul_pd(ocz, ocz)), r2);
+    __m256d disc = _mm256_sub_pd(_mm256_mul_pd(b_half, b_half), c);
+    
+    __m256d zero = _mm256_setzero_pd();
+    int live_bits = (1 << n) - 1;
+    int has_root = _mm256_movemask_pd(_mm256_cmp_pd(disc, zero, _CMP_GE_OQ)) & live_bits;
+    if (!has_root) return 0;
+    
+    __m256d eps = _mm256_max_pd(_mm256_set1_pd(0.001), _mm256_mul_pd(r2, _mm256_set1_pd(Precision<double>::relativeEpsilon())));
+    __m256d sqrt_disc = _mm256_sqrt_pd(_mm256_max_pd(disc, zero));
+    __m256d neg_b = _mm256_sub_pd(zero, b_half);
+    __m256d t1 = _mm256_sub_pd(neg_b, sqrt_disc);
+    __m256d t2 = _mm256_add_pd(neg_b, sqrt_disc);
+    __m256d near_mask = _mm256_cmp_pd(t1, eps, _CMP_GT_OQ);
+    int near_ok = _mm256_movemask_pd(near_mask) & has_root;
+    int far_ok = _mm256_movemask_pd(_mm256_cmp_pd(t2, eps, _CMP_GT_OQ)) & has_root & ~near_ok;
+    _mm256_storeu_pd(t_out, _mm256_blendv_pd(t2, t1, near_mask));
+    return near_ok | far_ok;
+}
+#elif defined(__AVX2__)
+static inline int sphereRoots8(const SphereSoA& soa, int i, int n, const Ray& ray, float* t_out) {
+    __m256 cx, cy, cz, r2;
+    if (n == 8) {
+        cx = _mm256_loadu_ps(&soa.cx[i]);
+        cy = _mm256_loadu_ps(&soa.cy[i]);
+        cz = _mm256_loadu_ps(&soa.cz[i]);
+        r2 = _mm256_loadu_ps(&soa.r2[i]);
+    } else {
+        __m256i lane = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+        __m256i live = _mm256_cmpgt_epi32(_mm256_set1_epi32(n), lane);
+        cx = _mm256_maskload_ps(&soa.cx[i], live);
+        cy = _mm256_maskload_ps(&soa.cy[i], live);
+        cz = _mm256_maskload_ps(&soa.cz[i], live);
+        r2 = _mm256_maskload_ps(&soa.r2[i], live);
+    }
+    
+    __m256 ocx = _mm256_sub_ps(_mm256_set1_ps(ray.origin.x), cx);
+    __m256 ocy = _mm256_sub_ps(_mm256_set1_ps(ray.origin.y), cy);
+    __m256 ocz = _mm256_sub_ps(_mm256_set1_ps(ray.origin.z), cz);
+    __m256 dx = _mm256_set1_ps(ray.direction.x);
+    __m256 dy = _mm256_set1_ps(ray.direction.y);
+    __m256 dz = _mm256_set1_ps(ray.direction.z);
+    
+    __m256 b_half = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, dx), _mm256_mul_ps(ocy, dy)), _mm256_mul_ps(ocz, dz));
+    __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)),
+                                           _mm256_mul_ps(ocz, ocz)), r2);
+    __m256 disc = _mm256_sub_ps(_mm256_mul_ps(b_half, b_half), c);
+    
+    __m256 zero = _mm256_setzero_ps();
+    int live_bits = (1 << n) - 1;
+    int has_root = _mm256_movemask_ps(_mm256_cmp_ps(disc, zero, _CMP_GE_OQ)) & live_bits;
+    if (!has_root) return 0;
+    
+    __m256 eps = _mm256_max_ps(_mm256_set1_ps(0.001f), _mm256_mul_ps(r2, _mm256_set1_ps(Precision<float>::relativeEpsilon())));
+    __m256 sqrt_disc = _mm256_sqrt_ps(_mm256_max_ps(disc, zero));
+    __m256 neg_b = _mm256_sub_ps(zero, b_half);
+    __m256 t1 = _mm256_sub_ps(neg_b, sqrt_disc);
+    __m256 t2 = _mm256_add_ps(neg_b, sqrt_disc);
+    __m256 near_mask = _mm256_cmp_ps(t1, eps, _CMP_GT_OQ);
+    int near_ok = _mm256_movemask_ps(near_mask) & has_root;
+    int far_ok = _mm256_movemask_ps(_mm256_cmp_ps(t2, eps, _CMP_GT_OQ)) & has_root & ~near_ok;
+    _mm256_storeu_ps(t_out, _mm256_blendv_ps(t2, t1, near_mask));
+    return near_ok | far_ok;
+}
+#endif
+
+// Lanes with a valid root among slots [i, i + n), n <= SIMD_LANES
+static inline unsigned sphereRoots(const SphereSoA& soa, int i, int n, const Ray& ray, Real* t_out) {
+#if defined(__AVX512F__) && defined(RAYTRACER_DOUBLE)
+    return sphereRoots8(soa, i, __mmask8((1u << n) - 1), ray, t_out);
+#elif defined(__AVX512F__)
+    return sphereRoots16(soa, i, __mmask16((1u << n) - 1), ray, t_out);
+#elif defined(__AVX2__) && defined(RAYTRACER_DOUBLE)
+    return unsigned(sphereRoots4(soa, i, n, ray, t_out));
+#elif defined(__AVX2__)
+    return unsigned(sphereRoots8(soa, i, n, ray, t_out));
+#else
+    (void)n;
+    Vec3 oc = ray.origin - soa.center(i);
+    Real b_half = oc.dot(ray.direction);
+    Real disc = b_half * b_half - (oc.lengthSquared() - soa.r2[i]);
+    if (disc < 0) return 0;
+    Real eps = hitEpsilon(soa.r2[i]);
+    Real sqrt_disc = std::sqrt(disc);
+    Real t1 = -b_half - sqrt_disc;
+    Real t2 = -b_half + sqrt_disc;
+    t_out[0] = t1 > eps ? t1 : t2;
+    return t_out[0] > eps ? 1u : 0u;
+#endif
+}
+
+static inline void intersectSpheresSIMD(const SphereSoA& soa, int first, int count, const Ray& ray,
+                                        Real& closest_t, int& hit_slot) {
+    Real t[SIMD_LANES];
+    for (int i = first; i < first + count; i += SIMD_LANES) {
+        unsigned mask = sphereRoots(soa, i, std::min(SIMD_LANES, first + count - i), ray, t);
+        // Lowest lane first, strict '<', so ties resolve like the scalar loop
+        while (mask) {
+            int lane = __builtin_ctz(mask);
+            mask &= mask - 1;
+            if (t[lane] < closest_t) {
+                closest_t = t[lane];
+                hit_slot = i + lane;
+            }
+        }
+    }
+}
+
+// Returns the slot of the first sphere with a root below max_distance, or -1
+static inline int anySphereSIMD(const SphereSoA& soa, int first, int count, const Ray& ray, Real max_distance) {
+    Real t[SIMD_LANES];
+    for (int i = first; i < first + count; i += SIMD_LANES) {
+        unsigned mask = sphereRoots(soa, i, std::min(SIMD_LANES, first + count - i), ray, t);
+        while (mask) {
+            int lane = __builtin_ctz(mask);
+            mask &= mask - 1;
+            if (t[lane] < max_distance) return i + lane;
+        }
+    }
+    return -1;
+}
+
+// OPTIMIZATION 7: 8-wide ray packets in SoA layout
+// Each per-lane loop below runs over all PACKET_SIZE lanes and selects with
+// the 'active' mask, so the compiler can vectorize it across the packet
+static const int PACKET_SIZE = 8;
+
+struct RayPacket {
+    alignas(64) Real ox[PACKET_SIZE];
+    alignas(64) Real oy[PACKET_SIZE];
+    alignas(64) Real oz[PACKET_SIZE];
+    alignas(64) Real dx[PACKET_SIZE];
+    alignas(64) Real dy[PACKET_SIZE];
+    alignas(64) Real dz[PACKET_SIZE];
+    alignas(64) Real t[PACKET_SIZE];     // closest hit so far, or max distance for any-hit
+    int hit[PACKET_SIZE];                // SoA slot, -1 on miss
+    unsigned active;                     // bit per live lane
+    
+    void set(int lane, const Ray& ray, Real t_max) {
+        ox[lane] = ray.origin.x; oy[lane] = ray.origin.y; oz[lane] = ray.origin.z;
+        dx[lane] = ray.direction.x; dy[lane] = ray.direction.y; dz[lane] = ray.direction.z;
+        t[lane] = t_max;
+        hit[lane] = -1;
+    }
+    
+    Vec3 origin(int lane) const { return Vec3(ox[lane], oy[lane], oz[lane]); }
+    Vec3 direction(int lane) const { return Vec3(dx[lane], dy[lane], dz[lane]); }
+    Vec3 at(int lane) const { return origin(lane) + direction(lane) * t[lane]; }
+    
+    // Fills unused lanes with harmless copies of lane 0 so full-width loops stay finite
+    void padFrom(int count) {
+        for (int k = count; k < PACKET_SIZE; k++) {
+            ox[k] = ox[0]; oy[k] = oy[0]; oz[k] = oz[0];
+            dx[k] = dx[0]; dy[k] = dy[0]; dz[k] = dz[0];
+            t[k] = t[0];
+            hit[k] = -1;
+        }
+    }
+};
+
+// Packet leaf kernels: every active lane against each slot in [first, first + count)
+// Same root selection as Sphere::intersect. A packet fills one AVX-512
+// register in double and one AVX register in float
+#if defined(__AVX512F__) && defined(RAYTRACER_DOUBLE)
+#define PACKET_KERNEL_AVX512 1
+
+// Chosen root per lane (disc >= 0 and t > hitEpsilon), as a lane mask
+static inline __mmask8 packetRoots8(const SphereSoA& soa, int s, const RayPacket& p, __m512d& t) {
+    __m512d ocx = _mm512_sub_pd(_mm512_load_pd(p.ox), _mm512_set1_pd(soa.cx[s]));
+    __m512d ocy = _mm512_sub_pd(_mm512_load_pd(p.oy), _mm512_set1_pd(soa.cy[s]));
+    __m512d ocz = _mm512_sub_pd(_mm512_load_pd(p.oz), _mm512_set1_pd(soa.cz[s]));
+    __m512d b_half = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(ocx, _mm512_load_pd(p.dx)), _mm512_mul_pd(ocy, _mm512_load_pd(p.dy))),
+                                   _mm512_mul_pd(ocz, _mm512_load_pd(p.dz)));
+    __m512d c = _mm512_sub_pd(_mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(ocx, ocx), _mm512_mul_pd(ocy, ocy)), _mm512_mul_pd(ocz, ocz)),
+                              _mm512_set1_pd(soa.r2[s]));
+    __m512d disc = _mm512_sub_pd(_mm512_mul_pd(b_half, b_half), c);
+    __mmask8 has_root = _mm512_cmp_pd_mask(disc, _mm512_setzero_pd(), _CMP_GE_OQ);
+    t = disc;
+    if (!has_root) return 0;
+    
+    __m512d eps = _mm512_set1_pd(hitEpsilon(soa.r2[s]));
+    __m512d sqrt_disc = _mm512_maskz_sqrt_pd(has_root, disc);
+    __m512d neg_b = _mm512_sub_pd(_mm512_setzero_pd(), b_half);
+    __m512d t1 = _mm512_sub_pd(neg_b, sqrt_disc);
+    __m512d t2 = _mm512_add_pd(neg_b, sqrt_disc);
+    __mmask8 near_ok = _mm512_cmp_pd_mask(t1, eps, _CMP_GT_OQ);
+    t = _mm512_mask_blend_pd(near_ok, t2, t1);
+    return _mm512_mask_cmp_pd_mask(has_root, t, eps, _CMP_GT_OQ);
+}
+#elif defined(__AVX2__) && !defined(RAYTRACER_DOUBLE)
+#define PACKET_KERNEL_AVX 1
+
+// Expands the low 8 bits of 'lanes' into an all-ones/all-zeros lane mask
+static inline __m256 laneMask8(unsigned lanes) {
+    __m256i bits = _mm256_set_epi32(128, 64, 32, 16, 8, 4, 2, 1);
+    return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(int(lanes)), bits), bits));
+}
+
+// Chosen root per lane (disc >= 0 and t > hitEpsilon), as a lane mask
+static inline __m256 packetRoots8(const SphereSoA& soa, int s, const RayPacket& p, __m256& t) {
+    __m256 ocx = _mm256_sub_ps(_mm256_load_ps(p.ox), _mm256_set1_ps(soa.cx[s]));
+    __m256 ocy = _mm256_sub_ps(_mm256_load_ps(p.oy), _mm256_set1_ps(soa.cy[s]));
+    __m256 ocz = _mm256_sub_ps(_mm256_load_ps(p.oz), _mm256_set1_ps(soa.cz[s]));
+    __m256 b_half = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, _mm256_load_ps(p.dx)), _mm256_mul_ps(ocy, _mm256_load_ps(p.dy))),
+                                  _mm256_mul_ps(ocz, _mm256_load_ps(p.dz)));
+    __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)), _mm256_mul_ps(ocz, ocz)),
+                             _mm256_set1_ps(soa.r2[s]));
+    __m256 disc = _mm256_sub_ps(_mm256_mul_ps(b_half, b_half), c);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 has_root = _mm256_cmp_ps(disc, zero, _CMP_GE_OQ);
+    t = disc;
+    if (_mm256_testz_ps(has_root, has_root)) return has_root;
+    
+    __m256 eps = _mm256_set1_ps(hitEpsilon(soa.r2[s]));
+    __m256 sqrt_disc = _mm256_sqrt_ps(_mm256_max_ps(disc, zero));
+    __m256 neg_b = _mm256_sub_ps(zero, b_half);
+    __m256 t1 = _mm256_sub_ps(neg_b, sqrt_disc);
+    __m256 t2 = _mm256_add_ps(neg_b, sqrt_disc);
+    t = _mm256_blendv_ps(t2, t1, _mm256_cmp_ps(t1, eps, _CMP_GT_OQ));
+    return _mm256_and_ps(has_root, _mm256_cmp_ps(t, eps, _CMP_GT_OQ));
+}
+#endif
+
+static inline void intersectPacketSpheres(const SphereSoA& soa, int first, int count, RayPacket& p, unsigned lanes) {
+#if defined(PACKET_KERNEL_AVX512)
+    __m512d closest = _mm512_load_pd(p.t);
+    __m256i hit = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p.hit));
+    for (int s = first; s < first + count; s++) {
+        __m512d t;
+        __mmask8 ok = packetRoots8(soa, s, p, t) & __mmask8(lanes);
+        ok = _mm512_mask_cmp_pd_mask(ok, t, closest, _CMP_LT_OQ);
+        closest = _mm512_mask_blend_pd(ok, closest, t);
+        hit = _mm256_mask_blend_epi32(ok, hit, _mm256_set1_epi32(s));
+    }
+    _mm512_store_pd(p.t, closest);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p.hit), hit);
+#elif defined(PACKET_KERNEL_AVX)
+    __m256 closest = _mm256_load_ps(p.t);
+    __m256 hit = _mm256_castsi256_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p.hit)));
+    __m256 live = laneMask8(lanes);
+    for (int s = first; s < first + count; s++) {
+        __m256 t;
+        __m256 ok = _mm256_and_ps(packetRoots8(soa, s, p, t), live);
+        ok = _mm256_and_ps(ok, _mm256_cmp_ps(t, closest, _CMP_LT_OQ));
+        closest = _mm256_blendv_ps(closest, t, ok);
+        hit = _mm256_blendv_ps(hit, _mm256_castsi256_ps(_mm256_set1_epi32(s)), ok);
+    }
+    _mm256_store_ps(p.t, closest);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p.hit), _mm256_castps_si256(hit));
+#else
+    for (int s = first; s < first + count; s++) {
+        Real cx = soa.cx[s], cy = soa.cy[s], cz = soa.cz[s], r2 = soa.r2[s];
+        Real eps = hitEpsilon(r2);
+        #pragma omp simd
+        for (int k = 0; k < PACKET_SIZE; k++) {
+            Real ocx = p.ox[k] - cx, ocy = p.oy[k] - cy, ocz = p.oz[k] - cz;
+            Real b_half = ocx * p.dx[k] + ocy * p.dy[k] + ocz * p.dz[k];
+            Real c = ocx * ocx + ocy * ocy + ocz * ocz - r2;
+            Real disc = b_half * b_half - c;
+            Real sqrt_disc = std::sqrt(disc > 0 ? disc : 0);
+            Real t1 = -b_half - sqrt_disc;
+            Real t2 = -b_half + sqrt_disc;
+            Real t = t1 > eps ? t1 : t2;
+            bool ok = ((lanes >> k) & 1) & (disc >= 0) & (t > eps) & (t < p.t[k]);
+            p.t[k] = ok ? t : p.t[k];
+            p.hit[k] = ok ? s : p.hit[k];
+        }
+    }
+#endif
+}
+
+// Returns the lanes (of 'lanes') that hit something closer than their p.t.
+// 'blocker', if given, receives the last slot that occluded any of them
+static inline unsigned occludedPacketSpheres(const SphereSoA& soa, int first, int count, const RayPacket& p, unsigned lanes,
+                                             int* blocker = nullptr) {
+    unsigned occluded = 0;
+#if defined(PACKET_KERNEL_AVX512)
+    __m512d max_t = _mm512_load_pd(p.t);
+    for (int s = first; s < first + count && occluded != lanes; s++) {
+        __m512d t;
+        __mmask8 ok = packetRoots8(soa, s, p, t) & __mmask8(lanes & ~occluded);
+        unsigned hit = _mm512_mask_cmp_pd_mask(ok, t, max_t, _CMP_LT_OQ);
+        if (hit && blocker) *blocker = s;
+        occluded |= hit;
+    }
+#elif defined(PACKET_KERNEL_AVX)
+    __m256 max_t = _mm256_load_ps(p.t);
+    for (int s = first; s < first + count && occluded != lanes; s++) {
+        __m256 t;
+        __m256 ok = packetRoots8(soa, s, p, t);
+        ok = _mm256_and_ps(ok, _mm256_cmp_ps(t, max_t, _CMP_LT_OQ));
+        unsigned hit = unsigned(_mm256_movemask_ps(ok)) & lanes & ~occluded;
+        if (hit && blocker) *blocker = s;
+        occluded |= hit;
+    }
+#else
+    int blocked[PACKET_SIZE];
+    for (int s = first; s < first + count && occluded != lanes; s++) {
+        Real cx = soa.cx[s], cy = soa.cy[s], cz = soa.cz[s], r2 = soa.r2[s];
+        Real eps = hitEpsilon(r2);
+        #pragma omp simd
+        for (int k = 0; k < PACKET_SIZE; k++) {
+            Real ocx = p.ox[k] - cx, ocy = p.oy[k] - cy, ocz = p.oz[k] - cz;
+            Real b_half = ocx * p.dx[k] + ocy * p.dy[k] + ocz * p.dz[k];
+            Real c = ocx * ocx + ocy * ocy + ocz * ocz - r2;
+            Real disc = b_half * b_half - c;
+            Real sqrt_disc = std::sqrt(disc > 0 ? disc : 0);
+            Real t1 = -b_half - sqrt_disc;
+            Real t2 = -b_half + sqrt_disc;
+            Real t = t1 > eps ? t1 : t2;
+            blocked[k] = (disc >= 0) & (t > eps) & (t < p.t[k]);
+        }
+        unsigned hit = 0;
+        for (int k = 0; k < PACKET_SIZE; k++) hit |= unsigned(blocked[k]) << k;
+        hit &= lanes & ~occluded;
+        if (hit && blocker) *blocker = s;
+        occluded |= hit;
+    }
+#endif
+    return occluded;
+}
@@ -0,0 +1,174 @@
+// Render statistics: ray/sphere-test counters and optional per-stage timers.
+// Both are kept per thread on the hot path and merged once per frame
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <string>
+#include <ostream>
+
+struct RayCounters {
+    uint64_t primary;
+    uint64_t primary_cached; // camera rays whose first hit came from the G-buffer
+    uint64_t shadow;
+    uint64_t reflection;
+    uint64_t sphere_tests;  // ray-sphere tests, packets count one per live lane
+    uint64_t shadow_cached; // shadow rays the last-occluder cache answered
+    uint64_t lights_culled; // lights skipped without a shadow ray
+    uint64_t accel_jobs;    // sphere tests sent to the accelerator (--backend accel)
+    uint64_t accel_batches; // batches they went in
+    uint64_t accel_cpu;     // tests it couldn't take, done on the CPU instead
+    
+    RayCounters() : primary(0), primary_cached(0), shadow(0), reflection(0), sphere_tests(0), shadow_cached(0),
+                    lights_culled(0), accel_jobs(0), accel_batches(0), accel_cpu(0) {}
+    
+    uint64_t secondary() const { return shadow + reflection; }
+    uint64_t total() const { return primary + shadow + reflection; }
+    
+    RayCounters& operator+=(const RayCounters& o) {
+        primary += o.primary;
+        primary_cached += o.primary_cached;
+        shadow += o.shadow;
+        reflection += o.reflection;
+        sphere_tests += o.sphere_tests;
+        shadow_cached += o.shadow_cached;
+        lights_culled += o.lights_culled;
+        accel_jobs += o.accel_jobs;
+        accel_batches += o.accel_batches;
+        accel_cpu += o.accel_cpu;
+        return *this;
+    }
+};
+
+enum Stage {
+    STAGE_OTHER,        // scheduling and anything outside the stages below
+    STAGE_RAY_GEN,
+    STAGE_INTERSECT,    // BVH traversal + sphere tests, closest-hit and shadow
+    STAGE_SHADE,
+    STAGE_WRITE,        // framebuffer write
+    STAGE_COUNT
+};
+
+inline const char* stageName(int s) {
+    static const char* names[STAGE_COUNT] = {"Other", "Ray generation", "Intersection", "Shading", "Framebuffer write"};
+    return names[s];
+}
+
+// Exclusive time per stage: entering a stage charges the time since the last
+// switch to the stage being left, so nested stages are never double counted
+struct StageTimer {
+    typedef std::chrono::steady_clock Clock;
+    
+    double seconds[STAGE_COUNT];
+    int current;
+    Clock::time_point last;
+    
+    StageTimer() { reset(); }
+    
+    void reset() {
+        for (int s = 0; s < STAGE_COUNT; s++) seconds[s] = 0;
+        current = STAGE_OTHER;
+        last = Clock::now();
+    }
+    
+    // Returns the stage that was active, so the caller can switch back
+    int enter(int stage) {
+        Clock::time_point now = Clock::now();
+        seconds[current] += std::chrono::duration<double>(now - last).count();
+        last = now;
+        int previous = current;
+        current = stage;
+        return previous;
+    }
+};
+
+struct ThreadStats {
+    RayCounters rays;
+    StageTimer timer;
+};
+
+// The calling thread's statistics. Renderer::render() resets them when a
+// frame starts and sums every thread's copy when it finishes
+inline ThreadStats& threadStats() {
+    static thread_local ThreadStats stats;
+    return stats;
+}
+
+inline RayCounters& threadCounters() {
+    return threadStats().rays;
+}
+
+// Stage timers cost two clock reads per scope, so they're compiled in only
+// with -DRAYTRACER_PROFILE (make PROFILE=1)
+#ifdef RAYTRACER_PROFILE
+class ScopedStage {
+public:
+    explicit ScopedStage(int stage) : timer(threadStats().timer), previous(timer.enter(stage)) {}
+    ~ScopedStage() { timer.enter(previous); }
+
+private:
+    StageTimer& timer;
+    int previous;
+};
+#define PROFILE_STAGE(stage) ScopedStage profile_stage_scope(stage)
+static const bool PROFILING_ENABLED = true;
+#else
+#define PROFILE_STAGE(stage) ((void)0)
+static const bool PROFILING_ENABLED = false;
+#endif
+
+// Everything measured for one frame
+struct RenderStats {
+    RayCounters rays;
+    double stage_seconds[STAGE_COUNT];  // summed over threads (thread-seconds)
+    double frame_seconds;               // wall time
+    int threads;
+    uint64_t pixels, aa_pixels;         // pixels in the frame, and those given extra samples
+    int tiles, tiles_traced;            // tiles in the frame, and those an incremental frame re-traced
+    
+    RenderStats() : frame_seconds(0), threads(0), pixels(0), aa_pixels(0), tiles(0), tiles_traced(0) {
+        for (int s = 0; s < STAGE_COUNT; s++) stage_seconds[s] = 0;
+    }
+    
+    double raysPerSecond() const { return frame_seconds > 0 ? rays.total() / frame_seconds : 0; }
+    
+    void print(std::ostream& out) const {
+        out << "Render stats (" << threads << " threads, " << frame_seconds * 1000.0 << " ms):" << std::endl;
+        out << "  Primary rays:     " << rays.primary;
+        if (rays.primary_cached) out << " (" << rays.primary_cached << " more shaded from the G-buffer)";
+        out << std::endl;
+        out << "  Shadow rays:      " << rays.shadow << " (" << rays.shadow_cached << " hit the cached occluder, "
+            << rays.lights_culled << " lights culled)" << std::endl;
+        out << "  Reflection rays:  " << rays.reflection << std::endl;
+        out << "  Total rays:       " << rays.total() << " (" << raysPerSecond() / 1e6 << " Mrays/sec)" << std::endl;
+        out << "  Sphere tests:     " << rays.sphere_tests << " ("
+            << (rays.total() ? double(rays.sphere_tests) / rays.total() : 0.0) << " per ray)" << std::endl;
+        if (rays.accel_batches) {
+            out << "  Accelerator:      " << rays.accel_jobs << " jobs in " << rays.accel_batches << " batches ("
+                << double(rays.accel_jobs) / rays.accel_batches << " per batch), "
+                << rays.accel_cpu << " tests on the CPU" << std::endl;
+        }
+        if (tiles_traced < tiles) {
+            out << "  Incremental:      " << tiles_traced << " of " << tiles << " tiles re-traced ("
+                << 100.0 * tiles_traced / tiles << "%)" << std::endl;
+        }
+        if (aa_pixels) {
+            out << "  Antialiased:      " << aa_pixels << " pixels ("
+                << (pixels ? 100.0 * aa_pixels / pixels : 0.0) << "%)" << std::endl;
+        }
+        if (!PROFILING_ENABLED) {
+            out << "  Stage timers:     not compiled in (build with make PROFILE=1)" << std::endl;
+            return;
+        }
+        double busy = 0;
+        for (int s = 0; s < STAGE_COUNT; s++) busy += stage_seconds[s];
+        out << "  Stage times (thread-ms, exclusive):" << std::endl;
+        for (int s = 1; s <= STAGE_COUNT; s++) {
+            int stage = s % STAGE_COUNT;    // 'other' last
+            out << "    " << std::left << std::setw(20) << (std::string(stageName(stage)) + ":") << std::right
+                << stage_seconds[stage] * 1000.0 << " ms ("
+                << (busy > 0 ? 100.0 * stage_seconds[stage] / busy : 0.0) << "%)" << std::endl;
+        }
+    }
+};
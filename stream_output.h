@@ -0,0 +1,264 @@
+// Streaming output: images rendered band by band straight into their file
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "renderer.h"
+#include "camera.h"
+#include "framebuffer.h"
+
+// Writes an image top to bottom, a few rows at a time, without holding it:
+// PPM and PNG (stored deflate, one IDAT chunk per call) as 8-bit RGB, EXR as
+// uncompressed float scanlines, whose offset table is known up front
+class ScanlineWriter {
+public:
+    virtual ~ScanlineWriter() {
+        if (f) fclose(f);
+    }
+    
+    // Starts a width x height image at 'path'
+    virtual bool open(const std::string& path, int width, int height) = 0;
+    
+    // Appends rows [j0, j1) of 'band', resolved, below the rows written so far
+    virtual bool write(const FrameBuffer& band, int j0, int j1) = 0;
+    
+    // Finishes the file once every row has been written
+    virtual bool close() {
+        bool ok = f && !ferror(f);
+        if (f && fclose(f) != 0) ok = false;
+        f = nullptr;
+        return ok;
+    }
+    
+    // By extension, as FrameBuffer::save() picks it
+    static std::unique_ptr<ScanlineWriter> forPath(const std::string& path);
+
+protected:
+    FILE* f = nullptr;
+    int width = 0, height = 0;
+    
+    bool create(const std::string& path, int w, int h) {
+        f = fopen(path.c_str(), "wb");
+        width = w;
+        height = h;
+        return f != nullptr;
+    }
+};
+
+class PPMWriter : public ScanlineWriter {
+public:
+    bool open(const std::string& path, int w, int h) override {
+        if (!create(path, w, h)) return false;
+        fprintf(f, "P6\n%d %d\n255\n", w, h);
+        row.resize(size_t(w) * 3);
+        return true;
+    }
+    
+    bool write(const FrameBuffer& band, int j0, int j1) override {
+        for (int j = j0; j < j1; j++) {
+            band.rgbRow(j, row.data());
+            fwrite(row.data(), 1, row.size(), f);
+        }
+        return !ferror(f);
+    }
+
+private:
+    std::vector<uint8_t> row;
+};
+
+class PNGWriter : public ScanlineWriter {
+public:
+    bool open(const std::string& path, int w, int h) override {
+        if (!create(path, w, h)) return false;
+        FrameBuffer::writePNGHeader(f, w, h);
+        adler = 1;
+        started = false;
+        return true;
+    }
+    
+    bool write(const FrameBuffer& band, int j0, int j1) override {
+        size_t stride = size_t(width) * 3 + 1;
+        raw.resize(stride * (j1 - j0));
+        for (int j = j0; j < j1; j++) band.pngRow(j, &raw[stride * (j - j0)]);
+        adler = FrameBuffer::adler32(raw.data(), raw.size(), adler);
+        
+        std::vector<uint8_t> z;
+        if (!started) {
+            z.push_back(0x78);      // zlib header, as in FrameBuffer::savePNG()
+            z.push_back(0x01);
+            started = true;
+        }
+        FrameBuffer::storedBlocks(z, raw.data(), raw.size(), false);
+        FrameBuffer::writeChunk(f, "IDAT", z);
+        return !ferror(f);
+    }
+    
+    // An empty final block ends the deflate stream, then its checksum
+    bool close() override {
+        if (!f) return false;
+        std::vector<uint8_t> z;
+        if (!started) {
+            z.push_back(0x78);
+            z.push_back(0x01);
+        }
+        FrameBuffer::storedBlocks(z, nullptr, 0, true);
+        FrameBuffer::putBE32(z, adler);
+        FrameBuffer::writeChunk(f, "IDAT", z);
+        FrameBuffer::writeChunk(f, "IEND", std::vector<uint8_t>());
+        return ScanlineWriter::close();
+    }
+
+private:
+    std::vector<uint8_t> raw;
+    uint32_t adler = 1;
+    bool started = false;
+};
+
+class EXRWriter : public ScanlineWriter {
+public:
+    bool open(const std::string& path, int w, int h) override {
+        if (!create(path, w, h)) return false;
+        std::vector<uint8_t> out = FrameBuffer::exrHeader(w, h);
+        uint64_t offset = out.size() + uint64_t(h) * 8;
+        for (int j = 0; j < h; j++) {
+            FrameBuffer::putLE64(out, offset);
+            offset += FrameBuffer::exrLineBytes(w);
+        }
+        fwrite(out.data(), 1, out.size(), f);
+        line = 0;
+        return !ferror(f);
+    }
+    
+    bool write(const FrameBuffer& band, int j0, int j1) override {
+        std::vector<uint8_t> out;
+        out.reserve(size_t(FrameBuffer::exrLineBytes(width)) * (j1 - j0));
+        for (int j = j0; j < j1; j++) band.exrLine(out, j, line++);
+        fwrite(out.data(), 1, out.size(), f);
+        return !ferror(f);
+    }
+
+private:
+    int line = 0;
+};
+
+inline std::unique_ptr<ScanlineWriter> ScanlineWriter::forPath(const std::string& path) {
+    std::string ext = path.size() >= 4 ? path.substr(path.size() - 4) : "";
+    if (ext == ".png") return std::unique_ptr<ScanlineWriter>(new PNGWriter());
+    if (ext == ".exr") return std::unique_ptr<ScanlineWriter>(new EXRWriter());
+    return std::unique_ptr<ScanlineWriter>(new PPMWriter());
+}
+
+// NEW: Streaming renders for images too large to hold. The image is
+// rendered as bands of band_rows rows, each a window of the full frame (so
+// it gets the rays and seeds of a whole-image render, and with --aa a
+// one-row apron for edge detection), into one of 'ring' band buffers. A
+// writer thread appends the finished bands to the file in order while the
+// next ones render; the renderer waits only when every buffer is still
+// queued. Memory is O(ring * band_rows * width), not O(width * height)
+inline bool renderStreamed(Renderer& renderer, const Scene& scene, const Camera& camera, int width, int height,
+                           const std::string& path, int band_rows, int ring) {
+    band_rows = std::max(1, std::min(band_rows, height));
+    ring = std::max(2, ring);
+    std::unique_ptr<ScanlineWriter> writer = ScanlineWriter::forPath(path);
+    if (!writer->open(path, width, height)) {
+        std::cerr << "Cannot write " << path << std::endl;
+        return false;
+    }
+    
+    struct Band {
+        std::unique_ptr<FrameBuffer> target;
+        int j0, j1;                 // rows of 'target' that belong to the image band
+    };
+    std::vector<Band> slots(ring);
+    std::deque<int> queued;         // slots rendered and waiting for the writer, in order
+    std::vector<int> free_slots;
+    for (int s = ring - 1; s >= 0; s--) free_slots.push_back(s);
+    std::mutex lock;
+    std::condition_variable changed;
+    bool done = false, failed = false;
+    
+    std::thread writing([&]() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            changed.wait(guard, [&]() { return !queued.empty() || done; });
+            if (queued.empty()) return;
+            int s = queued.front();
+            queued.pop_front();
+            guard.unlock();
+            const Band& b = slots[s];
+            bool ok = writer->write(*b.target, b.j0, b.j1);
+            guard.lock();
+            failed = failed || !ok;
+            free_slots.push_back(s);
+            changed.notify_all();
+        }
+    });
+    
+    renderer.setVerbose(false);
+    CameraFrame full = camera.prepare(width, height);
+    int apron = renderer.antialiasingGrid() > 1 ? 1 : 0;
+    int bands = (height + band_rows - 1) / band_rows;
+    double seconds = 0;
+    uint64_t rays = 0;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    
+    for (int b = 0; b < bands; b++) {
+        int s;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&]() { return !free_slots.empty() || failed; });
+            if (failed) break;
+            s = free_slots.back();
+            free_slots.pop_back();
+        }
+        
+        int y0 = b * band_rows, y1 = std::min(height, y0 + band_rows);
+        Tile window(0, std::max(0, y0 - apron), width, std::min(height, y1 + apron));
+        Band& band = slots[s];
+        if (!band.target || band.target->height != window.height()) {
+            band.target.reset(new FrameBuffer(width, window.height(), FrameBuffer::Untouched()));
+        }
+        band.j0 = y0 - window.y0;
+        band.j1 = y1 - window.y0;
+        
+        CameraFrame frame = full.window(window);
+        do {
+            seconds += renderer.render(scene, frame, *band.target);
+            rays += renderer.stats().rays.total();
+        } while (renderer.refining(scene));
+        renderer.resolve(*band.target);
+        
+        std::lock_guard<std::mutex> guard(lock);
+        queued.push_back(s);
+        changed.notify_all();
+        std::cout << "Band " << b + 1 << "/" << bands << " (rows " << y0 << "-" << y1 - 1 << ")\r" << std::flush;
+    }
+    
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        done = true;
+        changed.notify_all();
+    }
+    writing.join();
+    bool ok = !failed && writer->close();
+    double total = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count();
+    std::cout << std::endl;
+    if (!ok) {
+        std::cerr << "Failed to write " << path << std::endl;
+        return false;
+    }
+    std::cout << "Rendered " << width << "x" << height << " in " << bands << " bands of " << band_rows << " rows: "
+              << total << " s (" << seconds << " s tracing, " << rays / std::max(seconds, 1e-9) / 1e6
+              << " Mrays/sec), " << ring << " band buffers" << std::endl;
+    return true;
+}
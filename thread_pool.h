@@ -0,0 +1,210 @@
+// Persistent render threads pinned to CPUs, and the NUMA layout they run on
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+
+// The CPUs this process may run on and the NUMA node of each, read from
+// /sys/devices/system/node; everything is node 0 where that isn't available
+struct CpuTopology {
+    std::vector<int> cpus;      // grouped by node, ascending within a node
+    std::vector<int> node;      // node of each entry of 'cpus', 0 .. nodes-1
+    int nodes;
+    
+    CpuTopology() : nodes(1) {}
+    
+    static CpuTopology detect() {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+            for (unsigned c = 0; c < std::max(1u, std::thread::hardware_concurrency()); c++) CPU_SET(c, &allowed);
+        }
+        
+        // Node of every CPU; -1 for CPUs no node lists
+        std::vector<int> node_of(CPU_SETSIZE, -1);
+        int found = 0;
+        for (int n = 0; n < 1024; n++) {
+            std::ifstream in("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist");
+            if (!in) {
+                if (n > 0) break;           // node numbers start at 0 and have no gaps in practice
+                continue;
+            }
+            std::string list;
+            std::getline(in, list);
+            std::vector<int> listed = parseCpuList(list);
+            bool used = false;
+            for (int c : listed) {
+                if (c >= 0 && c < CPU_SETSIZE && CPU_ISSET(c, &allowed)) {
+                    node_of[c] = found;
+                    used = true;
+                }
+            }
+            found += used;                  // nodes we may not run on are left out
+        }
+        
+        CpuTopology t;
+        t.nodes = std::max(1, found);
+        for (int n = 0; n < t.nodes; n++) {
+            for (int c = 0; c < CPU_SETSIZE; c++) {
+                if (!CPU_ISSET(c, &allowed) || std::max(0, node_of[c]) != n) continue;
+                t.cpus.push_back(c);
+                t.node.push_back(n);
+            }
+        }
+        return t;
+    }
+    
+    // "0-3,8-11" -> 0 1 2 3 8 9 10 11
+    static std::vector<int> parseCpuList(const std::string& list) {
+        std::vector<int> cpus;
+        std::stringstream ss(list);
+        std::string range;
+        while (std::getline(ss, range, ',')) {
+            int lo, hi;
+            if (sscanf(range.c_str(), "%d-%d", &lo, &hi) == 2) {
+                for (int c = lo; c <= hi; c++) cpus.push_back(c);
+            } else if (sscanf(range.c_str(), "%d", &lo) == 1) {
+                cpus.push_back(lo);
+            }
+        }
+        return cpus;
+    }
+};
+
+// OPTIMIZATION 11: Persistent, pinned render threads
+// The threads are started once and wait between run() calls, so interactive
+// and sequence frames don't pay for a team each. Each is pinned to one CPU,
+// taken node by node: thread t stays on the same socket from frame to
+// frame, and the contiguous runs of tiles the TileScheduler deals threads
+// 0 .. k-1 add up to one compact block of the image per node. Memory a
+// thread writes first (see FrameBuffer::Untouched) is therefore placed on
+// the node that renders it
+class ThreadPool {
+public:
+    // pin = false leaves the threads to the OS scheduler; they still persist
+    explicit ThreadPool(int threads, bool pin = true)
+        : topology(CpuTopology::detect()), pin_threads(pin), stopping(false), generation(0), running(0),
+          task(nullptr), arrived(0), barrier_generation(0) {
+        threads = std::max(1, threads);
+        for (int t = 0; t < threads; t++) {
+            int slot = t % std::max<int>(1, int(topology.cpus.size()));
+            thread_node.push_back(topology.cpus.empty() ? 0 : topology.node[slot]);
+            thread_cpu.push_back(topology.cpus.empty() ? -1 : topology.cpus[slot]);
+        }
+        for (int t = 0; t < threads; t++) workers.push_back(std::thread(&ThreadPool::workerLoop, this, t));
+    }
+    
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& w : workers) w.join();
+    }
+    
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    
+    int size() const { return int(workers.size()); }
+    bool pinned() const { return pin_threads; }
+    int nodeCount() const { return topology.nodes; }
+    int nodeOf(int thread) const { return thread_node[thread]; }
+    
+    // Runs task(thread) once on every pool thread and returns when all have
+    // finished. The calling thread only waits, so it keeps its own affinity
+    void run(const std::function<void(int)>& fn) {
+        std::unique_lock<std::mutex> guard(lock);
+        task = &fn;
+        running = size();
+        generation++;
+        wake.notify_all();
+        finished.wait(guard, [this]() { return running == 0; });
+        task = nullptr;
+    }
+    
+    // Inside run(): returns once every pool thread has called it
+    void barrier() {
+        std::unique_lock<std::mutex> guard(barrier_lock);
+        uint64_t gen = barrier_generation;
+        if (++arrived == size()) {
+            arrived = 0;
+            barrier_generation++;
+            barrier_done.notify_all();
+        } else {
+            barrier_done.wait(guard, [&]() { return barrier_generation != gen; });
+        }
+    }
+    
+    // The share [begin, end) of n items that 'thread' takes in a static split
+    static void staticRange(int n, int thread, int threads, int& begin, int& end) {
+        begin = int(int64_t(n) * thread / threads);
+        end = int(int64_t(n) * (thread + 1) / threads);
+    }
+    
+    // NUMA node of the pool thread calling this; 0 on any other thread
+    static int currentNode() { return nodeSlot(); }
+
+private:
+    CpuTopology topology;
+    bool pin_threads;
+    std::vector<int> thread_node, thread_cpu;
+    std::vector<std::thread> workers;
+    
+    std::mutex lock;
+    std::condition_variable wake, finished;
+    bool stopping;
+    uint64_t generation;            // bumped by every run()
+    int running;                    // threads still inside the current task
+    const std::function<void(int)>* task;
+    
+    std::mutex barrier_lock;
+    std::condition_variable barrier_done;
+    int arrived;
+    uint64_t barrier_generation;
+    
+    static int& nodeSlot() {
+        static thread_local int node = 0;
+        return node;
+    }
+    
+    void workerLoop(int thread) {
+        if (pin_threads && thread_cpu[thread] >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(thread_cpu[thread], &set);
+            int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            if (err != 0 && thread == 0) std::cerr << "Could not pin render threads (error " << err << ")" << std::endl;
+        }
+        nodeSlot() = thread_node[thread];
+        
+        uint64_t seen = 0;
+        while (true) {
+            const std::function<void(int)>* fn;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [&]() { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+                fn = task;
+            }
+            
+            (*fn)(thread);
+            
+            std::lock_guard<std::mutex> guard(lock);
+            if (--running == 0) finished.notify_one();
+        }
+    }
+};
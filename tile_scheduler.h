@@ -0,0 +1,156 @@
+// Work-stealing tile queues used by the renderer
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+#include "camera.h"
+
+enum class TileOrder {
+    Scanline,
+    Morton,     // Z-order: neighbouring tiles stay close in the queue
+    Hilbert     // no long jumps between consecutive tiles
+};
+
+// OPTIMIZATION 9: Tile scheduler with per-thread work-stealing deques
+// Tiles are laid out along a space-filling curve and dealt to the threads in
+// contiguous runs. Each thread pops from the front of its own deque; once it
+// is empty it steals from the back of another thread's deque, i.e. the tiles
+// furthest from where that thread is working
+class TileScheduler {
+public:
+    // 'mask', if given, has one entry per tile of the grid, row-major; tiles
+    // whose entry is 0 are left out (see DirtyTiles)
+    TileScheduler(int width, int height, int tile_size, TileOrder order, int threads,
+                  const std::vector<uint8_t>* mask = nullptr)
+        : queues(new WorkQueue[std::max(1, threads)]), queue_count(std::max(1, threads)), done(0) {
+        tile_size = std::max(1, tile_size);
+        int tiles_x = (width + tile_size - 1) / tile_size;
+        int tiles_y = (height + tile_size - 1) / tile_size;
+        
+        std::vector<std::pair<uint64_t, int>> keyed;
+        for (int ty = 0; ty < tiles_y; ty++) {
+            for (int tx = 0; tx < tiles_x; tx++) {
+                int grid_index = ty * tiles_x + tx;
+                if (mask && !(*mask)[grid_index]) continue;
+                keyed.push_back(std::make_pair(curveKey(order, tx, ty, tiles_x, tiles_y), grid_index));
+            }
+        }
+        std::sort(keyed.begin(), keyed.end());
+        
+        for (const auto& k : keyed) {
+            int tx = k.second % tiles_x, ty = k.second / tiles_x;
+            tiles.push_back(Tile(tx * tile_size, ty * tile_size,
+                                 std::min(width, (tx + 1) * tile_size), std::min(height, (ty + 1) * tile_size)));
+        }
+        
+        // Contiguous runs of the curve per thread
+        for (int q = 0; q < queue_count; q++) {
+            int begin, end;
+            dealtRange(q, begin, end);
+            for (int i = begin; i < end; i++) queues[q].tiles.push_back(i);
+        }
+    }
+    
+    int tileCount() const { return int(tiles.size()); }
+    const Tile& tile(int i) const { return tiles[i]; }
+    
+    // The tiles [begin, end) dealt to 'thread' up front, i.e. the ones it
+    // renders unless they are stolen
+    void dealtRange(int thread, int& begin, int& end) const {
+        int n = int(tiles.size()), q = thread % queue_count;
+        begin = n * q / queue_count;
+        end = n * (q + 1) / queue_count;
+    }
+    int tilesDone() const { return done.load(std::memory_order_relaxed); }
+    
+    // Next tile for 'thread': own queue first, then steal; false once all work is gone
+    bool next(int thread, Tile& tile) {
+        int idx;
+        if (popFront(thread % queue_count, idx)) {
+            tile = tiles[idx];
+            return true;
+        }
+        for (int k = 1; k < queue_count; k++) {
+            if (popBack((thread + k) % queue_count, idx)) {
+                tile = tiles[idx];
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    // Called once per finished tile; returns the new completed count
+    int finish() { return done.fetch_add(1, std::memory_order_relaxed) + 1; }
+
+private:
+    // Padded so neighbouring queue locks don't share a cache line
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<int> tiles;
+        char padding[64];
+    };
+    
+    std::vector<Tile> tiles;
+    std::unique_ptr<WorkQueue[]> queues;
+    int queue_count;
+    std::atomic<int> done;
+    
+    bool popFront(int q, int& idx) {
+        std::lock_guard<std::mutex> guard(queues[q].lock);
+        if (queues[q].tiles.empty()) return false;
+        idx = queues[q].tiles.front();
+        queues[q].tiles.pop_front();
+        return true;
+    }
+    
+    bool popBack(int q, int& idx) {
+        std::lock_guard<std::mutex> guard(queues[q].lock);
+        if (queues[q].tiles.empty()) return false;
+        idx = queues[q].tiles.back();
+        queues[q].tiles.pop_back();
+        return true;
+    }
+    
+    static uint64_t curveKey(TileOrder order, int x, int y, int tiles_x, int tiles_y) {
+        switch (order) {
+            case TileOrder::Morton:  return mortonKey(x, y);
+            case TileOrder::Hilbert: return hilbertKey(x, y, std::max(tiles_x, tiles_y));
+            default:                 return uint64_t(y) * tiles_x + x;
+        }
+    }
+    
+    static uint64_t mortonKey(uint32_t x, uint32_t y) {
+        uint64_t key = 0;
+        for (int b = 0; b < 32; b++) {
+            key |= (uint64_t((x >> b) & 1) << (2 * b)) | (uint64_t((y >> b) & 1) << (2 * b + 1));
+        }
+        return key;
+    }
+    
+    // Distance of (x, y) along the Hilbert curve covering the smallest
+    // power-of-two square that holds an extent x extent grid
+    static uint64_t hilbertKey(int x, int y, int extent) {
+        int n = 1;
+        while (n < extent) n <<= 1;
+        uint64_t d = 0;
+        for (int s = n / 2; s > 0; s /= 2) {
+            int rx = (x & s) > 0;
+            int ry = (y & s) > 0;
+            d += uint64_t(s) * s * ((3 * rx) ^ ry);
+            if (ry == 0) {
+                if (rx == 1) {
+                    x = s - 1 - x;
+                    y = s - 1 - y;
+                }
+                std::swap(x, y);
+            }
+        }
+        return d;
+    }
+};